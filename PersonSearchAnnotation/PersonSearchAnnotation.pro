@@ -1,4 +1,4 @@
-QT += core gui sql
+QT += core gui sql concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -9,26 +9,40 @@ TEMPLATE = app
 
 CONFIG += c++11
 
+include(core.pri)
+
 SOURCES += \
   main.cpp \
   gui/MainWindow.cpp \
   gui/PreferencesDialog.cpp \
+  gui/GalleryModel.cpp \
   gui/GalleryNavigator.cpp \
   gui/ImageArea.cpp \
+  gui/CropList.cpp \
+  gui/PersonCropDock.cpp \
+  gui/SuggestionDock.cpp \
+  gui/TilePyramid.cpp \
   utils/PreferencesManager.cpp \
-  utils/util_functions.cpp \
-  db/DatabaseHelper.cpp
+  utils/ImageCache.cpp \
+  utils/CropCache.cpp \
+  utils/ThumbnailCache.cpp \
+  utils/AppearanceEngine.cpp
 
 HEADERS += \
   gui/MainWindow.h \
   gui/PreferencesDialog.h \
+  gui/GalleryModel.h \
   gui/GalleryNavigator.h \
   gui/ImageArea.h \
+  gui/CropList.h \
+  gui/PersonCropDock.h \
+  gui/SuggestionDock.h \
+  gui/TilePyramid.h \
   utils/PreferencesManager.h \
-  utils/util_functions.h \
-  db/DatabaseHelper.h \
-  common/PersonBBox.hpp \
-  common/ImageFile.hpp
+  utils/ImageCache.h \
+  utils/CropCache.h \
+  utils/ThumbnailCache.h \
+  utils/AppearanceEngine.h
 
 RESOURCES += \
   resources.qrc
@@ -0,0 +1,264 @@
+#include "bench/Benchmark.h"
+#include "bench/SyntheticDataGenerator.h"
+#include "utils/AppearanceIndex.h"
+#include "utils/AppearanceDescriptor.h"
+#include <cmath>
+#include <algorithm>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include <QStringList>
+#include <QElapsedTimer>
+
+static const int ImageFilesBatchSize = 1000;
+// One in ten paths of a batch is new
+static const int NewImageFilesPerBatch = 100;
+// Persons suggested for a new bbox
+static const int MaxSuggestions = 8;
+
+// Nearest-rank percentile of sorted samples
+static qint64 percentile(const QVector<qint64>& sorted, double p)
+{
+  int rank = static_cast<int>(std::ceil(p * sorted.size()));
+  return sorted[std::min(std::max(rank, 1), sorted.size()) - 1];
+}
+
+static double toMilliseconds(qint64 nanoseconds)
+{
+  return nanoseconds / 1e6;
+}
+
+Benchmark::Benchmark(const Options& options)
+  : options_(options),
+    random_(options.seed)
+{
+
+}
+
+Benchmark::~Benchmark()
+{
+
+}
+
+QJsonObject Benchmark::run()
+{
+  generate();
+  benchmarkGetPersonBBoxesByImageId();
+  benchmarkSyncPersonBBoxes();
+  benchmarkAddAndQueryImageFiles();
+  benchmarkRemovePersonBBox();
+  benchmarkExports();
+  benchmarkAppearanceSearch();
+
+  QJsonObject config;
+  config["images"] = options_.numImages;
+  config["persons"] = options_.numPersons;
+  config["bboxes_per_image"] = options_.numBBoxesPerImage;
+  config["descriptors"] = options_.numDescriptors;
+  config["distance_kernel"] = QString(AppearanceIndex::getKernelName());
+  config["iterations"] = options_.iterations;
+  config["seed"] = static_cast<qint64>(options_.seed);
+  QJsonObject report;
+  report["config"] = config;
+  report["generate"] = generation_;
+  report["benchmarks"] = results_;
+  return report;
+}
+
+void Benchmark::generate()
+{
+  QFile::remove(options_.databaseFilePath);
+  QElapsedTimer timer;
+  timer.start();
+  databaseHelper_.init(options_.databaseFilePath);
+  SyntheticDataGenerator generator(options_.numImages, options_.numPersons,
+                                   options_.numBBoxesPerImage, options_.seed);
+  qint64 rows = generator.generate();
+  qint64 elapsed = timer.nsecsElapsed();
+  generation_["rows"] = rows;
+  generation_["total_ms"] = toMilliseconds(elapsed);
+  generation_["rows_per_s"] = rows * 1e9 / std::max(elapsed, qint64(1));
+  generation_["file_bytes"] = QFileInfo(options_.databaseFilePath).size();
+}
+
+void Benchmark::benchmarkGetPersonBBoxesByImageId()
+{
+  int imageId = 0;
+  measure("getPersonBBoxesByImageId", options_.iterations,
+          options_.numBBoxesPerImage,
+          [&]() { imageId = randomImageId(); },
+          [&]() { databaseHelper_.getPersonBBoxesByImageId(imageId); });
+}
+
+void Benchmark::benchmarkSyncPersonBBoxes()
+{
+  // A typical save: one bbox moved and one added
+  QVector<PersonBBox> personBBoxes;
+  QVector<bool> removedMarks;
+  QVector<bool> dirtyMarks;
+  measure("syncPersonBBoxes", options_.iterations, 2, [&]() {
+    int imageId = randomImageId();
+    personBBoxes = databaseHelper_.getPersonBBoxesByImageId(imageId);
+    dirtyMarks.fill(false, personBBoxes.size());
+    if (!personBBoxes.isEmpty()) {
+      PersonBBox& personBBox = personBBoxes[0];
+      personBBox.setBBox(personBBox.x() + 1, personBBox.y(),
+                         personBBox.width(), personBBox.height());
+      dirtyMarks[0] = true;
+    }
+    PersonBBox personBBox;
+    personBBox.setBBoxId(0);
+    personBBox.setImageId(imageId);
+    personBBox.setPersonId(0);
+    personBBox.setBBox(10, 10, 40, 100);
+    personBBox.setHard(false);
+    personBBoxes.push_back(personBBox);
+    dirtyMarks.push_back(true);
+    removedMarks.fill(false, personBBoxes.size());
+  }, [&]() {
+    databaseHelper_.syncPersonBBoxes(&personBBoxes, removedMarks, dirtyMarks);
+  });
+}
+
+void Benchmark::benchmarkAddAndQueryImageFiles()
+{
+  // Reopening a folder, with a few images added since
+  int numExisting = std::min(ImageFilesBatchSize - NewImageFilesPerBatch,
+                             options_.numImages);
+  int numAdded = 0;
+  QStringList paths;
+  measure("addAndQueryImageFiles", options_.iterations,
+          numExisting + NewImageFilesPerBatch, [&]() {
+    paths.clear();
+    int begin = std::uniform_int_distribution<int>(
+        0, options_.numImages - numExisting)(random_);
+    for (int i = 0; i < numExisting; ++i) {
+      paths.push_back(SyntheticDataGenerator::getImagePath(begin + i));
+    }
+    for (int i = 0; i < NewImageFilesPerBatch; ++i) {
+      paths.push_back(QString("added/%1.jpg").arg(numAdded++));
+    }
+  }, [&]() {
+    databaseHelper_.addAndQueryImageFiles(paths, "added");
+  });
+}
+
+void Benchmark::benchmarkRemovePersonBBox()
+{
+  PersonBBox personBBox;
+  measure("removePersonBBox", options_.iterations, 1, [&]() {
+    PersonBBox added;
+    added.setBBoxId(0);
+    added.setImageId(randomImageId());
+    added.setPersonId(std::uniform_int_distribution<int>(
+        1, options_.numPersons)(random_));
+    added.setBBox(10, 10, 40, 100);
+    added.setHard(false);
+    personBBox = databaseHelper_.getPersonBBox(
+        databaseHelper_.addPersonBBox(added));
+  }, [&]() {
+    databaseHelper_.removePersonBBox(personBBox);
+  });
+}
+
+void Benchmark::benchmarkExports()
+{
+  QDir outputDirectory(options_.outputDirectory);
+  qint64 numBBoxes = databaseHelper_.getStatistics().value("bboxes");
+  QString filePath = outputDirectory.filePath("bench_person.txt");
+  measureOnce("exportToPersonTxt", numBBoxes, filePath,
+              [&]() { databaseHelper_.exportToPersonTxt(filePath); });
+  filePath = outputDirectory.filePath("bench_image.txt");
+  measureOnce("exportToImageTxt", numBBoxes, filePath,
+              [&]() { databaseHelper_.exportToImageTxt(filePath); });
+  filePath = outputDirectory.filePath("bench.psab");
+  measureOnce("exportToBinary", numBBoxes, filePath,
+              [&]() { databaseHelper_.exportToBinary(filePath); });
+}
+
+void Benchmark::benchmarkAppearanceSearch()
+{
+  if (options_.numDescriptors == 0) return;
+  std::uniform_int_distribution<int> byteDistribution(0, 255);
+  QByteArray descriptor(AppearanceDescriptor::Size, 0);
+  AppearanceIndex index;
+  index.reserve(options_.numDescriptors);
+  for (int i = 0; i < options_.numDescriptors; ++i) {
+    for (int j = 0; j < descriptor.size(); ++j) {
+      descriptor[j] = static_cast<char>(byteDistribution(random_));
+    }
+    int personId = std::uniform_int_distribution<int>(
+        1, options_.numPersons)(random_);
+    index.insert(i + 1, personId, descriptor);
+  }
+  measure("appearanceSearch", options_.iterations, options_.numDescriptors,
+          [&]() {
+    for (int j = 0; j < descriptor.size(); ++j) {
+      descriptor[j] = static_cast<char>(byteDistribution(random_));
+    }
+  }, [&]() { index.search(descriptor, MaxSuggestions); });
+}
+
+void Benchmark::measure(const QString& name, int iterations,
+                        qint64 itemsPerCall,
+                        const std::function<void()>& setup,
+                        const std::function<void()>& run)
+{
+  QVector<qint64> latencies;
+  latencies.reserve(iterations);
+  QElapsedTimer timer;
+  for (int i = 0; i < iterations; ++i) {
+    setup();
+    timer.start();
+    run();
+    latencies.push_back(timer.nsecsElapsed());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  qint64 total = 0;
+  foreach (qint64 latency, latencies) {
+    total += latency;
+  }
+
+  QJsonObject result;
+  result["name"] = name;
+  result["kind"] = QString("latency");
+  result["iterations"] = iterations;
+  if (iterations > 0) {
+    result["mean_ms"] = toMilliseconds(total / iterations);
+    result["p50_ms"] = toMilliseconds(percentile(latencies, 0.50));
+    result["p90_ms"] = toMilliseconds(percentile(latencies, 0.90));
+    result["p99_ms"] = toMilliseconds(percentile(latencies, 0.99));
+    result["max_ms"] = toMilliseconds(latencies.last());
+    result["items_per_s"] =
+        itemsPerCall * iterations * 1e9 / std::max(total, qint64(1));
+  }
+  results_.push_back(result);
+}
+
+void Benchmark::measureOnce(const QString& name, qint64 items,
+                            const QString& outputFilePath,
+                            const std::function<void()>& run)
+{
+  QElapsedTimer timer;
+  timer.start();
+  run();
+  qint64 elapsed = std::max(timer.nsecsElapsed(), qint64(1));
+  qint64 bytes = QFileInfo(outputFilePath).size();
+
+  QJsonObject result;
+  result["name"] = name;
+  result["kind"] = QString("throughput");
+  result["total_ms"] = toMilliseconds(elapsed);
+  result["items"] = items;
+  result["items_per_s"] = items * 1e9 / elapsed;
+  result["bytes"] = bytes;
+  result["megabytes_per_s"] = bytes * 1e9 / elapsed / (1 << 20);
+  results_.push_back(result);
+}
+
+int Benchmark::randomImageId()
+{
+  // The generator numbers the images from 1
+  return std::uniform_int_distribution<int>(1, options_.numImages)(random_);
+}
@@ -0,0 +1,65 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "db/DatabaseHelper.h"
+#include <functional>
+#include <random>
+#include <QString>
+#include <QJsonArray>
+#include <QJsonObject>
+
+class Benchmark
+{
+public:
+  struct Options
+  {
+    QString databaseFilePath;
+    QString outputDirectory;
+    int numImages;
+    int numPersons;
+    int numBBoxesPerImage;
+    int numDescriptors;
+    int iterations;
+    quint32 seed;
+  };
+
+public:
+  explicit Benchmark(const Options& options);
+  ~Benchmark();
+
+  // Returns the report in JSON
+  QJsonObject run();
+
+private:
+  void generate();
+
+  // Latencies of single calls
+  void benchmarkGetPersonBBoxesByImageId();
+  void benchmarkSyncPersonBBoxes();
+  void benchmarkAddAndQueryImageFiles();
+  void benchmarkRemovePersonBBox();
+  // Throughputs of whole-database operations
+  void benchmarkExports();
+  // Brute-force search of random descriptors, in memory
+  void benchmarkAppearanceSearch();
+
+  // Times iterations calls of run, with setup untimed before each
+  void measure(const QString& name, int iterations, qint64 itemsPerCall,
+               const std::function<void()>& setup,
+               const std::function<void()>& run);
+  // Whole-file operations writing to outputFilePath, timed once
+  void measureOnce(const QString& name, qint64 items,
+                   const QString& outputFilePath,
+                   const std::function<void()>& run);
+
+  int randomImageId();
+
+private:
+  Options options_;
+  DatabaseHelper databaseHelper_;
+  std::mt19937 random_;
+  QJsonObject generation_;
+  QJsonArray results_;
+};
+
+#endif // BENCHMARK_H
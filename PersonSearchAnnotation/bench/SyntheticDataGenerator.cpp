@@ -0,0 +1,95 @@
+#include "bench/SyntheticDataGenerator.h"
+#include "db/DatabaseTransaction.h"
+#include "common/ImageFile.hpp"
+#include <random>
+#include <algorithm>
+#include <QSqlQuery>
+#include <QVariant>
+
+static const int ImageWidth = 1920;
+static const int ImageHeight = 1080;
+static const int ImagesPerFolder = 1000;
+
+SyntheticDataGenerator::SyntheticDataGenerator(int numImages, int numPersons,
+                                               int numBBoxesPerImage,
+                                               quint32 seed)
+  : numImages_(numImages),
+    numPersons_(numPersons),
+    numBBoxesPerImage_(numBBoxesPerImage),
+    seed_(seed)
+{
+
+}
+
+SyntheticDataGenerator::~SyntheticDataGenerator()
+{
+
+}
+
+qint64 SyntheticDataGenerator::generate()
+{
+  std::mt19937 random(seed_);
+  std::uniform_int_distribution<int> personDist(1, numPersons_);
+  std::uniform_int_distribution<int> widthDist(20, 200);
+  std::uniform_int_distribution<int> hardDist(0, 9);
+
+  DatabaseTransaction transaction(QSqlDatabase::database(),
+                                  DatabaseTransaction::ModeImmediate);
+  QSqlQuery query;
+  query.prepare("INSERT INTO psa_person(person_id) VALUES(?)");
+  for (int i = 1; i <= numPersons_; ++i) {
+    query.bindValue(0, i);
+    query.exec();
+  }
+  int numFolders = (numImages_ + ImagesPerFolder - 1) / ImagesPerFolder;
+  QString folder;
+  QString name;
+  query.prepare("INSERT INTO psa_folder(folder_id, path, author) "
+                "VALUES(?, ?, 'synthetic')");
+  for (int i = 0; i < numFolders; ++i) {
+    ImageFile::splitPath(getImagePath(i * ImagesPerFolder), &folder, &name);
+    query.bindValue(0, i + 1);
+    query.bindValue(1, folder);
+    query.exec();
+  }
+  query.prepare("INSERT INTO psa_image(image_id, folder_id, name, width, "
+                "    height) VALUES(?, ?, ?, ?, ?)");
+  for (int i = 0; i < numImages_; ++i) {
+    ImageFile::splitPath(getImagePath(i), &folder, &name);
+    query.bindValue(0, i + 1);
+    query.bindValue(1, i / ImagesPerFolder + 1);
+    query.bindValue(2, name);
+    query.bindValue(3, ImageWidth);
+    query.bindValue(4, ImageHeight);
+    query.exec();
+  }
+  query.prepare("INSERT INTO psa_bbox(image_id, person_id, x, y, width, "
+                "    height, hard) VALUES(?, ?, ?, ?, ?, ?, ?)");
+  for (int i = 0; i < numImages_; ++i) {
+    for (int j = 0; j < numBBoxesPerImage_; ++j) {
+      // Pedestrians are about two and a half times as tall as wide
+      int width = widthDist(random);
+      int height = std::min(width * 5 / 2, ImageHeight);
+      int x = std::uniform_int_distribution<int>(0, ImageWidth - width)(random);
+      int y = std::uniform_int_distribution<int>(0, ImageHeight - height)(random);
+      query.bindValue(0, i + 1);
+      query.bindValue(1, personDist(random));
+      query.bindValue(2, x);
+      query.bindValue(3, y);
+      query.bindValue(4, width);
+      query.bindValue(5, height);
+      query.bindValue(6, hardDist(random) == 0 ? 1 : 0);
+      query.exec();
+    }
+  }
+  transaction.commit();
+  return numPersons_ + numFolders + numImages_ +
+         static_cast<qint64>(numImages_) * numBBoxesPerImage_;
+}
+
+QString SyntheticDataGenerator::getImagePath(int index)
+{
+  return QString("synthetic/%1/%2.jpg")
+      .arg(index / ImagesPerFolder, 4, 10, QChar('0'))
+      .arg(index, 8, 10, QChar('0'));
+}
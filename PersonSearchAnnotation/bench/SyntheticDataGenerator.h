@@ -0,0 +1,28 @@
+#ifndef SYNTHETICDATAGENERATOR_H
+#define SYNTHETICDATAGENERATOR_H
+
+#include <QString>
+
+// Fills the database opened by DatabaseHelper with random but reproducible
+// annotations. The same options always produce the same rows. Needs at
+// least one person.
+class SyntheticDataGenerator
+{
+public:
+  SyntheticDataGenerator(int numImages, int numPersons,
+                         int numBBoxesPerImage, quint32 seed);
+  ~SyntheticDataGenerator();
+
+  // Returns the number of rows inserted
+  qint64 generate();
+
+  static QString getImagePath(int index);
+
+private:
+  int numImages_;
+  int numPersons_;
+  int numBBoxesPerImage_;
+  quint32 seed_;
+};
+
+#endif // SYNTHETICDATAGENERATOR_H
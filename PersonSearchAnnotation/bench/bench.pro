@@ -0,0 +1,20 @@
+QT += core gui sql
+
+QMAKE_MAC_SDK = macosx10.11
+
+TARGET = psa-bench
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../core.pri)
+
+SOURCES += \
+  main.cpp \
+  Benchmark.cpp \
+  SyntheticDataGenerator.cpp
+
+HEADERS += \
+  Benchmark.h \
+  SyntheticDataGenerator.h
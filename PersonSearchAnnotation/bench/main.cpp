@@ -0,0 +1,82 @@
+#include "bench/Benchmark.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  QCoreApplication::setOrganizationName("CUHK");
+  QCoreApplication::setApplicationName("Person Search Annotation");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Benchmarks the database operations on synthetic annotations");
+  parser.addHelpOption();
+  QCommandLineOption databaseOption("database",
+      "Database file to create, replaced if it exists.", "file");
+  QCommandLineOption imagesOption("images", "Number of images.", "n", "10000");
+  QCommandLineOption personsOption("persons", "Number of persons.", "n",
+                                   "2000");
+  QCommandLineOption bboxesOption("bboxes-per-image",
+      "Number of bboxes per image.", "n", "8");
+  QCommandLineOption descriptorsOption("descriptors",
+      "Appearance descriptors searched, 0 to skip.", "n", "1000000");
+  QCommandLineOption iterationsOption("iterations",
+      "Calls timed per operation.", "n", "1000");
+  QCommandLineOption seedOption("seed", "Random seed.", "n", "1");
+  QCommandLineOption outputOption("output",
+      "JSON report file, stdout if not given.", "file");
+  parser.addOptions(QList<QCommandLineOption>() << databaseOption
+                    << imagesOption << personsOption << bboxesOption
+                    << descriptorsOption << iterationsOption << seedOption
+                    << outputOption);
+  parser.process(a);
+
+  QTextStream err(stderr);
+  bool ok[6];
+  Benchmark::Options options;
+  options.numImages = parser.value(imagesOption).toInt(&ok[0]);
+  options.numPersons = parser.value(personsOption).toInt(&ok[1]);
+  options.numBBoxesPerImage = parser.value(bboxesOption).toInt(&ok[2]);
+  options.iterations = parser.value(iterationsOption).toInt(&ok[3]);
+  options.seed = parser.value(seedOption).toUInt(&ok[4]);
+  options.numDescriptors = parser.value(descriptorsOption).toInt(&ok[5]);
+  if (!(ok[0] && ok[1] && ok[2] && ok[3] && ok[4] && ok[5]) ||
+      options.numImages < 1 || options.numPersons < 1 ||
+      options.numBBoxesPerImage < 0 || options.numDescriptors < 0 ||
+      options.iterations < 1) {
+    err << "Invalid options, there must be at least one image and person\n";
+    return 1;
+  }
+
+  // Exports and the default database go to a directory removed on exit
+  QTemporaryDir temporaryDir;
+  if (!temporaryDir.isValid()) {
+    err << "Cannot create a temporary directory\n";
+    return 1;
+  }
+  options.outputDirectory = temporaryDir.path();
+  options.databaseFilePath = parser.isSet(databaseOption)
+      ? parser.value(databaseOption)
+      : QDir(temporaryDir.path()).filePath("bench.sqlite");
+
+  Benchmark benchmark(options);
+  QByteArray report = QJsonDocument(benchmark.run()).toJson();
+
+  if (!parser.isSet(outputOption)) {
+    QTextStream(stdout) << report;
+    return 0;
+  }
+  QFile file(parser.value(outputOption));
+  if (!file.open(QIODevice::WriteOnly) || file.write(report) < 0) {
+    err << "Cannot write " << file.fileName() << "\n";
+    return 1;
+  }
+  return 0;
+}
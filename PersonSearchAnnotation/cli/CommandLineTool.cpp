@@ -0,0 +1,286 @@
+#include "cli/CommandLineTool.h"
+#include "common/BinaryAnnotation.hpp"
+#include <cstdio>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+CommandLineTool::CommandLineTool()
+  : out_(stdout),
+    err_(stderr)
+{
+  databaseHelper_.setProgressCallback(
+      [this](qint64 done, qint64 total) { printProgress(done, total); });
+}
+
+CommandLineTool::~CommandLineTool()
+{
+
+}
+
+int CommandLineTool::run(const QStringList& arguments)
+{
+  if (arguments.size() < 2) {
+    printUsage();
+    return 1;
+  }
+  QString command = arguments[0];
+  QStringList rest = arguments.mid(1);
+  if (command == "export-person") return exportToPersonTxt(rest);
+  if (command == "export-image") return exportToImageTxt(rest);
+  if (command == "export-binary") return exportToBinary(rest);
+  if (command == "inspect-binary") return inspectBinary(rest);
+  if (command == "import") return importFolder(rest);
+  if (command == "import-person") return importFromTxt(rest, true);
+  if (command == "import-image") return importFromTxt(rest, false);
+  if (command == "stats") return printStatistics(rest);
+  if (command == "check") return checkIntegrity(rest);
+  if (command == "validate") return validateDataset(rest);
+  printUsage();
+  return 1;
+}
+
+int CommandLineTool::exportToPersonTxt(const QStringList& arguments)
+{
+  if (arguments.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(arguments[0])) return 1;
+  timer_.start();
+  if (!databaseHelper_.exportToPersonTxt(arguments[1])) {
+    err_ << "cannot write " << arguments[1] << endl;
+    return 1;
+  }
+  printElapsed("export " + arguments[1]);
+  return 0;
+}
+
+int CommandLineTool::exportToImageTxt(const QStringList& arguments)
+{
+  if (arguments.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(arguments[0])) return 1;
+  timer_.start();
+  if (!databaseHelper_.exportToImageTxt(arguments[1])) {
+    err_ << "cannot write " << arguments[1] << endl;
+    return 1;
+  }
+  printElapsed("export " + arguments[1]);
+  return 0;
+}
+
+int CommandLineTool::exportToBinary(const QStringList& arguments)
+{
+  if (arguments.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(arguments[0])) return 1;
+  timer_.start();
+  if (!databaseHelper_.exportToBinary(arguments[1])) {
+    err_ << "cannot write " << arguments[1] << endl;
+    return 1;
+  }
+  printElapsed("export " + arguments[1]);
+  return 0;
+}
+
+int CommandLineTool::inspectBinary(const QStringList& arguments)
+{
+  if (arguments.size() != 1) {
+    printUsage();
+    return 1;
+  }
+  timer_.start();
+  psa::BinaryAnnotation annotation;
+  if (!annotation.open(QFile::encodeName(arguments[0]).constData())) {
+    err_ << "not a binary annotation file: " << arguments[0] << endl;
+    return 1;
+  }
+  printElapsed("open " + arguments[0]);
+  out_ << "images\t" << annotation.getImageCount() << endl
+       << "persons\t" << annotation.getPersonCount() << endl
+       << "bboxes\t" << annotation.getBBoxCount() << endl;
+  return 0;
+}
+
+int CommandLineTool::importFolder(const QStringList& arguments)
+{
+  QStringList positional = arguments;
+  bool recursive = positional.removeAll("--recursive") > 0;
+  if (positional.size() != 3) {
+    printUsage();
+    return 1;
+  }
+  QString root = QDir(positional[1]).absolutePath();
+  QString folder = QDir(positional[2]).absolutePath();
+  if (folder == root || QDir(root).relativeFilePath(folder).startsWith("..")) {
+    err_ << "folder must be under the images root directory" << endl;
+    return 1;
+  }
+  if (!openDatabase(positional[0], true)) return 1;
+  timer_.start();
+  QVector<ImageFile> imageFiles = databaseHelper_.importFolder(
+      root, folder, recursive);
+  printElapsed(QString("import %1 images").arg(imageFiles.size()));
+  return 0;
+}
+
+int CommandLineTool::importFromTxt(const QStringList& arguments,
+                                   bool byPerson)
+{
+  if (arguments.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  if (!QFileInfo(arguments[1]).isFile()) {
+    err_ << "no such file: " << arguments[1] << endl;
+    return 1;
+  }
+  if (!openDatabase(arguments[0], true)) return 1;
+  timer_.start();
+  QString errorMessage;
+  bool ok = byPerson ?
+      databaseHelper_.importFromPersonTxt(arguments[1], &errorMessage) :
+      databaseHelper_.importFromImageTxt(arguments[1], &errorMessage);
+  if (!ok) {
+    err_ << arguments[1] << ": " << errorMessage << endl;
+    return 2;
+  }
+  printElapsed("import " + arguments[1]);
+  return 0;
+}
+
+int CommandLineTool::printStatistics(const QStringList& arguments)
+{
+  if (arguments.size() != 1) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(arguments[0])) return 1;
+  timer_.start();
+  QMap<QString, qint64> statistics = databaseHelper_.getStatistics();
+  for (QMap<QString, qint64>::const_iterator it = statistics.constBegin();
+       it != statistics.constEnd(); ++it) {
+    out_ << it.key() << "\t" << it.value() << endl;
+  }
+  printElapsed("stats");
+  return 0;
+}
+
+int CommandLineTool::checkIntegrity(const QStringList& arguments)
+{
+  if (arguments.size() != 1) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(arguments[0])) return 1;
+  timer_.start();
+  QStringList problems = databaseHelper_.checkIntegrity();
+  foreach (const QString& problem, problems) {
+    out_ << problem << endl;
+  }
+  printElapsed(QString("check, %1 problems").arg(problems.size()));
+  return problems.isEmpty() ? 0 : 2;
+}
+
+int CommandLineTool::validateDataset(const QStringList& arguments)
+{
+  QStringList positional = arguments;
+  int numThreads = 0;
+  int i = positional.indexOf("--threads");
+  if (i >= 0) {
+    bool ok = false;
+    if (i + 1 < positional.size()) numThreads = positional[i + 1].toInt(&ok);
+    if (!ok || numThreads <= 0) {
+      printUsage();
+      return 1;
+    }
+    positional.erase(positional.begin() + i, positional.begin() + i + 2);
+  }
+  if (positional.size() != 1 && positional.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  if (!openDatabase(positional[0])) return 1;
+  timer_.start();
+  DatasetValidator::Report report = databaseHelper_.validateDataset(numThreads);
+  if (!report.error.isEmpty()) {
+    err_ << "cannot read the database: " << report.error << endl;
+    return 1;
+  }
+  for (int type = 0; type < DatasetValidator::NumIssueTypes; ++type) {
+    DatasetValidator::IssueType issueType =
+        static_cast<DatasetValidator::IssueType>(type);
+    out_ << DatasetValidator::getIssueName(issueType) << "\t"
+         << report.getCount(issueType) << endl;
+  }
+  if (positional.size() == 2 && !report.save(positional[1])) {
+    err_ << "cannot write " << positional[1] << endl;
+    return 1;
+  }
+  printElapsed(QString("validate %1 images, %2 bboxes on %3 threads, "
+                       "%4 issues").arg(report.numImages)
+               .arg(report.numBBoxes).arg(report.numThreads)
+               .arg(report.issues.size()));
+  return report.issues.isEmpty() ? 0 : 2;
+}
+
+bool CommandLineTool::openDatabase(const QString& filePath, bool create)
+{
+  if (!create && !QFileInfo(filePath).isFile()) {
+    err_ << "no such database: " << filePath << endl;
+    return false;
+  }
+  timer_.start();
+  if (!databaseHelper_.init(filePath)) {
+    err_ << "cannot open database: " << filePath << endl;
+    return false;
+  }
+  printElapsed("open " + filePath);
+  return true;
+}
+
+void CommandLineTool::printUsage()
+{
+  err_ << "Usage: psa-cli <command> <database> [arguments]" << endl
+       << endl
+       << "Commands:" << endl
+       << "  export-person <output>         "
+          "export annotations grouped by person" << endl
+       << "  export-image <output>          "
+          "export annotations grouped by image" << endl
+       << "  export-binary <output>         "
+          "export a memory-mappable binary file" << endl
+       << "  import [--recursive] <images-root> <folder>" << endl
+       << "                                 "
+          "add the images of a folder" << endl
+       << "  import-person <input>          "
+          "import annotations grouped by person" << endl
+       << "  import-image <input>           "
+          "import annotations grouped by image" << endl
+       << "  stats                          "
+          "print statistics of the database" << endl
+       << "  check                          "
+          "check integrity of the database" << endl
+       << "  validate [--threads <n>] [<report.json>]" << endl
+       << "                                 "
+          "check the annotations, optionally writing a report" << endl
+       << endl
+       << "       psa-cli inspect-binary <file>" << endl;
+}
+
+void CommandLineTool::printProgress(qint64 done, qint64 total)
+{
+  err_ << "\r  " << done << " / " << total;
+  if (done >= total) err_ << endl;
+  err_.flush();
+}
+
+void CommandLineTool::printElapsed(const QString& task)
+{
+  err_ << task << ": " << timer_.elapsed() << " ms" << endl;
+}
@@ -0,0 +1,40 @@
+#ifndef COMMANDLINETOOL_H
+#define COMMANDLINETOOL_H
+
+#include "db/DatabaseHelper.h"
+#include <QStringList>
+#include <QTextStream>
+#include <QElapsedTimer>
+
+class CommandLineTool
+{
+public:
+  CommandLineTool();
+  ~CommandLineTool();
+
+  int run(const QStringList& arguments);
+
+private:
+  int exportToPersonTxt(const QStringList& arguments);
+  int exportToImageTxt(const QStringList& arguments);
+  int exportToBinary(const QStringList& arguments);
+  int inspectBinary(const QStringList& arguments);
+  int importFolder(const QStringList& arguments);
+  int importFromTxt(const QStringList& arguments, bool byPerson);
+  int printStatistics(const QStringList& arguments);
+  int checkIntegrity(const QStringList& arguments);
+  int validateDataset(const QStringList& arguments);
+
+  bool openDatabase(const QString& filePath, bool create = false);
+  void printUsage();
+  void printProgress(qint64 done, qint64 total);
+  void printElapsed(const QString& task);
+
+private:
+  DatabaseHelper databaseHelper_;
+  QTextStream out_;
+  QTextStream err_;
+  QElapsedTimer timer_;
+};
+
+#endif // COMMANDLINETOOL_H
@@ -0,0 +1,18 @@
+QT += core gui sql
+
+QMAKE_MAC_SDK = macosx10.11
+
+TARGET = psa-cli
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../core.pri)
+
+SOURCES += \
+  main.cpp \
+  CommandLineTool.cpp
+
+HEADERS += \
+  CommandLineTool.h
@@ -0,0 +1,13 @@
+#include "cli/CommandLineTool.h"
+#include <QCoreApplication>
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  QCoreApplication::setOrganizationName("CUHK");
+  QCoreApplication::setApplicationName("Person Search Annotation");
+
+  CommandLineTool tool;
+  return tool.run(a.arguments().mid(1));
+}
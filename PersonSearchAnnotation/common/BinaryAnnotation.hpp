@@ -0,0 +1,356 @@
+#ifndef BINARYANNOTATION_HPP
+#define BINARYANNOTATION_HPP
+
+// Binary annotation files written by DatabaseHelper::exportToBinary, and a
+// reader for them. Depends on nothing but the standard library and the OS,
+// so that training code can include this header alone.
+//
+// The file starts with a Header, followed by arrays of native little-endian
+// integers, each aligned to 8 bytes and located by the offsets in the header:
+//
+//   images   ids, widths, heights, path offsets into the string table, and
+//            the index of the first bbox of each image (n + 1 entries)
+//   persons  ids, and the start of each person in personBBoxes (n + 1)
+//   bboxes   ids, image and person indices, x, y, widths, heights, hards,
+//            one array per field, sorted by image and then by bbox id
+//   personBBoxes  bbox indices grouped by person, in image order
+//   strings  NUL-terminated UTF-8 paths relative to the images root
+//
+// Images and persons are sorted by id, so they can be found by bisection.
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace psa
+{
+
+namespace binary
+{
+
+static const char Magic[4] = {'P', 'S', 'A', 'B'};
+static const uint32_t Version = 1;
+static const uint32_t ByteOrderMark = 0x01020304;
+static const uint64_t Alignment = 8;
+
+struct Header
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint32_t numImages;
+  uint32_t numPersons;
+  uint32_t numBBoxes;
+  uint64_t stringTableSize;
+
+  uint64_t imageIds;
+  uint64_t imageWidths;
+  uint64_t imageHeights;
+  uint64_t imagePathOffsets;
+  uint64_t imageBBoxBegins;
+
+  uint64_t personIds;
+  uint64_t personBBoxBegins;
+  uint64_t personBBoxes;
+
+  uint64_t bboxIds;
+  uint64_t bboxImages;
+  uint64_t bboxPersons;
+  uint64_t bboxXs;
+  uint64_t bboxYs;
+  uint64_t bboxWidths;
+  uint64_t bboxHeights;
+  uint64_t bboxHards;
+
+  uint64_t stringTable;
+  uint64_t fileSize;
+};
+
+inline uint64_t align(uint64_t offset)
+{
+  return (offset + Alignment - 1) / Alignment * Alignment;
+}
+
+// Fills in the offsets of a header whose counts are set, as the writer lays
+// out the arrays
+inline void layOut(Header* header)
+{
+  uint64_t offset = align(sizeof(Header));
+  uint64_t numImages = header->numImages;
+  uint64_t numPersons = header->numPersons;
+  uint64_t numBBoxes = header->numBBoxes;
+  uint64_t* sections[] = {
+    &header->imageIds, &header->imageWidths, &header->imageHeights,
+    &header->imagePathOffsets, &header->imageBBoxBegins,
+    &header->personIds, &header->personBBoxBegins, &header->personBBoxes,
+    &header->bboxIds, &header->bboxImages, &header->bboxPersons,
+    &header->bboxXs, &header->bboxYs, &header->bboxWidths,
+    &header->bboxHeights, &header->bboxHards, &header->stringTable
+  };
+  const uint64_t sizes[] = {
+    4 * numImages, 4 * numImages, 4 * numImages,
+    4 * numImages, 4 * (numImages + 1),
+    4 * numPersons, 4 * (numPersons + 1), 4 * numBBoxes,
+    4 * numBBoxes, 4 * numBBoxes, 4 * numBBoxes,
+    4 * numBBoxes, 4 * numBBoxes, 4 * numBBoxes,
+    4 * numBBoxes, numBBoxes, header->stringTableSize
+  };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    *sections[i] = offset;
+    offset = align(offset + sizes[i]);
+  }
+  header->fileSize = offset;
+}
+
+}
+
+class BinaryAnnotation
+{
+public:
+  BinaryAnnotation() : data_(NULL), size_(0), header_(NULL) {}
+  ~BinaryAnnotation() { close(); }
+
+  // Maps the whole file read-only, nothing is copied
+  bool open(const char* filePath)
+  {
+    close();
+    if (!map(filePath)) return false;
+    if (!validate()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (data_) unmap();
+    data_ = NULL;
+    size_ = 0;
+    header_ = NULL;
+  }
+
+  bool isOpen() const { return data_ != NULL; }
+
+  uint32_t getImageCount() const { return header_->numImages; }
+  uint32_t getPersonCount() const { return header_->numPersons; }
+  uint32_t getBBoxCount() const { return header_->numBBoxes; }
+
+  int32_t getImageId(uint32_t image) const
+  {
+    return array<int32_t>(header_->imageIds)[image];
+  }
+  int32_t getImageWidth(uint32_t image) const
+  {
+    return array<int32_t>(header_->imageWidths)[image];
+  }
+  int32_t getImageHeight(uint32_t image) const
+  {
+    return array<int32_t>(header_->imageHeights)[image];
+  }
+  const char* getImagePath(uint32_t image) const
+  {
+    return array<char>(header_->stringTable) +
+           array<uint32_t>(header_->imagePathOffsets)[image];
+  }
+  // Bboxes of an image are the indices in [begin, end)
+  uint32_t getImageBBoxBegin(uint32_t image) const
+  {
+    return array<uint32_t>(header_->imageBBoxBegins)[image];
+  }
+  uint32_t getImageBBoxEnd(uint32_t image) const
+  {
+    return array<uint32_t>(header_->imageBBoxBegins)[image + 1];
+  }
+
+  int32_t getPersonId(uint32_t person) const
+  {
+    return array<int32_t>(header_->personIds)[person];
+  }
+  uint32_t getPersonBBoxCount(uint32_t person) const
+  {
+    const uint32_t* begins = array<uint32_t>(header_->personBBoxBegins);
+    return begins[person + 1] - begins[person];
+  }
+  // Index of the k-th bbox of a person
+  uint32_t getPersonBBox(uint32_t person, uint32_t k) const
+  {
+    const uint32_t* begins = array<uint32_t>(header_->personBBoxBegins);
+    return array<uint32_t>(header_->personBBoxes)[begins[person] + k];
+  }
+
+  // Fields of the bboxes, each as a contiguous array over all bboxes
+  const int32_t* getBBoxIds() const { return array<int32_t>(header_->bboxIds); }
+  const uint32_t* getBBoxImages() const
+  {
+    return array<uint32_t>(header_->bboxImages);
+  }
+  const uint32_t* getBBoxPersons() const
+  {
+    return array<uint32_t>(header_->bboxPersons);
+  }
+  const int32_t* getBBoxXs() const { return array<int32_t>(header_->bboxXs); }
+  const int32_t* getBBoxYs() const { return array<int32_t>(header_->bboxYs); }
+  const int32_t* getBBoxWidths() const
+  {
+    return array<int32_t>(header_->bboxWidths);
+  }
+  const int32_t* getBBoxHeights() const
+  {
+    return array<int32_t>(header_->bboxHeights);
+  }
+  const uint8_t* getBBoxHards() const
+  {
+    return array<uint8_t>(header_->bboxHards);
+  }
+
+  // Returns the index of the image or person, -1 if there is none
+  int64_t findImage(int32_t imageId) const
+  {
+    return find(array<int32_t>(header_->imageIds), header_->numImages,
+                imageId);
+  }
+  int64_t findPerson(int32_t personId) const
+  {
+    return find(array<int32_t>(header_->personIds), header_->numPersons,
+                personId);
+  }
+
+private:
+  BinaryAnnotation(const BinaryAnnotation&);
+  const BinaryAnnotation& operator = (const BinaryAnnotation&);
+
+  template <typename T>
+  const T* array(uint64_t offset) const
+  {
+    return reinterpret_cast<const T*>(data_ + offset);
+  }
+
+  static int64_t find(const int32_t* ids, uint32_t n, int32_t id)
+  {
+    const int32_t* it = std::lower_bound(ids, ids + n, id);
+    if (it == ids + n || *it != id) return -1;
+    return it - ids;
+  }
+
+  bool validate()
+  {
+    if (size_ < sizeof(binary::Header)) return false;
+    header_ = reinterpret_cast<const binary::Header*>(data_);
+    if (std::memcmp(header_->magic, binary::Magic, 4) != 0 ||
+        header_->version != binary::Version ||
+        header_->byteOrderMark != binary::ByteOrderMark) {
+      return false;
+    }
+    // The offsets must be the ones the writer would use for these counts
+    binary::Header expected = *header_;
+    binary::layOut(&expected);
+    if (std::memcmp(&expected, header_, sizeof(binary::Header)) != 0 ||
+        header_->fileSize > size_) {
+      return false;
+    }
+    // Paths must not run off the string table
+    const char* strings = array<char>(header_->stringTable);
+    if (header_->stringTableSize > 0 &&
+        strings[header_->stringTableSize - 1] != '\0') {
+      return false;
+    }
+    const uint32_t* pathOffsets = array<uint32_t>(header_->imagePathOffsets);
+    for (uint32_t i = 0; i < header_->numImages; ++i) {
+      if (pathOffsets[i] >= header_->stringTableSize) return false;
+    }
+    // Neither may the groups run off the bboxes, nor the indices off their
+    // arrays
+    return isPartition(array<uint32_t>(header_->imageBBoxBegins),
+                       header_->numImages) &&
+           isPartition(array<uint32_t>(header_->personBBoxBegins),
+                       header_->numPersons) &&
+           isBelow(array<uint32_t>(header_->bboxImages), header_->numBBoxes,
+                   header_->numImages) &&
+           isBelow(array<uint32_t>(header_->bboxPersons), header_->numBBoxes,
+                   header_->numPersons) &&
+           isBelow(array<uint32_t>(header_->personBBoxes), header_->numBBoxes,
+                   header_->numBBoxes);
+  }
+
+  static bool isBelow(const uint32_t* values, uint32_t n, uint32_t bound)
+  {
+    for (uint32_t i = 0; i < n; ++i) {
+      if (values[i] >= bound) return false;
+    }
+    return true;
+  }
+
+  bool isPartition(const uint32_t* begins, uint32_t n) const
+  {
+    if (begins[0] != 0 || begins[n] != header_->numBBoxes) return false;
+    for (uint32_t i = 0; i < n; ++i) {
+      if (begins[i] > begins[i + 1]) return false;
+    }
+    return true;
+  }
+
+#ifdef _WIN32
+  bool map(const char* filePath)
+  {
+    HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+    if (!mapping) return false;
+    data_ = static_cast<const char*>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (!data_) return false;
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    return true;
+  }
+
+  void unmap() { UnmapViewOfFile(data_); }
+#else
+  bool map(const char* filePath)
+  {
+    int fd = ::open(filePath, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<uint64_t>(st.st_size);
+    return true;
+  }
+
+  void unmap() { munmap(const_cast<char*>(data_), size_); }
+#endif
+
+private:
+  const char* data_;
+  uint64_t size_;
+  const binary::Header* header_;
+};
+
+}
+
+#endif // BINARYANNOTATION_HPP
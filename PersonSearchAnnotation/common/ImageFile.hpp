@@ -2,11 +2,12 @@
 #define IMAGEFILE_HPP
 
 #include <QString>
+#include <QSize>
 
 class ImageFile
 {
 public:
-  ImageFile(): imageId_(-1) {}
+  ImageFile(): imageId_(-1), width_(0), height_(0), orientation_(0) {}
   ~ImageFile() {}
 
   bool isNull() const { return imageId_ == -1; }
@@ -14,17 +15,54 @@ public:
   inline int getImageId() const { return imageId_; }
   void setImageId(int imageId) { imageId_ = imageId; }
 
-  inline QString getPath() const { return path_; }
-  void setPath(const QString& path) { path_ = path; }
+  // Relative to the images root directory
+  inline QString getPath() const { return folder_ + name_; }
+  void setPath(const QString& path) { splitPath(path, &folder_, &name_); }
+
+  // The folder ends with a slash, or is empty for the images root. Images
+  // read from the database share the string with the others in the folder.
+  inline QString getFolder() const { return folder_; }
+  void setFolder(const QString& folder) { folder_ = folder; }
+  inline QString getName() const { return name_; }
+  void setName(const QString& name) { name_ = name; }
+
+  static void splitPath(const QString& path, QString* folder, QString* name) {
+    int n = path.lastIndexOf('/') + 1;
+    *folder = path.left(n);
+    *name = path.mid(n);
+  }
 
   inline QString getAuthor() const { return author_; }
   void setAuthor(const QString& author) { author_ = author; }
 
+  // Size as stored in the file, zero if not probed yet
+  inline int width() const { return width_; }
+  inline int height() const { return height_; }
+  inline bool hasSize() const { return width_ > 0 && height_ > 0; }
+  void setSize(int width, int height) {
+    width_ = width;
+    height_ = height;
+  }
+
+  // QImageIOHandler::Transformations read from the EXIF orientation
+  inline int getOrientation() const { return orientation_; }
+  void setOrientation(int orientation) { orientation_ = orientation; }
+
+  // Size after applying the orientation, as shown in the image areas
+  QSize getDisplaySize() const {
+    // QImageIOHandler::TransformationRotate90
+    if (orientation_ & 0x4) return QSize(height_, width_);
+    return QSize(width_, height_);
+  }
+
 private:
   int imageId_;
-  QString path_;
+  QString folder_;
+  QString name_;
   QString author_;
+  int width_;
+  int height_;
+  int orientation_;
 };
 
 #endif // IMAGEFILE_HPP
-
@@ -4,7 +4,7 @@
 class PersonBBox
 {
 public:
-  PersonBBox() : bboxId_(-1) {}
+  PersonBBox() : bboxId_(-1), version_(0) {}
   ~PersonBBox() {}
 
   bool isNull() const { return bboxId_ == -1; }
@@ -32,6 +32,10 @@ public:
   inline int isHard() const { return hard_; }
   inline void setHard(bool hard) { hard_ = hard; }
 
+  // Row version read from the database, bumped by every update
+  inline int getVersion() const { return version_; }
+  inline void setVersion(int version) { version_ = version; }
+
 private:
   int bboxId_;
   int imageId_;
@@ -41,6 +45,7 @@ private:
   int width_;
   int height_;
   bool hard_;
+  int version_;
 };
 
 #endif // PERSONBBOX_H
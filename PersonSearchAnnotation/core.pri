@@ -0,0 +1,37 @@
+# Sources shared by the GUI and the command-line tools. Must not depend on
+# widgets. QtGui is needed only for reading image headers.
+
+QT += core gui sql concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+  $$PWD/utils/util_functions.cpp \
+  $$PWD/utils/BufferedReader.cpp \
+  $$PWD/utils/BufferedWriter.cpp \
+  $$PWD/utils/Trace.cpp \
+  $$PWD/utils/AppearanceDescriptor.cpp \
+  $$PWD/utils/AppearanceIndex.cpp \
+  $$PWD/db/DatabaseHelper.cpp \
+  $$PWD/db/AnnotationStore.cpp \
+  $$PWD/db/FolderDictionary.cpp \
+  $$PWD/db/DatasetValidator.cpp \
+  $$PWD/db/DatabaseTransaction.cpp \
+  $$PWD/db/DatabaseWorker.cpp
+
+HEADERS += \
+  $$PWD/utils/util_functions.h \
+  $$PWD/utils/BufferedReader.h \
+  $$PWD/utils/BufferedWriter.h \
+  $$PWD/utils/Trace.h \
+  $$PWD/utils/AppearanceDescriptor.h \
+  $$PWD/utils/AppearanceIndex.h \
+  $$PWD/db/DatabaseHelper.h \
+  $$PWD/db/AnnotationStore.h \
+  $$PWD/db/FolderDictionary.h \
+  $$PWD/db/DatasetValidator.h \
+  $$PWD/db/DatabaseTransaction.h \
+  $$PWD/db/DatabaseWorker.h \
+  $$PWD/common/PersonBBox.hpp \
+  $$PWD/common/BinaryAnnotation.hpp \
+  $$PWD/common/ImageFile.hpp
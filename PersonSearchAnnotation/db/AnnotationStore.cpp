@@ -0,0 +1,285 @@
+#include "db/AnnotationStore.h"
+#include "db/DatabaseTransaction.h"
+#include "utils/Trace.h"
+#include <algorithm>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+// Changes written at once at most, so that a flush stays short
+static const int WriteBatchSize = 1000;
+
+// The transaction of the caller is rolled back as it goes out of scope
+static bool failWrite(const QSqlQuery& query)
+{
+  qDebug() << "writing annotations failed:" << query.lastError().text();
+  return false;
+}
+
+AnnotationStore::AnnotationStore(const QSqlDatabase& db)
+  : db_(db),
+    nextPersonId_(1)
+{
+
+}
+
+AnnotationStore::~AnnotationStore()
+{
+
+}
+
+void AnnotationStore::load()
+{
+  PSA_TRACE_SCOPE("AnnotationStore::load");
+  QSqlQuery query(db_);
+  query.setForwardOnly(true);
+  query.exec("SELECT person_id FROM psa_person");
+  while (query.next()) {
+    int personId = query.value(0).toInt();
+    personIds_.insert(personId);
+    nextPersonId_ = std::max(nextPersonId_, personId + 1);
+  }
+
+  query.exec("SELECT MAX(bbox_id) FROM psa_bbox");
+  if (query.next()) records_.reserve(query.value(0).toInt() + 1);
+  query.exec("SELECT bbox_id, image_id, person_id, x, y, width, height, "
+             "    hard, version "
+             "FROM psa_bbox");
+  while (query.next()) {
+    Record record;
+    record.imageId = query.value(1).toInt();
+    record.personId = query.value(2).toInt();
+    record.x = query.value(3).toInt();
+    record.y = query.value(4).toInt();
+    record.width = query.value(5).toInt();
+    record.height = query.value(6).toInt();
+    record.hard = query.value(7).toInt() != 0;
+    record.version = query.value(8).toUInt();
+    insert(query.value(0).toInt(), record);
+  }
+}
+
+bool AnnotationStore::flush()
+{
+  if (getPendingCount() == 0) return true;
+  PSA_TRACE_SCOPE("AnnotationStore::flush");
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  QSqlQuery query(db_);
+  // Persons first, the bboxes refer to them
+  query.prepare("INSERT OR IGNORE INTO psa_person(person_id) VALUES(?)");
+  foreach (int personId, addedPersonIds_) {
+    query.bindValue(0, personId);
+    if (!query.exec()) return failWrite(query);
+  }
+  query.prepare("INSERT OR REPLACE INTO psa_bbox(bbox_id, image_id,"
+                "    person_id, x, y, width, height, hard, version) "
+                "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?)");
+  foreach (int bboxId, writtenBBoxIds_) {
+    const Record& record = records_[bboxId];
+    query.bindValue(0, bboxId);
+    query.bindValue(1, record.imageId);
+    query.bindValue(2, record.personId);
+    query.bindValue(3, record.x);
+    query.bindValue(4, record.y);
+    query.bindValue(5, record.width);
+    query.bindValue(6, record.height);
+    query.bindValue(7, static_cast<int>(record.hard));
+    query.bindValue(8, static_cast<int>(record.version));
+    if (!query.exec()) return failWrite(query);
+  }
+  query.prepare("DELETE FROM psa_bbox WHERE bbox_id = ?");
+  foreach (int bboxId, removedBBoxIds_) {
+    query.bindValue(0, bboxId);
+    if (!query.exec()) return failWrite(query);
+  }
+  query.prepare("DELETE FROM psa_person WHERE person_id = ?");
+  foreach (int personId, removedPersonIds_) {
+    query.bindValue(0, personId);
+    if (!query.exec()) return failWrite(query);
+  }
+  if (!transaction.commit()) {
+    qDebug() << "writing annotations failed:" << db_.lastError().text();
+    return false;
+  }
+  writtenBBoxIds_.clear();
+  removedBBoxIds_.clear();
+  addedPersonIds_.clear();
+  removedPersonIds_.clear();
+  return true;
+}
+
+int AnnotationStore::getPendingCount() const
+{
+  return writtenBBoxIds_.size() + removedBBoxIds_.size() +
+         addedPersonIds_.size() + removedPersonIds_.size();
+}
+
+PersonBBox AnnotationStore::getPersonBBox(int bboxId) const
+{
+  if (!find(bboxId)) return PersonBBox();
+  return toPersonBBox(bboxId);
+}
+
+QVector<PersonBBox> AnnotationStore::getPersonBBoxesByImageId(
+    int imageId) const
+{
+  QVector<PersonBBox> personBBoxes;
+  foreach (int bboxId, imageBBoxIds_.value(imageId)) {
+    personBBoxes.push_back(toPersonBBox(bboxId));
+  }
+  return personBBoxes;
+}
+
+QVector<PersonBBox> AnnotationStore::getPersonBBoxesByPersonId(
+    int personId) const
+{
+  QVector<PersonBBox> personBBoxes;
+  foreach (int bboxId, personBBoxIds_.value(personId)) {
+    personBBoxes.push_back(toPersonBBox(bboxId));
+  }
+  return personBBoxes;
+}
+
+bool AnnotationStore::hasPerson(int personId) const
+{
+  return personIds_.contains(personId);
+}
+
+int AnnotationStore::addPerson(int personId)
+{
+  if (personId <= 0) personId = nextPersonId_;
+  if (personIds_.contains(personId)) return personId;
+  personIds_.insert(personId);
+  nextPersonId_ = std::max(nextPersonId_, personId + 1);
+  removedPersonIds_.remove(personId);
+  addedPersonIds_.insert(personId);
+  flushIfFull();
+  return personId;
+}
+
+int AnnotationStore::addPersonBBox(const PersonBBox& personBBox)
+{
+  int bboxId = personBBox.getBBoxId();
+  if (bboxId <= 0) {
+    bboxId = std::max(records_.size(), 1);
+  } else if (find(bboxId)) {
+    // Taken, the insert would fail
+    return 0;
+  }
+  Record record;
+  record.imageId = personBBox.getImageId();
+  record.personId = addPerson(personBBox.getPersonId());
+  record.x = personBBox.x();
+  record.y = personBBox.y();
+  record.width = personBBox.width();
+  record.height = personBBox.height();
+  record.hard = personBBox.isHard();
+  record.version = 0;
+  insert(bboxId, record);
+  removedBBoxIds_.remove(bboxId);
+  writtenBBoxIds_.insert(bboxId);
+  flushIfFull();
+  return bboxId;
+}
+
+bool AnnotationStore::updatePersonBBox(PersonBBox* personBBox)
+{
+  int bboxId = personBBox->getBBoxId();
+  const Record* stored = find(bboxId);
+  if (!stored || static_cast<int>(stored->version) !=
+                 personBBox->getVersion()) {
+    return false;
+  }
+  int oldPersonId = stored->personId;
+  int personId = addPerson(personBBox->getPersonId());
+
+  Record& record = records_[bboxId];
+  record.personId = personId;
+  record.x = personBBox->x();
+  record.y = personBBox->y();
+  record.width = personBBox->width();
+  record.height = personBBox->height();
+  record.hard = personBBox->isHard();
+  record.version = record.version + 1;
+  if (oldPersonId != personId) {
+    removeFromIndex(&personBBoxIds_, oldPersonId, bboxId);
+    personBBoxIds_[personId].push_back(bboxId);
+    removePersonIfUnused(oldPersonId);
+  }
+  writtenBBoxIds_.insert(bboxId);
+  flushIfFull();
+
+  personBBox->setPersonId(personId);
+  personBBox->setVersion(record.version);
+  return true;
+}
+
+bool AnnotationStore::removePersonBBox(const PersonBBox& personBBox)
+{
+  int bboxId = personBBox.getBBoxId();
+  const Record* stored = find(bboxId);
+  if (!stored) return true;
+  if (static_cast<int>(stored->version) != personBBox.getVersion()) {
+    return false;
+  }
+  int personId = stored->personId;
+  removeFromIndex(&imageBBoxIds_, stored->imageId, bboxId);
+  removeFromIndex(&personBBoxIds_, personId, bboxId);
+  records_[bboxId] = Record();
+  removePersonIfUnused(personId);
+  writtenBBoxIds_.remove(bboxId);
+  removedBBoxIds_.insert(bboxId);
+  flushIfFull();
+  return true;
+}
+
+PersonBBox AnnotationStore::toPersonBBox(int bboxId) const
+{
+  const Record& record = records_[bboxId];
+  PersonBBox personBBox;
+  personBBox.setBBoxId(bboxId);
+  personBBox.setImageId(record.imageId);
+  personBBox.setPersonId(record.personId);
+  personBBox.setBBox(record.x, record.y, record.width, record.height);
+  personBBox.setHard(record.hard);
+  personBBox.setVersion(record.version);
+  return personBBox;
+}
+
+const AnnotationStore::Record* AnnotationStore::find(int bboxId) const
+{
+  if (bboxId <= 0 || bboxId >= records_.size()) return NULL;
+  const Record& record = records_[bboxId];
+  return record.isNull() ? NULL : &record;
+}
+
+void AnnotationStore::insert(int bboxId, const Record& record)
+{
+  if (bboxId >= records_.size()) records_.resize(bboxId + 1);
+  records_[bboxId] = record;
+  imageBBoxIds_[record.imageId].push_back(bboxId);
+  personBBoxIds_[record.personId].push_back(bboxId);
+}
+
+void AnnotationStore::removePersonIfUnused(int personId)
+{
+  if (personBBoxIds_.contains(personId)) return;
+  if (!personIds_.remove(personId)) return;
+  addedPersonIds_.remove(personId);
+  removedPersonIds_.insert(personId);
+}
+
+void AnnotationStore::flushIfFull()
+{
+  if (getPendingCount() >= WriteBatchSize) flush();
+}
+
+void AnnotationStore::removeFromIndex(QHash<int, QVector<int> >* index,
+                                      int key, int bboxId)
+{
+  QHash<int, QVector<int> >::iterator it = index->find(key);
+  if (it == index->end()) return;
+  it->removeOne(bboxId);
+  if (it->isEmpty()) index->erase(it);
+}
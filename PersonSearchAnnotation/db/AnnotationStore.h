@@ -0,0 +1,85 @@
+#ifndef ANNOTATIONSTORE_H
+#define ANNOTATIONSTORE_H
+
+#include "common/PersonBBox.hpp"
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QSqlDatabase>
+
+// All the persons and bboxes of a database held in memory, indexed by image
+// and by person. Reads never touch the file. Writes are applied here at once
+// and kept pending until flush, which writes them in a single transaction.
+// Only valid while no other connection writes bboxes or persons.
+class AnnotationStore
+{
+public:
+  explicit AnnotationStore(const QSqlDatabase& db);
+  ~AnnotationStore();
+
+  void load();
+  // Returns false, keeping the changes pending, if any write failed
+  bool flush();
+  int getPendingCount() const;
+
+  PersonBBox getPersonBBox(int bboxId) const;
+  QVector<PersonBBox> getPersonBBoxesByImageId(int imageId) const;
+  QVector<PersonBBox> getPersonBBoxesByPersonId(int personId) const;
+
+  bool hasPerson(int personId) const;
+
+  // Same semantics as the methods of DatabaseHelper
+  int addPerson(int personId);
+  int addPersonBBox(const PersonBBox& personBBox);
+  bool updatePersonBBox(PersonBBox* personBBox);
+  bool removePersonBBox(const PersonBBox& personBBox);
+
+private:
+  AnnotationStore(const AnnotationStore&);
+  const AnnotationStore& operator = (const AnnotationStore&);
+
+  // 28 bytes per bbox
+  struct Record
+  {
+    Record() : imageId(0) {}
+
+    // Image ids start from 1, so 0 marks a bbox id not in use
+    inline bool isNull() const { return imageId == 0; }
+
+    qint32 imageId;
+    qint32 personId;
+    qint32 x;
+    qint32 y;
+    qint32 width;
+    qint32 height;
+    quint32 hard : 1;
+    quint32 version : 31;
+  };
+
+  PersonBBox toPersonBBox(int bboxId) const;
+  const Record* find(int bboxId) const;
+  void insert(int bboxId, const Record& record);
+  void removePersonIfUnused(int personId);
+  void flushIfFull();
+
+  static void removeFromIndex(QHash<int, QVector<int> >* index, int key,
+                              int bboxId);
+
+private:
+  QSqlDatabase db_;
+
+  // Indexed by bbox id, which SQLite assigns densely
+  QVector<Record> records_;
+  QHash<int, QVector<int> > imageBBoxIds_;
+  QHash<int, QVector<int> > personBBoxIds_;
+  QSet<int> personIds_;
+  int nextPersonId_;
+
+  // Changes not written yet
+  QSet<int> writtenBBoxIds_;
+  QSet<int> removedBBoxIds_;
+  QSet<int> addedPersonIds_;
+  QSet<int> removedPersonIds_;
+};
+
+#endif // ANNOTATIONSTORE_H
@@ -1,123 +1,927 @@
 #include "db/DatabaseHelper.h"
-#include <cstdio>
+#include "db/DatabaseTransaction.h"
+#include "db/AnnotationStore.h"
+#include "db/FolderDictionary.h"
+#include "common/BinaryAnnotation.hpp"
+#include "utils/BufferedReader.h"
+#include "utils/BufferedWriter.h"
+#include "utils/Trace.h"
+#include "utils/util_functions.h"
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QRect>
+#include <QImageReader>
+#include <QtConcurrent>
 #include <QSqlQuery>
+#include <QSqlError>
 #include <QVariant>
 #include <QDebug>
 
+using namespace psa;
+
+// Schema migrations in order. Migration i upgrades the schema from version i
+// to version i + 1, and existing database files are upgraded in place.
+static const char* const Migration1[] = {
+  "CREATE TABLE IF NOT EXISTS psa_image("
+  "    image_id INTEGER PRIMARY KEY,"
+  "    path TEXT NOT NULL,"
+  "    author VARCHAR(128) NOT NULL)",
+  "CREATE TABLE IF NOT EXISTS psa_person("
+  "    person_id INTEGER PRIMARY KEY)",
+  "CREATE TABLE IF NOT EXISTS psa_bbox("
+  "    bbox_id INTEGER PRIMARY KEY,"
+  "    image_id INTEGER NOT NULL,"
+  "    person_id INTEGER NOT NULL,"
+  "    x INTEGER NOT NULL,"
+  "    y INTEGER NOT NULL,"
+  "    width INTEGER NOT NULL,"
+  "    height INTEGER NOT NULL,"
+  "    hard INTEGER NOT NULL)",
+  NULL
+};
+static const char* const Migration2[] = {
+  // Merge images sharing the same path before the path becomes unique
+  "UPDATE psa_bbox SET image_id = ("
+  "    SELECT MIN(b.image_id) FROM psa_image a, psa_image b"
+  "    WHERE a.image_id = psa_bbox.image_id AND b.path = a.path) "
+  "WHERE image_id IN (SELECT image_id FROM psa_image)",
+  "DELETE FROM psa_image WHERE image_id NOT IN ("
+  "    SELECT MIN(image_id) FROM psa_image GROUP BY path)",
+  "CREATE INDEX IF NOT EXISTS psa_bbox_image_id ON psa_bbox(image_id)",
+  "CREATE INDEX IF NOT EXISTS psa_bbox_person_id ON psa_bbox(person_id)",
+  "CREATE UNIQUE INDEX IF NOT EXISTS psa_image_path ON psa_image(path)",
+  NULL
+};
+static const char* const Migration3[] = {
+  // Image headers probed at import time
+  "ALTER TABLE psa_image ADD COLUMN width INTEGER NOT NULL DEFAULT 0",
+  "ALTER TABLE psa_image ADD COLUMN height INTEGER NOT NULL DEFAULT 0",
+  "ALTER TABLE psa_image ADD COLUMN orientation INTEGER NOT NULL DEFAULT 0",
+  NULL
+};
+static const char* const Migration4[] = {
+  // Row versions for detecting concurrent edits of the same bbox
+  "ALTER TABLE psa_bbox ADD COLUMN version INTEGER NOT NULL DEFAULT 0",
+  NULL
+};
+static const char* const Migration5[] = {
+  // Folders and their authors are stored once, images keep their base names.
+  // Folders end with a slash, which rtrim leaves when it strips the name.
+  "CREATE TABLE psa_folder("
+  "    folder_id INTEGER PRIMARY KEY,"
+  "    path TEXT NOT NULL,"
+  "    author VARCHAR(128) NOT NULL)",
+  "CREATE UNIQUE INDEX psa_folder_path ON psa_folder(path)",
+  "INSERT INTO psa_folder(path, author) "
+  "    SELECT rtrim(path, replace(path, '/', '')) AS folder, MIN(author) "
+  "    FROM psa_image GROUP BY folder",
+  "CREATE TABLE psa_image_by_folder("
+  "    image_id INTEGER PRIMARY KEY,"
+  "    folder_id INTEGER NOT NULL,"
+  "    name TEXT NOT NULL,"
+  "    width INTEGER NOT NULL DEFAULT 0,"
+  "    height INTEGER NOT NULL DEFAULT 0,"
+  "    orientation INTEGER NOT NULL DEFAULT 0)",
+  "INSERT INTO psa_image_by_folder "
+  "    SELECT i.image_id, f.folder_id, substr(i.path, length(f.path) + 1),"
+  "        i.width, i.height, i.orientation "
+  "    FROM psa_image i JOIN psa_folder f"
+  "        ON f.path = rtrim(i.path, replace(i.path, '/', ''))",
+  "DROP TABLE psa_image",
+  "ALTER TABLE psa_image_by_folder RENAME TO psa_image",
+  "CREATE UNIQUE INDEX psa_image_folder_name ON psa_image(folder_id, name)",
+  NULL
+};
+static const char* const Migration6[] = {
+  // Appearance descriptors of the bboxes, with the geometries they were made
+  // for. Rows of moved or removed bboxes are stale until they are replaced.
+  "CREATE TABLE psa_descriptor("
+  "    bbox_id INTEGER PRIMARY KEY,"
+  "    image_id INTEGER NOT NULL,"
+  "    x INTEGER NOT NULL,"
+  "    y INTEGER NOT NULL,"
+  "    width INTEGER NOT NULL,"
+  "    height INTEGER NOT NULL,"
+  "    data BLOB NOT NULL)",
+  "CREATE INDEX psa_descriptor_image_id ON psa_descriptor(image_id)",
+  NULL
+};
+static const char* const* const Migrations[] = {
+  Migration1,
+  Migration2,
+  Migration3,
+  Migration4,
+  Migration5,
+  Migration6
+};
+static const int NumMigrations = sizeof(Migrations) / sizeof(Migrations[0]);
+
+static const int ProgressInterval = 1000;
+
+// Concurrent writers wait for each other instead of failing at once
+static const int BusyTimeout = 10000;
+static const int DefaultCacheSize = 64 * 1024;
+static const qint64 MmapSize = 256 * 1024 * 1024;
+
+// Stay below SQLite's limit of 999 host parameters per statement
+static const int InsertChunkSize = 400;
+static const int SelectChunkSize = 900;
+
+static QString repeatPlaceholders(const QString& placeholder, int n)
+{
+  QStringList placeholders;
+  for (int i = 0; i < n; ++i) {
+    placeholders.push_back(placeholder);
+  }
+  return placeholders.join(", ");
+}
+
+static void writePersonGroup(BufferedWriter* writer, int personId, int count,
+                             const std::string& contents)
+{
+  writer->write("# ", 2);
+  writer->writeNumber(personId);
+  writer->write('\n');
+  writer->writeNumber(count);
+  writer->write('\n');
+  writer->write(contents);
+}
+
+static void writeImageGroup(BufferedWriter* writer, int imageId,
+                            const QByteArray& path, int count,
+                            const std::string& contents)
+{
+  writer->write("# ", 2);
+  writer->writeNumber(imageId);
+  writer->write('\n');
+  writer->write(path);
+  writer->write('\n');
+  writer->writeNumber(count);
+  writer->write('\n');
+  writer->write(contents);
+}
+
+// Pads up to the offset of the section before writing it
+static void writeSection(BufferedWriter* writer, quint64* position,
+                         quint64 offset, const void* data, quint64 size)
+{
+  static const char zeros[binary::Alignment] = {0};
+  writer->write(zeros, static_cast<int>(offset - *position));
+  writer->write(static_cast<const char*>(data), static_cast<int>(size));
+  *position = offset + size;
+}
+
+template <typename T>
+static void writeSection(BufferedWriter* writer, quint64* position,
+                         quint64 offset, const QVector<T>& values)
+{
+  writeSection(writer, position, offset, values.constData(),
+               values.size() * sizeof(T));
+}
+
+// Writes the groups of the text exports back. Statements are prepared once
+// and reused for every row. The methods fail at the first statement which
+// fails, leaving getError() set, and the import is then rolled back.
+class TextImporter
+{
+public:
+  explicit TextImporter(FolderDictionary* folders)
+    : folders_(folders)
+  {
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.exec("SELECT i.image_id, f.path || i.name "
+               "FROM psa_image i JOIN psa_folder f"
+               "    ON f.folder_id = i.folder_id");
+    while (query.next()) {
+      imageIds_.insert(query.value(1).toString(), query.value(0).toInt());
+      usedImageIds_.insert(query.value(0).toInt());
+    }
+    insertImage_.prepare("INSERT INTO psa_image(image_id, folder_id, name) "
+                         "VALUES(?, ?, ?)");
+    insertPerson_.prepare("INSERT OR IGNORE INTO psa_person(person_id) "
+                          "VALUES(?)");
+    insertBBox_.prepare("INSERT INTO psa_bbox(image_id, person_id, x, y,"
+                        "    width, height, hard) "
+                        "VALUES(?, ?, ?, ?, ?, ?, ?)");
+    selectImagePersons_.setForwardOnly(true);
+    selectImagePersons_.prepare("SELECT DISTINCT person_id FROM psa_bbox "
+                                "WHERE image_id = ?");
+    deleteImageBBoxes_.prepare("DELETE FROM psa_bbox WHERE image_id = ?");
+    deletePersonBBoxes_.prepare("DELETE FROM psa_bbox WHERE person_id = ?");
+    deleteUnusedPerson_.prepare("DELETE FROM psa_person WHERE person_id = ? "
+                                "AND NOT EXISTS (SELECT 1 FROM psa_bbox"
+                                "    WHERE person_id = ?)");
+  }
+
+  ~TextImporter()
+  {
+    // The folders added are gone if the import is rolled back
+    folders_->clear();
+  }
+
+  const QString& getError() const
+  {
+    return error_;
+  }
+
+  // Adds the image if missing, keeping the given id unless it is taken.
+  // Returns 0 if it cannot be added.
+  int getImageId(const QString& path, int imageId = 0)
+  {
+    QHash<QString, int>::const_iterator it = imageIds_.constFind(path);
+    if (it != imageIds_.constEnd()) return it.value();
+    bool keepId = imageId > 0 && !usedImageIds_.contains(imageId);
+    QString folder;
+    QString name;
+    ImageFile::splitPath(path, &folder, &name);
+    // Same author as importFolder
+    int folderId = folders_->addFolder(
+        folder, path.section('/', 0, 0, QString::SectionSkipEmpty));
+    insertImage_.bindValue(0, keepId ? QVariant(imageId) : QVariant());
+    insertImage_.bindValue(1, folderId);
+    insertImage_.bindValue(2, name);
+    if (!execute(&insertImage_)) return 0;
+    imageId = insertImage_.lastInsertId().toInt();
+    imageIds_.insert(path, imageId);
+    usedImageIds_.insert(imageId);
+    return imageId;
+  }
+
+  bool addPerson(int personId)
+  {
+    insertPerson_.bindValue(0, personId);
+    return execute(&insertPerson_);
+  }
+
+  bool removeImageBBoxes(int imageId)
+  {
+    // Their persons may be left without any bbox
+    selectImagePersons_.bindValue(0, imageId);
+    if (!execute(&selectImagePersons_)) return false;
+    while (selectImagePersons_.next()) {
+      affectedPersonIds_.insert(selectImagePersons_.value(0).toInt());
+    }
+    deleteImageBBoxes_.bindValue(0, imageId);
+    return execute(&deleteImageBBoxes_);
+  }
+
+  bool removePersonBBoxes(int personId)
+  {
+    deletePersonBBoxes_.bindValue(0, personId);
+    return execute(&deletePersonBBoxes_);
+  }
+
+  // fields are x, y, width, height and hard
+  bool addBBox(int imageId, int personId, const int* fields)
+  {
+    insertBBox_.bindValue(0, imageId);
+    insertBBox_.bindValue(1, personId);
+    for (int i = 0; i < 5; ++i) {
+      insertBBox_.bindValue(i + 2, fields[i]);
+    }
+    return execute(&insertBBox_);
+  }
+
+  bool removeUnusedPersons()
+  {
+    foreach (int personId, affectedPersonIds_) {
+      deleteUnusedPerson_.bindValue(0, personId);
+      deleteUnusedPerson_.bindValue(1, personId);
+      if (!execute(&deleteUnusedPerson_)) return false;
+    }
+    return true;
+  }
+
+private:
+  bool execute(QSqlQuery* query)
+  {
+    if (query->exec()) return true;
+    error_ = query->lastError().text();
+    return false;
+  }
+
+private:
+  FolderDictionary* folders_;
+  QHash<QString, int> imageIds_;
+  QSet<int> usedImageIds_;
+  QSet<int> affectedPersonIds_;
+  QSqlQuery insertImage_;
+  QSqlQuery insertPerson_;
+  QSqlQuery insertBBox_;
+  QSqlQuery selectImagePersons_;
+  QSqlQuery deleteImageBBoxes_;
+  QSqlQuery deletePersonBBoxes_;
+  QSqlQuery deleteUnusedPerson_;
+  QString error_;
+};
+
+// The transaction of the import is rolled back as it goes out of scope
+static bool failImport(const TextImporter& importer, int lineNumber,
+                       QString* errorMessage)
+{
+  if (errorMessage) {
+    *errorMessage = lineNumber > 0 ?
+        QString("line %1: %2").arg(lineNumber).arg(importer.getError()) :
+        importer.getError();
+  }
+  return false;
+}
+
+// Parses "# <id>" of a group header
+static bool parseGroupHeader(const char* line, int size, int* id)
+{
+  const char* end = line + size;
+  if (size < 2 || line[0] != '#' || line[1] != ' ') return false;
+  return parseNumber(line + 2, end, id) == end;
+}
+
+static bool parseCount(const char* line, int size, int* count)
+{
+  const char* end = line + size;
+  return parseNumber(line, end, count) == end && *count >= 0;
+}
+
+// Parses n numbers separated by tabs, with one more tab before the first
+// number if leadingTab
+static bool parseFields(const char* line, const char* end, bool leadingTab,
+                        int* fields, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    if (i > 0 || leadingTab) {
+      if (line == end || *line != '\t') return false;
+      ++line;
+    }
+    line = parseNumber(line, end, &fields[i]);
+    if (line == NULL) return false;
+  }
+  return line == end;
+}
+
 DatabaseHelper::DatabaseHelper()
-  : db_(QSqlDatabase::addDatabase("QSQLITE"))
+  : db_(QSqlDatabase::addDatabase("QSQLITE")),
+    concurrent_(false),
+    cacheSize_(DefaultCacheSize),
+    store_(NULL)
 {
 
 }
 
 DatabaseHelper::~DatabaseHelper()
 {
+  closeStore();
   db_.close();
 }
 
-void DatabaseHelper::init(const QString& filePath)
+bool DatabaseHelper::init(const QString& filePath, bool concurrent)
 {
+  closeStore();
+  concurrent_ = concurrent;
+  folders_.clear();
   db_.close();
   db_.setDatabaseName(filePath);
-  db_.open();
-  createTables();
+  db_.setConnectOptions(concurrent ?
+      QString("QSQLITE_BUSY_TIMEOUT=%1").arg(BusyTimeout) : QString());
+  if (!db_.open()) {
+    qDebug() << "cannot open" << filePath << db_.lastError().text();
+    return false;
+  }
+
+  setCacheSize(cacheSize_);
+  QSqlQuery query;
+  query.exec(QString("PRAGMA mmap_size = %1").arg(MmapSize));
+  if (concurrent) {
+    // Readers never block the writer nor each other. The file is switched
+    // for good, and all the annotators must be on the same host, since the
+    // WAL index lives in shared memory.
+    query.exec("PRAGMA journal_mode = WAL");
+    query.exec("PRAGMA synchronous = NORMAL");
+  }
+  return migrate();
 }
 
-void DatabaseHelper::exportToPersonTxt(const QString& filePath)
+void DatabaseHelper::setCacheSize(int cacheSize)
 {
-  // Get all people
+  cacheSize_ = cacheSize;
+  if (!db_.isOpen()) return;
+  // Negative cache sizes are in KiB
   QSqlQuery query;
-  query.prepare("SELECT person_id FROM psa_person");
-  query.exec();
-  QVector<int> personIds;
+  query.exec(QString("PRAGMA cache_size = %1").arg(-cacheSize_));
+}
+
+void DatabaseHelper::loadAnnotationStore()
+{
+  getStore();
+}
+
+bool DatabaseHelper::flush()
+{
+  return !store_ || store_->flush();
+}
+
+bool DatabaseHelper::hasPendingWrites() const
+{
+  return store_ && store_->getPendingCount() > 0;
+}
+
+void DatabaseHelper::setProgressCallback(
+    const ProgressCallback& progressCallback)
+{
+  progressCallback_ = progressCallback;
+}
+
+int DatabaseHelper::getSchemaVersion()
+{
+  QSqlQuery query;
+  query.exec("SELECT MAX(version) FROM psa_schema");
+  if (!query.next()) return 0;
+  return query.value(0).toInt();
+}
+
+bool DatabaseHelper::exportToPersonTxt(const QString& filePath)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::exportToPersonTxt");
+  // The pending writes would be missing
+  if (!flush()) return false;
+  // Stream all the people with their bboxes in a single ordered pass. People
+  // without any bbox come with a row of NULLs.
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.prepare("SELECT psa_person.person_id,"
+                "       psa_folder.path || psa_image.name, psa_bbox.x,"
+                "       psa_bbox.y, psa_bbox.width, psa_bbox.height,"
+                "       psa_bbox.hard "
+                "FROM psa_person "
+                "LEFT JOIN psa_bbox "
+                "    ON psa_bbox.person_id = psa_person.person_id "
+                "LEFT JOIN psa_image "
+                "    ON psa_image.image_id = psa_bbox.image_id "
+                "LEFT JOIN psa_folder "
+                "    ON psa_folder.folder_id = psa_image.folder_id "
+                "ORDER BY psa_person.person_id, psa_bbox.bbox_id");
+  if (!query.exec()) return false;
+  qint64 total = count("SELECT COUNT(*) FROM psa_person");
+  qint64 done = 0;
+  // Save to file
+  BufferedWriter writer;
+  if (!writer.open(filePath)) return false;
+  // Lines of the current person, written out once they are counted
+  std::string contents;
+  int personId = 0;
+  int numBBoxes = -1;
   while (query.next()) {
-    personIds.push_back(query.value(0).toInt());
+    int id = query.value(0).toInt();
+    if (numBBoxes >= 0 && id != personId) {
+      writePersonGroup(&writer, personId, numBBoxes, contents);
+      numBBoxes = -1;
+      if (++done % ProgressInterval == 0) reportProgress(done, total);
+    }
+    if (numBBoxes < 0) {
+      personId = id;
+      numBBoxes = 0;
+      contents.clear();
+    }
+    if (query.isNull(1)) continue;
+    contents.append(query.value(1).toString().toUtf8().constData());
+    for (int i = 2; i <= 6; ++i) {
+      contents.push_back('\t');
+      appendNumber(&contents, query.value(i).toInt());
+    }
+    contents.push_back('\n');
+    ++numBBoxes;
+  }
+  if (numBBoxes >= 0) {
+    writePersonGroup(&writer, personId, numBBoxes, contents);
   }
+  if (!writer.close()) return false;
+  reportProgress(total, total);
+  return true;
+}
+
+bool DatabaseHelper::exportToImageTxt(const QString& filePath)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::exportToImageTxt");
+  // The pending writes would be missing
+  if (!flush()) return false;
+  // Stream all the images with their bboxes in a single ordered pass. Images
+  // without any bbox come with a row of NULLs.
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.prepare("SELECT psa_image.image_id,"
+                "       psa_folder.path || psa_image.name,"
+                "       psa_bbox.person_id, psa_bbox.x, psa_bbox.y,"
+                "       psa_bbox.width, psa_bbox.height, psa_bbox.hard "
+                "FROM psa_image "
+                "JOIN psa_folder "
+                "    ON psa_folder.folder_id = psa_image.folder_id "
+                "LEFT JOIN psa_bbox "
+                "    ON psa_bbox.image_id = psa_image.image_id "
+                "ORDER BY psa_image.image_id, psa_bbox.bbox_id");
+  if (!query.exec()) return false;
+  qint64 total = count("SELECT COUNT(*) FROM psa_image");
+  qint64 done = 0;
   // Save to file
-  FILE* fid = fopen(filePath.toStdString().c_str(), "w");
-  for (int i = 0; i < personIds.size(); ++i) {
-    query.prepare("SELECT psa_image.path, psa_bbox.x, psa_bbox.y,"
-                  "       psa_bbox.width, psa_bbox.height, psa_bbox.hard "
-                  "FROM psa_image, psa_bbox "
-                  "WHERE psa_image.image_id = psa_bbox.image_id AND "
-                  "      psa_bbox.person_id = :person_id");
-    query.bindValue(":person_id", personIds[i]);
-    query.exec();
-    QVector<QString> contents;
-    while (query.next()) {
-      contents.push_back(query.value(0).toString() + "\t" +
-                         QString::number(query.value(1).toInt()) + "\t" +
-                         QString::number(query.value(2).toInt()) + "\t" +
-                         QString::number(query.value(3).toInt()) + "\t" +
-                         QString::number(query.value(4).toInt()) + "\t" +
-                         QString::number(query.value(5).toInt()));
+  BufferedWriter writer;
+  if (!writer.open(filePath)) return false;
+  // Lines of the current image, written out once they are counted
+  std::string contents;
+  QByteArray path;
+  int imageId = 0;
+  int numBBoxes = -1;
+  while (query.next()) {
+    int id = query.value(0).toInt();
+    if (numBBoxes >= 0 && id != imageId) {
+      writeImageGroup(&writer, imageId, path, numBBoxes, contents);
+      numBBoxes = -1;
+      if (++done % ProgressInterval == 0) reportProgress(done, total);
+    }
+    if (numBBoxes < 0) {
+      imageId = id;
+      path = query.value(1).toString().toUtf8();
+      numBBoxes = 0;
+      contents.clear();
     }
-    fprintf(fid, "# %d\n", personIds[i]);
-    fprintf(fid, "%d\n", contents.size());
-    for (int i = 0; i < contents.size(); ++i) {
-      fprintf(fid, "%s\n", contents[i].toStdString().c_str());
+    if (query.isNull(2)) continue;
+    appendNumber(&contents, query.value(2).toInt());
+    for (int i = 3; i <= 7; ++i) {
+      contents.push_back('\t');
+      appendNumber(&contents, query.value(i).toInt());
     }
+    contents.push_back('\n');
+    ++numBBoxes;
+  }
+  if (numBBoxes >= 0) {
+    writeImageGroup(&writer, imageId, path, numBBoxes, contents);
   }
-  fclose(fid);
+  if (!writer.close()) return false;
+  reportProgress(total, total);
+  return true;
 }
 
-void DatabaseHelper::exportToImageTxt(const QString& filePath)
+bool DatabaseHelper::exportToBinary(const QString& filePath)
 {
-  // Get all images
+  PSA_TRACE_SCOPE("DatabaseHelper::exportToBinary");
+  // The pending writes would be missing
+  if (!flush()) return false;
   QSqlQuery query;
-  query.prepare("SELECT image_id, path FROM psa_image");
-  query.exec();
-  QVector<int> imageIds;
-  QVector<QString> imagePaths;
+  query.setForwardOnly(true);
+  qint64 total = count("SELECT COUNT(*) FROM psa_bbox");
+  qint64 done = 0;
+
+  // Sizes are stored as displayed, in which the bboxes are annotated
+  QVector<qint32> imageIds;
+  QVector<qint32> imageWidths;
+  QVector<qint32> imageHeights;
+  QVector<quint32> imagePathOffsets;
+  QByteArray strings;
+  QHash<int, quint32> imageIndices;
+  if (!query.exec("SELECT i.image_id, f.path || i.name, i.width, i.height,"
+                  "       i.orientation "
+                  "FROM psa_image i JOIN psa_folder f"
+                  "    ON f.folder_id = i.folder_id "
+                  "ORDER BY i.image_id")) {
+    return false;
+  }
   while (query.next()) {
+    ImageFile imageFile;
+    imageFile.setSize(query.value(2).toInt(), query.value(3).toInt());
+    imageFile.setOrientation(query.value(4).toInt());
+    imageIndices.insert(query.value(0).toInt(), imageIds.size());
     imageIds.push_back(query.value(0).toInt());
-    imagePaths.push_back(query.value(1).toString());
+    imageWidths.push_back(imageFile.getDisplaySize().width());
+    imageHeights.push_back(imageFile.getDisplaySize().height());
+    imagePathOffsets.push_back(strings.size());
+    strings.append(query.value(1).toString().toUtf8());
+    strings.append('\0');
+  }
+
+  QVector<qint32> personIds;
+  QHash<int, quint32> personIndices;
+  if (!query.exec("SELECT person_id FROM psa_person ORDER BY person_id")) {
+    return false;
+  }
+  while (query.next()) {
+    personIndices.insert(query.value(0).toInt(), personIds.size());
+    personIds.push_back(query.value(0).toInt());
+  }
+
+  // Bboxes of missing images or persons are left out
+  QVector<qint32> bboxIds;
+  QVector<quint32> bboxImages;
+  QVector<quint32> bboxPersons;
+  QVector<qint32> bboxXs;
+  QVector<qint32> bboxYs;
+  QVector<qint32> bboxWidths;
+  QVector<qint32> bboxHeights;
+  QVector<quint8> bboxHards;
+  if (!query.exec("SELECT bbox_id, image_id, person_id, x, y, width,"
+                  "    height, hard "
+                  "FROM psa_bbox ORDER BY image_id, bbox_id")) {
+    return false;
+  }
+  while (query.next()) {
+    if (++done % ProgressInterval == 0) reportProgress(done, total);
+    QHash<int, quint32>::const_iterator image =
+        imageIndices.constFind(query.value(1).toInt());
+    QHash<int, quint32>::const_iterator person =
+        personIndices.constFind(query.value(2).toInt());
+    if (image == imageIndices.constEnd() ||
+        person == personIndices.constEnd()) {
+      continue;
+    }
+    bboxIds.push_back(query.value(0).toInt());
+    bboxImages.push_back(image.value());
+    bboxPersons.push_back(person.value());
+    bboxXs.push_back(query.value(3).toInt());
+    bboxYs.push_back(query.value(4).toInt());
+    bboxWidths.push_back(query.value(5).toInt());
+    bboxHeights.push_back(query.value(6).toInt());
+    bboxHards.push_back(query.value(7).toInt() != 0);
+  }
+  int numBBoxes = bboxIds.size();
+
+  // Group the bboxes by image and by person with counting sorts, which keep
+  // the image order within each person
+  QVector<quint32> imageBBoxBegins(imageIds.size() + 1, 0);
+  QVector<quint32> personBBoxBegins(personIds.size() + 1, 0);
+  for (int i = 0; i < numBBoxes; ++i) {
+    ++imageBBoxBegins[bboxImages[i] + 1];
+    ++personBBoxBegins[bboxPersons[i] + 1];
   }
-  // Save to file
-  FILE* fid = fopen(filePath.toStdString().c_str(), "w");
   for (int i = 0; i < imageIds.size(); ++i) {
-    query.prepare("SELECT person_id, x, y, width, height, hard FROM psa_bbox "
-                  "WHERE image_id = :image_id");
-    query.bindValue(":image_id", imageIds[i]);
-    query.exec();
-    QVector<QString> contents;
-    while (query.next()) {
-      contents.push_back(QString::number(query.value(0).toInt()) + "\t" +
-                         QString::number(query.value(1).toInt()) + "\t" +
-                         QString::number(query.value(2).toInt()) + "\t" +
-                         QString::number(query.value(3).toInt()) + "\t" +
-                         QString::number(query.value(4).toInt()) + "\t" +
-                         QString::number(query.value(5).toInt()));
+    imageBBoxBegins[i + 1] += imageBBoxBegins[i];
+  }
+  for (int i = 0; i < personIds.size(); ++i) {
+    personBBoxBegins[i + 1] += personBBoxBegins[i];
+  }
+  QVector<quint32> personBBoxes(numBBoxes);
+  QVector<quint32> personEnds = personBBoxBegins;
+  for (int i = 0; i < numBBoxes; ++i) {
+    personBBoxes[personEnds[bboxPersons[i]]++] = i;
+  }
+
+  binary::Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, binary::Magic, sizeof(header.magic));
+  header.version = binary::Version;
+  header.byteOrderMark = binary::ByteOrderMark;
+  header.numImages = imageIds.size();
+  header.numPersons = personIds.size();
+  header.numBBoxes = numBBoxes;
+  header.stringTableSize = strings.size();
+  binary::layOut(&header);
+
+  BufferedWriter writer;
+  if (!writer.open(filePath, true)) return false;
+  quint64 position = 0;
+  writeSection(&writer, &position, 0, &header, sizeof(header));
+  writeSection(&writer, &position, header.imageIds, imageIds);
+  writeSection(&writer, &position, header.imageWidths, imageWidths);
+  writeSection(&writer, &position, header.imageHeights, imageHeights);
+  writeSection(&writer, &position, header.imagePathOffsets, imagePathOffsets);
+  writeSection(&writer, &position, header.imageBBoxBegins, imageBBoxBegins);
+  writeSection(&writer, &position, header.personIds, personIds);
+  writeSection(&writer, &position, header.personBBoxBegins, personBBoxBegins);
+  writeSection(&writer, &position, header.personBBoxes, personBBoxes);
+  writeSection(&writer, &position, header.bboxIds, bboxIds);
+  writeSection(&writer, &position, header.bboxImages, bboxImages);
+  writeSection(&writer, &position, header.bboxPersons, bboxPersons);
+  writeSection(&writer, &position, header.bboxXs, bboxXs);
+  writeSection(&writer, &position, header.bboxYs, bboxYs);
+  writeSection(&writer, &position, header.bboxWidths, bboxWidths);
+  writeSection(&writer, &position, header.bboxHeights, bboxHeights);
+  writeSection(&writer, &position, header.bboxHards, bboxHards);
+  writeSection(&writer, &position, header.stringTable,
+               strings.constData(), strings.size());
+  writeSection(&writer, &position, header.fileSize, NULL, 0);
+  if (!writer.close()) return false;
+  reportProgress(total, total);
+  return true;
+}
+
+bool DatabaseHelper::importFromPersonTxt(const QString& filePath,
+                                        QString* errorMessage)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::importFromPersonTxt");
+  // Read again from the file at the next access
+  if (!unloadStore()) {
+    if (errorMessage) *errorMessage = "cannot write the pending annotations";
+    return false;
+  }
+  BufferedReader reader;
+  if (!reader.open(filePath)) {
+    if (errorMessage) *errorMessage = "cannot open " + filePath;
+    return false;
+  }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  TextImporter importer(&folders_);
+  const char* line;
+  int size;
+  int lineNumber = 0;
+  qint64 done = 0;
+  while (reader.readLine(&line, &size)) {
+    ++lineNumber;
+    if (size == 0) continue;
+    int personId;
+    int numBBoxes;
+    if (!parseGroupHeader(line, size, &personId) || personId <= 0) {
+      if (errorMessage) *errorMessage = QString("line %1: expected # "
+          "<person_id>").arg(lineNumber);
+      return false;
     }
-    fprintf(fid, "# %d\n", imageIds[i]);
-    fprintf(fid, "%s\n", imagePaths[i].toStdString().c_str());
-    fprintf(fid, "%d\n", contents.size());
-    for (int i = 0; i < contents.size(); ++i) {
-      fprintf(fid, "%s\n", contents[i].toStdString().c_str());
+    ++lineNumber;
+    if (!reader.readLine(&line, &size) || !parseCount(line, size, &numBBoxes)) {
+      if (errorMessage) *errorMessage = QString("line %1: expected the "
+          "number of bboxes").arg(lineNumber);
+      return false;
     }
+    if (!importer.addPerson(personId) ||
+        !importer.removePersonBBoxes(personId)) {
+      return failImport(importer, lineNumber, errorMessage);
+    }
+    for (int i = 0; i < numBBoxes; ++i) {
+      ++lineNumber;
+      int fields[5];
+      const char* tab = NULL;
+      if (reader.readLine(&line, &size)) {
+        tab = static_cast<const char*>(memchr(line, '\t', size));
+      }
+      if (tab == NULL || tab == line ||
+          !parseFields(tab, line + size, true, fields, 5)) {
+        if (errorMessage) *errorMessage = QString("line %1: expected <path> "
+            "<x> <y> <width> <height> <hard>").arg(lineNumber);
+        return false;
+      }
+      int imageId = importer.getImageId(
+          QString::fromUtf8(line, static_cast<int>(tab - line)));
+      if (imageId == 0 || !importer.addBBox(imageId, personId, fields)) {
+        return failImport(importer, lineNumber, errorMessage);
+      }
+    }
+    if (++done % ProgressInterval == 0) {
+      reportProgress(reader.getPosition(), reader.getFileSize());
+    }
+  }
+  if (!importer.removeUnusedPersons()) {
+    return failImport(importer, 0, errorMessage);
+  }
+  if (!transaction.commit()) {
+    if (errorMessage) *errorMessage = "cannot commit the transaction";
+    return false;
   }
-  fclose(fid);
+  reportProgress(reader.getFileSize(), reader.getFileSize());
+  return true;
+}
+
+bool DatabaseHelper::importFromImageTxt(const QString& filePath,
+                                       QString* errorMessage)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::importFromImageTxt");
+  // Read again from the file at the next access
+  if (!unloadStore()) {
+    if (errorMessage) *errorMessage = "cannot write the pending annotations";
+    return false;
+  }
+  BufferedReader reader;
+  if (!reader.open(filePath)) {
+    if (errorMessage) *errorMessage = "cannot open " + filePath;
+    return false;
+  }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  TextImporter importer(&folders_);
+  const char* line;
+  int size;
+  int lineNumber = 0;
+  qint64 done = 0;
+  while (reader.readLine(&line, &size)) {
+    ++lineNumber;
+    if (size == 0) continue;
+    int imageId;
+    int numBBoxes;
+    if (!parseGroupHeader(line, size, &imageId)) {
+      if (errorMessage) *errorMessage = QString("line %1: expected # "
+          "<image_id>").arg(lineNumber);
+      return false;
+    }
+    ++lineNumber;
+    if (!reader.readLine(&line, &size) || size == 0) {
+      if (errorMessage) *errorMessage = QString("line %1: expected the "
+          "path").arg(lineNumber);
+      return false;
+    }
+    imageId = importer.getImageId(QString::fromUtf8(line, size), imageId);
+    if (imageId == 0) return failImport(importer, lineNumber, errorMessage);
+    ++lineNumber;
+    if (!reader.readLine(&line, &size) || !parseCount(line, size, &numBBoxes)) {
+      if (errorMessage) *errorMessage = QString("line %1: expected the "
+          "number of bboxes").arg(lineNumber);
+      return false;
+    }
+    if (!importer.removeImageBBoxes(imageId)) {
+      return failImport(importer, lineNumber, errorMessage);
+    }
+    for (int i = 0; i < numBBoxes; ++i) {
+      ++lineNumber;
+      int fields[6];
+      if (!reader.readLine(&line, &size) ||
+          !parseFields(line, line + size, false, fields, 6) ||
+          fields[0] <= 0) {
+        if (errorMessage) *errorMessage = QString("line %1: expected "
+            "<person_id> <x> <y> <width> <height> <hard>").arg(lineNumber);
+        return false;
+      }
+      if (!importer.addPerson(fields[0]) ||
+          !importer.addBBox(imageId, fields[0], fields + 1)) {
+        return failImport(importer, lineNumber, errorMessage);
+      }
+    }
+    if (++done % ProgressInterval == 0) {
+      reportProgress(reader.getPosition(), reader.getFileSize());
+    }
+  }
+  if (!importer.removeUnusedPersons()) {
+    return failImport(importer, 0, errorMessage);
+  }
+  if (!transaction.commit()) {
+    if (errorMessage) *errorMessage = "cannot commit the transaction";
+    return false;
+  }
+  reportProgress(reader.getFileSize(), reader.getFileSize());
+  return true;
 }
 
 ImageFile DatabaseHelper::getImageFile(const QString& path)
 {
+  QString folder;
+  QString name;
+  ImageFile::splitPath(path, &folder, &name);
+  int folderId = folders_.findFolderId(folder);
+  if (folderId <= 0) return ImageFile();
+
   QSqlQuery query;
-  query.prepare("SELECT image_id, author FROM psa_image WHERE path = :path");
-  query.bindValue(":path", path.toStdString().c_str());
+  query.setForwardOnly(true);
+  query.prepare("SELECT image_id, folder_id, name, width, height, orientation "
+                "FROM psa_image WHERE folder_id = :folder_id AND name = :name");
+  query.bindValue(":folder_id", folderId);
+  query.bindValue(":name", name);
   query.exec();
+  if (!query.next()) return ImageFile();
+  return readImageFile(query);
+}
 
-  ImageFile imageFile;
-  if (!query.last()) return imageFile;
-  imageFile.setImageId(query.value(0).toInt());
-  imageFile.setPath(path);
-  imageFile.setAuthor(query.value(1).toString());
-  return imageFile;
+QHash<int, ImageFile> DatabaseHelper::getImageFilesByIds(
+    const QVector<int>& imageIds)
+{
+  QHash<int, ImageFile> imageFiles;
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  int numPrepared = 0;
+  for (int begin = 0; begin < imageIds.size(); begin += SelectChunkSize) {
+    int n = std::min(SelectChunkSize, imageIds.size() - begin);
+    if (n != numPrepared) {
+      query.prepare("SELECT image_id, folder_id, name, width, height,"
+                    "       orientation FROM psa_image "
+                    "WHERE image_id IN (" + repeatPlaceholders("?", n) + ")");
+      numPrepared = n;
+    }
+    for (int i = 0; i < n; ++i) {
+      query.bindValue(i, imageIds[begin + i]);
+    }
+    query.exec();
+    while (query.next()) {
+      ImageFile imageFile = readImageFile(query);
+      imageFiles.insert(imageFile.getImageId(), imageFile);
+    }
+    query.finish();
+  }
+  return imageFiles;
+}
+
+QVector<int> DatabaseHelper::getImageIds()
+{
+  QVector<int> imageIds;
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.exec("SELECT i.image_id "
+             "FROM psa_image i JOIN psa_folder f ON f.folder_id = i.folder_id "
+             "ORDER BY f.path, i.name");
+  while (query.next()) {
+    imageIds.push_back(query.value(0).toInt());
+  }
+  return imageIds;
 }
 
 PersonBBox DatabaseHelper::getPersonBBox(int bboxId)
 {
+  if (AnnotationStore* store = getStore()) return store->getPersonBBox(bboxId);
   QSqlQuery query;
-  query.prepare("SELECT image_id, person_id, x, y, width, height, hard "
+  query.prepare("SELECT image_id, person_id, x, y, width, height, hard, "
+                "    version "
                 "FROM psa_bbox WHERE bbox_id = :bbox_id");
   query.bindValue(":bbox_id", bboxId);
   query.exec();
@@ -131,14 +935,20 @@ PersonBBox DatabaseHelper::getPersonBBox(int bboxId)
   personBBox.setBBox(query.value(2).toInt(), query.value(3).toInt(),
                      query.value(4).toInt(), query.value(5).toInt());
   personBBox.setHard(query.value(6).toInt());
+  personBBox.setVersion(query.value(7).toInt());
 
   return personBBox;
 }
 
 QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByImageId(int imageId)
 {
+  PSA_TRACE_SCOPE("DatabaseHelper::getPersonBBoxesByImageId");
+  if (AnnotationStore* store = getStore()) {
+    return store->getPersonBBoxesByImageId(imageId);
+  }
   QSqlQuery query;
-  query.prepare("SELECT bbox_id, person_id, x, y, width, height, hard "
+  query.prepare("SELECT bbox_id, person_id, x, y, width, height, hard, "
+                "    version "
                 "FROM psa_bbox WHERE image_id = :image_id");
   query.bindValue(":image_id", imageId);
   query.exec();
@@ -152,6 +962,7 @@ QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByImageId(int imageId)
     personBBox.setBBox(query.value(2).toInt(), query.value(3).toInt(),
                        query.value(4).toInt(), query.value(5).toInt());
     personBBox.setHard(query.value(6).toInt());
+    personBBox.setVersion(query.value(7).toInt());
     personBBoxes.push_back(personBBox);
   }
   return personBBoxes;
@@ -159,8 +970,12 @@ QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByImageId(int imageId)
 
 QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByPersonId(int personId)
 {
+  if (AnnotationStore* store = getStore()) {
+    return store->getPersonBBoxesByPersonId(personId);
+  }
   QSqlQuery query;
-  query.prepare("SELECT bbox_id, image_id, x, y, width, height, hard "
+  query.prepare("SELECT bbox_id, image_id, x, y, width, height, hard, "
+                "    version "
                 "FROM psa_bbox WHERE person_id = :person_id");
   query.bindValue(":person_id", personId);
   query.exec();
@@ -174,6 +989,7 @@ QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByPersonId(int personId)
     personBBox.setBBox(query.value(2).toInt(), query.value(3).toInt(),
                        query.value(4).toInt(), query.value(5).toInt());
     personBBox.setHard(query.value(6).toInt());
+    personBBox.setVersion(query.value(7).toInt());
     personBBoxes.push_back(personBBox);
   }
   return personBBoxes;
@@ -181,6 +997,7 @@ QVector<PersonBBox> DatabaseHelper::getPersonBBoxesByPersonId(int personId)
 
 bool DatabaseHelper::hasPerson(int personId)
 {
+  if (AnnotationStore* store = getStore()) return store->hasPerson(personId);
   QSqlQuery query;
   query.prepare("SELECT * FROM psa_person WHERE person_id = :person_id");
   query.bindValue(":person_id", personId);
@@ -190,17 +1007,21 @@ bool DatabaseHelper::hasPerson(int personId)
 
 int DatabaseHelper::addImageFile(const QString& path, const QString& author)
 {
+  QString folder;
+  QString name;
+  ImageFile::splitPath(path, &folder, &name);
   QSqlQuery query;
-  query.prepare("INSERT INTO psa_image(path, author) "
-                "VALUES(:path, :author)");
-  query.bindValue(":path", path.toStdString().c_str());
-  query.bindValue(":author", author.toStdString().c_str());
+  query.prepare("INSERT INTO psa_image(folder_id, name) "
+                "VALUES(:folder_id, :name)");
+  query.bindValue(":folder_id", folders_.addFolder(folder, author));
+  query.bindValue(":name", name);
   query.exec();
   return query.lastInsertId().toInt();
 }
 
 int DatabaseHelper::addPerson(int personId)
 {
+  if (AnnotationStore* store = getStore()) return store->addPerson(personId);
   QSqlQuery query;
   if (personId <= 0) {
     query.prepare("INSERT INTO psa_person DEFAULT VALUES");
@@ -216,6 +1037,10 @@ int DatabaseHelper::addPerson(int personId)
 
 int DatabaseHelper::addPersonBBox(const PersonBBox& personBBox)
 {
+  if (AnnotationStore* store = getStore()) {
+    return store->addPersonBBox(personBBox);
+  }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
   QSqlQuery query;
   // Add person if not exists
   int personId = addPerson(personBBox.getPersonId());
@@ -237,74 +1062,500 @@ int DatabaseHelper::addPersonBBox(const PersonBBox& personBBox)
   query.bindValue(":height", personBBox.height());
   query.bindValue(":hard", static_cast<int>(personBBox.isHard()));
   query.exec();
-  return query.lastInsertId().toInt();
+  int bboxId = query.lastInsertId().toInt();
+  transaction.commit();
+  return bboxId;
 }
 
-void DatabaseHelper::removePersonBBox(int bboxId)
+bool DatabaseHelper::updatePersonBBox(PersonBBox* personBBox)
 {
-  int personId = getPersonBBox(bboxId).getPersonId();
+  if (AnnotationStore* store = getStore()) {
+    return store->updatePersonBBox(personBBox);
+  }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  int oldPersonId = getPersonBBox(personBBox->getBBoxId()).getPersonId();
+  // Add person if not exists
+  int personId = addPerson(personBBox->getPersonId());
+
   QSqlQuery query;
-  query.prepare("DELETE FROM psa_bbox WHERE bbox_id = :bbox_id");
-  query.bindValue(":bbox_id", bboxId);
+  query.prepare("UPDATE psa_bbox SET person_id = :person_id, x = :x, y = :y, "
+                "    width = :width, height = :height, hard = :hard, "
+                "    version = version + 1 "
+                "WHERE bbox_id = :bbox_id AND version = :version");
+  query.bindValue(":person_id", personId);
+  query.bindValue(":x", personBBox->x());
+  query.bindValue(":y", personBBox->y());
+  query.bindValue(":width", personBBox->width());
+  query.bindValue(":height", personBBox->height());
+  query.bindValue(":hard", static_cast<int>(personBBox->isHard()));
+  query.bindValue(":bbox_id", personBBox->getBBoxId());
+  query.bindValue(":version", personBBox->getVersion());
   query.exec();
-  if (getPersonBBoxesByPersonId(personId).empty()) {
-    query.prepare("DELETE FROM psa_person WHERE person_id = :person_id");
-    query.bindValue(":person_id", personId);
-    query.exec();
+  // Changed or removed by someone else since it was read. The person which
+  // might have been added is rolled back as well.
+  if (query.numRowsAffected() != 1) return false;
+
+  if (oldPersonId != personId) removePersonIfUnused(oldPersonId);
+  transaction.commit();
+  personBBox->setPersonId(personId);
+  personBBox->setVersion(personBBox->getVersion() + 1);
+  return true;
+}
+
+bool DatabaseHelper::removePersonBBox(const PersonBBox& personBBox)
+{
+  if (AnnotationStore* store = getStore()) {
+    return store->removePersonBBox(personBBox);
   }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  PersonBBox stored = getPersonBBox(personBBox.getBBoxId());
+  // Removed by someone else as well
+  if (stored.isNull()) return true;
+  if (stored.getVersion() != personBBox.getVersion()) return false;
+  QSqlQuery query;
+  query.prepare("DELETE FROM psa_bbox WHERE bbox_id = :bbox_id");
+  query.bindValue(":bbox_id", personBBox.getBBoxId());
+  query.exec();
+  removePersonIfUnused(stored.getPersonId());
+  transaction.commit();
+  return true;
 }
 
 QVector<ImageFile> DatabaseHelper::addAndQueryImageFiles(
-    const QStringList &paths, const QString& author)
+    const QStringList &paths, const QString& author, const QString& rootDir)
 {
-  QVector<ImageFile> ret;
-  foreach (QString path, paths) {
-    ImageFile imageFile = getImageFile(path);
-    if (imageFile.isNull()) {
-      imageFile.setPath(path);
-      imageFile.setAuthor(author);
-      imageFile.setImageId(addImageFile(path, author));
+  PSA_TRACE_SCOPE("DatabaseHelper::addAndQueryImageFiles");
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  qint64 total = 2 * paths.size();
+  // New folders get the author, existing ones keep theirs
+  QVector<int> folderIds;
+  QStringList names;
+  QHash<int, QStringList> namesByFolder;
+  folderIds.reserve(paths.size());
+  names.reserve(paths.size());
+  foreach (const QString& path, paths) {
+    QString folder;
+    QString name;
+    ImageFile::splitPath(path, &folder, &name);
+    int folderId = folders_.addFolder(folder, author);
+    folderIds.push_back(folderId);
+    names.push_back(name);
+    namesByFolder[folderId].push_back(name);
+  }
+
+  // Add the new paths in chunks, leaving the existing ones untouched
+  QSqlQuery insertQuery;
+  int numPrepared = 0;
+  for (int begin = 0; begin < paths.size(); begin += InsertChunkSize) {
+    int n = std::min(InsertChunkSize, paths.size() - begin);
+    if (n != numPrepared) {
+      insertQuery.prepare("INSERT OR IGNORE INTO psa_image(folder_id, name) "
+                          "VALUES " + repeatPlaceholders("(?, ?)", n));
+      numPrepared = n;
     }
-    ret.push_back(imageFile);
+    for (int i = 0; i < n; ++i) {
+      insertQuery.bindValue(2 * i, folderIds[begin + i]);
+      insertQuery.bindValue(2 * i + 1, names[begin + i]);
+    }
+    insertQuery.exec();
+    reportProgress(begin + n, total);
+  }
+
+  // Query back all the images, whether new or not, one folder at a time so
+  // that each chunk is a range of the (folder_id, name) index
+  QHash<QPair<int, QString>, ImageFile> imageFiles;
+  imageFiles.reserve(paths.size());
+  QSqlQuery selectQuery;
+  selectQuery.setForwardOnly(true);
+  numPrepared = 0;
+  qint64 done = paths.size();
+  for (QHash<int, QStringList>::const_iterator it = namesByFolder.constBegin();
+       it != namesByFolder.constEnd(); ++it) {
+    const QStringList& folderNames = it.value();
+    for (int begin = 0; begin < folderNames.size(); begin += SelectChunkSize) {
+      int n = std::min(SelectChunkSize, folderNames.size() - begin);
+      if (n != numPrepared) {
+        QString placeholders = repeatPlaceholders("?", n);
+        selectQuery.prepare("SELECT image_id, folder_id, name, width, height,"
+                            "       orientation FROM psa_image "
+                            "WHERE folder_id = ? AND name IN (" +
+                            placeholders + ")");
+        numPrepared = n;
+      }
+      selectQuery.bindValue(0, it.key());
+      for (int i = 0; i < n; ++i) {
+        selectQuery.bindValue(i + 1, folderNames[begin + i]);
+      }
+      selectQuery.exec();
+      while (selectQuery.next()) {
+        ImageFile imageFile = readImageFile(selectQuery);
+        imageFiles.insert(qMakePair(it.key(), imageFile.getName()), imageFile);
+      }
+      selectQuery.finish();
+      done += n;
+      reportProgress(done, total);
+    }
+  }
+  transaction.commit();
+
+  QVector<ImageFile> ret;
+  ret.reserve(paths.size());
+  for (int i = 0; i < paths.size(); ++i) {
+    ret.push_back(imageFiles.value(qMakePair(folderIds[i], names[i])));
   }
+  if (!rootDir.isEmpty()) probeImageFiles(rootDir, &ret);
   return ret;
 }
 
-void DatabaseHelper::syncPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
-                                      const QVector<bool>& removedMarks)
+void DatabaseHelper::probeImageFiles(const QString& rootDir,
+                                     QVector<ImageFile>* imageFiles)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::probeImageFiles");
+  QVector<ImageFile*> unprobed;
+  for (int i = 0; i < imageFiles->size(); ++i) {
+    ImageFile& imageFile = (*imageFiles)[i];
+    if (!imageFile.isNull() && !imageFile.hasSize()) {
+      unprobed.push_back(&imageFile);
+    }
+  }
+  if (unprobed.isEmpty()) return;
+
+  // Only the headers are read, the pixels are never decoded
+  QtConcurrent::blockingMap(unprobed, [&rootDir](ImageFile* imageFile) {
+    QImageReader imageReader(QDir(rootDir).filePath(imageFile->getPath()));
+    QSize size = imageReader.size();
+    if (!size.isValid()) return;
+    imageFile->setSize(size.width(), size.height());
+    imageFile->setOrientation(static_cast<int>(imageReader.transformation()));
+  });
+
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  QSqlQuery query;
+  query.prepare("UPDATE psa_image SET width = :width, height = :height,"
+                "    orientation = :orientation "
+                "WHERE image_id = :image_id");
+  foreach (const ImageFile* imageFile, unprobed) {
+    if (!imageFile->hasSize()) continue;
+    query.bindValue(":width", imageFile->width());
+    query.bindValue(":height", imageFile->height());
+    query.bindValue(":orientation", imageFile->getOrientation());
+    query.bindValue(":image_id", imageFile->getImageId());
+    query.exec();
+  }
+  transaction.commit();
+}
+
+QVector<ImageFile> DatabaseHelper::importFolder(const QString& rootDir,
+                                                const QString& folderPath,
+                                                bool recursive)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::importFolder");
+  // Get folder's relative path to the root directory
+  QDir root(rootDir);
+  QString relPath = root.relativeFilePath(folderPath);
+  // Use its prefix as the author
+  QString prefix = relPath.split("/", QString::SkipEmptyParts).front();
+
+  QStringList paths;
+  if (recursive) {
+    listImageFilesRecursively(folderPath, &paths);
+  } else {
+    listImageFiles(folderPath, &paths);
+  }
+  for (int i = 0; i < paths.size(); ++i) {
+    paths[i] = root.relativeFilePath(paths[i]);
+  }
+  if (recursive) naturalSort(&paths);
+  return addAndQueryImageFiles(paths, prefix, rootDir);
+}
+
+QMap<QString, qint64> DatabaseHelper::getStatistics()
+{
+  flush();
+  QMap<QString, qint64> statistics;
+  statistics["schema_version"] = getSchemaVersion();
+  statistics["images"] = count("SELECT COUNT(*) FROM psa_image");
+  statistics["annotated_images"] =
+      count("SELECT COUNT(DISTINCT image_id) FROM psa_bbox");
+  statistics["persons"] = count("SELECT COUNT(*) FROM psa_person");
+  statistics["bboxes"] = count("SELECT COUNT(*) FROM psa_bbox");
+  statistics["hard_bboxes"] =
+      count("SELECT COUNT(*) FROM psa_bbox WHERE hard != 0");
+  statistics["folders"] = count("SELECT COUNT(*) FROM psa_folder");
+  statistics["authors"] =
+      count("SELECT COUNT(DISTINCT author) FROM psa_folder");
+  statistics["descriptors"] = count("SELECT COUNT(*) FROM psa_descriptor");
+  return statistics;
+}
+
+QStringList DatabaseHelper::checkIntegrity()
+{
+  flush();
+  QStringList problems;
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.exec("PRAGMA integrity_check");
+  while (query.next()) {
+    QString result = query.value(0).toString();
+    if (result != "ok") problems.push_back(result);
+  }
+  qint64 n = count("SELECT COUNT(*) FROM psa_image WHERE folder_id NOT IN "
+                   "    (SELECT folder_id FROM psa_folder)");
+  if (n > 0) problems.push_back(QString("%1 images of missing folders").arg(n));
+  n = count("SELECT COUNT(*) FROM psa_bbox WHERE image_id NOT IN "
+            "    (SELECT image_id FROM psa_image)");
+  if (n > 0) problems.push_back(QString("%1 bboxes of missing images").arg(n));
+  n = count("SELECT COUNT(*) FROM psa_bbox WHERE person_id NOT IN "
+            "    (SELECT person_id FROM psa_person)");
+  if (n > 0) problems.push_back(QString("%1 bboxes of missing persons").arg(n));
+  n = count("SELECT COUNT(*) FROM psa_person WHERE person_id NOT IN "
+            "    (SELECT person_id FROM psa_bbox)");
+  if (n > 0) problems.push_back(QString("%1 persons without bboxes").arg(n));
+  n = count("SELECT COUNT(*) FROM psa_bbox WHERE width <= 0 OR height <= 0");
+  if (n > 0) problems.push_back(QString("%1 empty bboxes").arg(n));
+  // Only images with probed sizes can be checked, rotated ones are swapped
+  n = count("SELECT COUNT(*) FROM psa_bbox b JOIN psa_image i"
+            "    ON b.image_id = i.image_id "
+            "WHERE i.width > 0 AND i.height > 0 AND ("
+            "    b.x < 0 OR b.y < 0 OR"
+            "    b.x + b.width > CASE WHEN i.orientation & 4"
+            "        THEN i.height ELSE i.width END OR"
+            "    b.y + b.height > CASE WHEN i.orientation & 4"
+            "        THEN i.width ELSE i.height END)");
+  if (n > 0) problems.push_back(QString("%1 bboxes out of images").arg(n));
+  return problems;
+}
+
+QString DatabaseHelper::getFilePath() const
+{
+  return db_.databaseName();
+}
+
+DatasetValidator::Report DatabaseHelper::validateDataset(int numThreads)
+{
+  // The validator reads the file through connections of its own
+  flush();
+  DatasetValidator validator(getFilePath());
+  return validator.run(numThreads);
+}
+
+QVector<PersonBBox> DatabaseHelper::getUndescribedPersonBBoxes(
+    const QVector<int>& imageIds)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::getUndescribedPersonBBoxes");
+  QVector<PersonBBox> undescribed;
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.prepare("SELECT bbox_id, x, y, width, height FROM psa_descriptor "
+                "WHERE image_id = ?");
+  foreach (int imageId, imageIds) {
+    // The bboxes may be in the store only
+    QVector<PersonBBox> personBBoxes = getPersonBBoxesByImageId(imageId);
+    if (personBBoxes.isEmpty()) continue;
+    query.bindValue(0, imageId);
+    query.exec();
+    QHash<int, QRect> described;
+    while (query.next()) {
+      described.insert(query.value(0).toInt(),
+                       QRect(query.value(1).toInt(), query.value(2).toInt(),
+                             query.value(3).toInt(), query.value(4).toInt()));
+    }
+    query.finish();
+    foreach (const PersonBBox& personBBox, personBBoxes) {
+      QRect rect(personBBox.x(), personBBox.y(),
+                 personBBox.width(), personBBox.height());
+      QHash<int, QRect>::const_iterator it =
+          described.constFind(personBBox.getBBoxId());
+      if (it == described.constEnd() || it.value() != rect) {
+        undescribed.push_back(personBBox);
+      }
+    }
+  }
+  return undescribed;
+}
+
+void DatabaseHelper::saveDescriptors(const QVector<PersonBBox>& personBBoxes,
+                                     const QVector<QByteArray>& descriptors)
 {
+  PSA_TRACE_SCOPE("DatabaseHelper::saveDescriptors");
+  DatabaseTransaction transaction(db_);
+  QSqlQuery query;
+  query.prepare("INSERT OR REPLACE INTO psa_descriptor"
+                "    (bbox_id, image_id, x, y, width, height, data) "
+                "VALUES(?, ?, ?, ?, ?, ?, ?)");
   for (int i = 0; i < personBBoxes.size(); ++i) {
+    // Crops outside their images cannot be described
+    if (descriptors[i].isEmpty()) continue;
     const PersonBBox& personBBox = personBBoxes[i];
+    query.bindValue(0, personBBox.getBBoxId());
+    query.bindValue(1, personBBox.getImageId());
+    query.bindValue(2, personBBox.x());
+    query.bindValue(3, personBBox.y());
+    query.bindValue(4, personBBox.width());
+    query.bindValue(5, personBBox.height());
+    query.bindValue(6, descriptors[i]);
+    query.exec();
+  }
+  transaction.commit();
+}
+
+AppearanceIndex DatabaseHelper::loadAppearanceIndex()
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::loadAppearanceIndex");
+  // Joined with the bboxes in the file, which must be up to date
+  flush();
+  QSqlQuery query;
+  query.exec("DELETE FROM psa_descriptor "
+             "WHERE bbox_id NOT IN (SELECT bbox_id FROM psa_bbox)");
+  AppearanceIndex index;
+  index.reserve(static_cast<int>(
+      count("SELECT COUNT(*) FROM psa_descriptor")));
+  query.setForwardOnly(true);
+  query.exec("SELECT d.bbox_id, b.person_id, d.data "
+             "FROM psa_descriptor d JOIN psa_bbox b"
+             "    ON b.bbox_id = d.bbox_id AND b.image_id = d.image_id"
+             "    AND b.x = d.x AND b.y = d.y"
+             "    AND b.width = d.width AND b.height = d.height");
+  while (query.next()) {
+    index.insert(query.value(0).toInt(), query.value(1).toInt(),
+                 query.value(2).toByteArray());
+  }
+  return index;
+}
+
+void DatabaseHelper::syncPersonBBoxes(QVector<PersonBBox>* personBBoxes,
+                                      const QVector<bool>& removedMarks,
+                                      const QVector<bool>& dirtyMarks,
+                                      QVector<int>* conflicts)
+{
+  PSA_TRACE_SCOPE("DatabaseHelper::syncPersonBBoxes");
+  // The store writes behind in transactions of its own
+  if (getStore()) {
+    writePersonBBoxes(personBBoxes, removedMarks, dirtyMarks, conflicts);
+    return;
+  }
+  DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+  writePersonBBoxes(personBBoxes, removedMarks, dirtyMarks, conflicts);
+  transaction.commit();
+}
+
+AnnotationStore* DatabaseHelper::getStore()
+{
+  if (concurrent_) return NULL;
+  if (!store_) {
+    store_ = new AnnotationStore(db_);
+    store_->load();
+  }
+  return store_;
+}
+
+bool DatabaseHelper::unloadStore()
+{
+  if (!store_) return true;
+  // Keep the edits which could not be written
+  if (!store_->flush()) return false;
+  delete store_;
+  store_ = NULL;
+  return true;
+}
+
+void DatabaseHelper::closeStore()
+{
+  if (unloadStore()) return;
+  qWarning() << "pending annotations lost";
+  delete store_;
+  store_ = NULL;
+}
+
+void DatabaseHelper::writePersonBBoxes(QVector<PersonBBox>* personBBoxes,
+                                       const QVector<bool>& removedMarks,
+                                       const QVector<bool>& dirtyMarks,
+                                       QVector<int>* conflicts)
+{
+  for (int i = 0; i < personBBoxes->size(); ++i) {
+    PersonBBox& personBBox = (*personBBoxes)[i];
+    bool written = true;
     if (removedMarks[i]) {
-      removePersonBBox(personBBox.getBBoxId());
-    } else {
-      if (personBBox.getBBoxId() <= 0) {
-        addPersonBBox(personBBox);
-      } else {
-        removePersonBBox(personBBox.getBBoxId());
-        addPersonBBox(personBBox);
+      // Bboxes never saved need not to be removed
+      if (personBBox.getBBoxId() > 0) {
+        written = removePersonBBox(personBBox);
+        if (written) personBBox.setBBoxId(0);
       }
+    } else if (personBBox.getBBoxId() <= 0) {
+      personBBox.setPersonId(addPerson(personBBox.getPersonId()));
+      personBBox.setBBoxId(addPersonBBox(personBBox));
+      personBBox.setVersion(0);
+    } else if (dirtyMarks[i]) {
+      written = updatePersonBBox(&personBBox);
     }
+    if (!written && conflicts) conflicts->push_back(i);
   }
 }
 
-void DatabaseHelper::createTables()
+void DatabaseHelper::removePersonIfUnused(int personId)
+{
+  QSqlQuery query;
+  query.prepare("SELECT 1 FROM psa_bbox WHERE person_id = :person_id LIMIT 1");
+  query.bindValue(":person_id", personId);
+  query.exec();
+  if (query.next()) return;
+  query.prepare("DELETE FROM psa_person WHERE person_id = :person_id");
+  query.bindValue(":person_id", personId);
+  query.exec();
+}
+
+void DatabaseHelper::reportProgress(qint64 done, qint64 total)
+{
+  if (progressCallback_) progressCallback_(done, total);
+}
+
+qint64 DatabaseHelper::count(const QString& sql)
+{
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  if (!query.exec(sql) || !query.next()) return 0;
+  return query.value(0).toLongLong();
+}
+
+ImageFile DatabaseHelper::readImageFile(const QSqlQuery& query)
+{
+  // Columns are image_id, folder_id, name, width, height and orientation
+  FolderDictionary::Folder folder = folders_.getFolder(query.value(1).toInt());
+  ImageFile imageFile;
+  imageFile.setImageId(query.value(0).toInt());
+  imageFile.setFolder(folder.path);
+  imageFile.setName(query.value(2).toString());
+  imageFile.setAuthor(folder.author);
+  imageFile.setSize(query.value(3).toInt(), query.value(4).toInt());
+  imageFile.setOrientation(query.value(5).toInt());
+  return imageFile;
+}
+
+bool DatabaseHelper::migrate()
 {
   QSqlQuery query;
   query.exec("PRAGMA foreign_keys = ON");
-  query.exec("CREATE TABLE IF NOT EXISTS psa_image("
-             "    image_id INTEGER PRIMARY KEY,"
-             "    path TEXT NOT NULL,"
-             "    author VARCHAR(128) NOT NULL)");
-  query.exec("CREATE TABLE IF NOT EXISTS psa_person("
-             "    person_id INTEGER PRIMARY KEY)");
-  query.exec("CREATE TABLE IF NOT EXISTS psa_bbox("
-             "    bbox_id INTEGER PRIMARY KEY,"
-             "    image_id INTEGER NOT NULL,"
-             "    person_id INTEGER NOT NULL,"
-             "    x INTEGER NOT NULL,"
-             "    y INTEGER NOT NULL,"
-             "    width INTEGER NOT NULL,"
-             "    height INTEGER NOT NULL,"
-             "    hard INTEGER NOT NULL)");
+  if (!query.exec("CREATE TABLE IF NOT EXISTS psa_schema("
+                  "    version INTEGER NOT NULL)")) {
+    qDebug() << "cannot read the schema version:" << query.lastError().text();
+    return false;
+  }
+  for (int version = getSchemaVersion(); version < NumMigrations; ++version) {
+    DatabaseTransaction transaction(db_, DatabaseTransaction::ModeImmediate);
+    for (const char* const* sql = Migrations[version]; *sql; ++sql) {
+      if (!query.exec(*sql)) {
+        qDebug() << "migration to version" << version + 1 << "failed:"
+                 << query.lastError().text();
+        return false;
+      }
+    }
+    query.prepare("INSERT INTO psa_schema(version) VALUES(:version)");
+    query.bindValue(":version", version + 1);
+    if (!query.exec() || !transaction.commit()) {
+      qDebug() << "migration to version" << version + 1 << "failed:"
+               << query.lastError().text();
+      return false;
+    }
+  }
+  return true;
 }
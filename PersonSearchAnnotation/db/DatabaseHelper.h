@@ -3,21 +3,69 @@
 
 #include "common/ImageFile.hpp"
 #include "common/PersonBBox.hpp"
+#include "db/FolderDictionary.h"
+#include "db/DatasetValidator.h"
+#include "utils/AppearanceIndex.h"
+#include <functional>
+#include <QMap>
+#include <QHash>
 #include <QVector>
 #include <QStringList>
 #include <QSqlDatabase>
 
+class AnnotationStore;
+class QSqlQuery;
+
 class DatabaseHelper
 {
+public:
+  typedef std::function<void(qint64 done, qint64 total)> ProgressCallback;
+
 public:
   DatabaseHelper();
   ~DatabaseHelper();
 
-  void init(const QString& filePath);
-  void exportToPersonTxt(const QString& filePath);
-  void exportToImageTxt(const QString& filePath);
+  // Concurrent mode lets several annotators share the file, see the
+  // comments in the implementation. Returns false if the file cannot be
+  // opened or brought to the current schema.
+  bool init(const QString& filePath, bool concurrent = false);
+  QString getFilePath() const;
+  int getSchemaVersion();
+  // Page cache in kilobytes, kept for the next connections
+  void setCacheSize(int cacheSize);
+
+  // Outside concurrent mode, the bboxes and persons are read into memory at
+  // their first access, or here at once, and all their reads are served from
+  // there. Their writes reach the file in batches, or at flush.
+  void loadAnnotationStore();
+  // Returns false if the pending writes could not be written, in which case
+  // they stay pending
+  bool flush();
+  bool hasPendingWrites() const;
+
+  // Called periodically by the long running operations
+  void setProgressCallback(const ProgressCallback& progressCallback);
+
+  // Return false if the file cannot be written in full
+  bool exportToPersonTxt(const QString& filePath);
+  bool exportToImageTxt(const QString& filePath);
+  // Memory-mappable file for common/BinaryAnnotation.hpp
+  bool exportToBinary(const QString& filePath);
+
+  // Read files in the formats of the text exports, all or nothing. Each
+  // group replaces the bboxes of its person or image. The text files carry
+  // no bbox ids, so bboxes get new ones; person ids are kept, and so are
+  // the image ids of new images if not taken.
+  bool importFromPersonTxt(const QString& filePath,
+                           QString* errorMessage = NULL);
+  bool importFromImageTxt(const QString& filePath,
+                          QString* errorMessage = NULL);
 
   ImageFile getImageFile(const QString& path);
+  // Keyed by image id, missing ones are left out
+  QHash<int, ImageFile> getImageFilesByIds(const QVector<int>& imageIds);
+  // All the images, ordered by folder and then by name
+  QVector<int> getImageIds();
 
   PersonBBox getPersonBBox(int bboxId);
   QVector<PersonBBox> getPersonBBoxesByImageId(int imageId);
@@ -29,19 +77,74 @@ public:
   int addPerson(int personId);
   int addPersonBBox(const PersonBBox& personBBox);
 
-  void removePersonBBox(int bboxId);
+  // Both fail, writing nothing, if the bbox has been changed by another
+  // connection since its version was read. Updates bump the version.
+  bool updatePersonBBox(PersonBBox* personBBox);
+  bool removePersonBBox(const PersonBBox& personBBox);
 
+  // The author belongs to the folder, and is only stored if the folder is
+  // new. Images which are new or not probed yet get their sizes and
+  // orientations read from the file headers under rootDir, if given.
   QVector<ImageFile> addAndQueryImageFiles(
-      const QStringList& paths, const QString& author);
+      const QStringList& paths, const QString& author,
+      const QString& rootDir = QString());
+  void probeImageFiles(const QString& rootDir,
+                       QVector<ImageFile>* imageFiles);
+  // Adds the images of a folder under the images root directory, using the
+  // first component of the folder's relative path as the author. Recursive
+  // imports walk the whole tree and are returned in natural sort order.
+  QVector<ImageFile> importFolder(const QString& rootDir,
+                                  const QString& folderPath,
+                                  bool recursive = false);
+
+  QMap<QString, qint64> getStatistics();
+  // Returns the problems found, empty if the database is consistent
+  QStringList checkIntegrity();
+  // Annotation checks on threads of their own, see DatasetValidator
+  DatasetValidator::Report validateDataset(int numThreads = 0);
+
+  // Bboxes of the images whose appearance descriptors are missing or were
+  // made for other geometries
+  QVector<PersonBBox> getUndescribedPersonBBoxes(const QVector<int>& imageIds);
+  // Descriptors from AppearanceDescriptor, one per bbox, empty ones skipped
+  void saveDescriptors(const QVector<PersonBBox>& personBBoxes,
+                       const QVector<QByteArray>& descriptors);
+  // The descriptors which still match their bboxes, with the persons of the
+  // bboxes. Drops the descriptors of removed bboxes.
+  AppearanceIndex loadAppearanceIndex();
 
-  void syncPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
-                        const QVector<bool>& removedMarks);
+  // Writes only the new, modified and removed bboxes. New bboxes and persons
+  // get their ids assigned in place. Bboxes changed by others in the
+  // meantime are left alone and their indices appended to conflicts.
+  void syncPersonBBoxes(QVector<PersonBBox>* personBBoxes,
+                        const QVector<bool>& removedMarks,
+                        const QVector<bool>& dirtyMarks,
+                        QVector<int>* conflicts = NULL);
 
 private:
-  void createTables();
+  AnnotationStore* getStore();
+  // Before the bboxes are written other than through the store. Fails,
+  // keeping the store, if its pending writes cannot be written.
+  bool unloadStore();
+  // Unloads the store even if its writes are lost
+  void closeStore();
+  void writePersonBBoxes(QVector<PersonBBox>* personBBoxes,
+                         const QVector<bool>& removedMarks,
+                         const QVector<bool>& dirtyMarks,
+                         QVector<int>* conflicts);
+  ImageFile readImageFile(const QSqlQuery& query);
+  bool migrate();
+  void removePersonIfUnused(int personId);
+  void reportProgress(qint64 done, qint64 total);
+  qint64 count(const QString& sql);
 
 private:
   QSqlDatabase db_;
+  bool concurrent_;
+  int cacheSize_;
+  AnnotationStore* store_;
+  FolderDictionary folders_;
+  ProgressCallback progressCallback_;
 };
 
 #endif // DATABASEHELPER_H
@@ -0,0 +1,54 @@
+#include "db/DatabaseTransaction.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+DatabaseTransaction::DatabaseTransaction(const QSqlDatabase& db, Mode mode)
+  : db_(db),
+    active_(false),
+    outermost_(false)
+{
+  QSqlQuery query(db_);
+  // Fails inside an enclosing transaction, where a savepoint is used instead
+  if (mode == ModeImmediate && query.exec("BEGIN IMMEDIATE")) {
+    active_ = true;
+    outermost_ = true;
+    return;
+  }
+  // Savepoints behave like BEGIN when there is no enclosing transaction
+  active_ = query.exec("SAVEPOINT psa_transaction");
+  if (!active_) {
+    qDebug() << "begin transaction failed:" << query.lastError().text();
+  }
+}
+
+DatabaseTransaction::~DatabaseTransaction()
+{
+  rollback();
+}
+
+bool DatabaseTransaction::commit()
+{
+  if (!active_) return false;
+  QSqlQuery query(db_);
+  if (!query.exec(outermost_ ? "COMMIT" : "RELEASE psa_transaction")) {
+    qDebug() << "commit transaction failed:" << query.lastError().text();
+    rollback();
+    return false;
+  }
+  active_ = false;
+  return true;
+}
+
+void DatabaseTransaction::rollback()
+{
+  if (!active_) return;
+  QSqlQuery query(db_);
+  if (outermost_) {
+    query.exec("ROLLBACK");
+  } else {
+    query.exec("ROLLBACK TO psa_transaction");
+    query.exec("RELEASE psa_transaction");
+  }
+  active_ = false;
+}
@@ -0,0 +1,38 @@
+#ifndef DATABASETRANSACTION_H
+#define DATABASETRANSACTION_H
+
+#include <QSqlDatabase>
+
+// Scoped transaction which is rolled back unless committed. Scopes can be
+// nested, in which case only the outermost one reaches the disk.
+class DatabaseTransaction
+{
+public:
+  enum Mode {
+    // Locks the database at the first write
+    ModeDeferred,
+    // Locks the database for writing at once if outermost, so that the
+    // transaction does not fail halfway when another connection writes
+    ModeImmediate
+  };
+
+public:
+  explicit DatabaseTransaction(
+      const QSqlDatabase& db = QSqlDatabase::database(),
+      Mode mode = ModeDeferred);
+  ~DatabaseTransaction();
+
+  bool commit();
+  void rollback();
+
+private:
+  DatabaseTransaction(const DatabaseTransaction&);
+  const DatabaseTransaction& operator = (const DatabaseTransaction&);
+
+private:
+  QSqlDatabase db_;
+  bool active_;
+  bool outermost_;
+};
+
+#endif // DATABASETRANSACTION_H
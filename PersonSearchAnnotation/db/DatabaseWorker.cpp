@@ -0,0 +1,140 @@
+#include "db/DatabaseWorker.h"
+#include "utils/Trace.h"
+#include <QMutexLocker>
+#include <QDebug>
+
+// Idle time after which the writes kept in memory go to the file
+static const unsigned long WriteBehindDelay = 1000;
+
+DatabaseWorker::DatabaseWorker(QObject* parent)
+  : QThread(parent),
+    stopping_(false)
+{
+  setObjectName("DatabaseWorker");
+}
+
+DatabaseWorker::~DatabaseWorker()
+{
+  {
+    QMutexLocker locker(&mutex_);
+    stopping_ = true;
+    taskPosted_.wakeAll();
+  }
+  // Pending writes are finished before the connection is closed, and the
+  // ones kept in memory are flushed by the destructor of the helper
+  wait();
+}
+
+void DatabaseWorker::post(const Task& task)
+{
+  QMutexLocker locker(&mutex_);
+  tasks_.enqueue(task);
+  taskPosted_.wakeAll();
+}
+
+void DatabaseWorker::flush()
+{
+  Q_ASSERT(currentThread() != this);
+  QMutexLocker locker(&mutex_);
+  while (!tasks_.isEmpty()) {
+    queueEmpty_.wait(&mutex_);
+  }
+}
+
+void DatabaseWorker::init(const QString& filePath, bool concurrent)
+{
+  post([this, filePath, concurrent](DatabaseHelper* databaseHelper) {
+    insertedPersonBBoxes_.clear();
+    writtenVersions_.clear();
+    if (!databaseHelper->init(filePath, concurrent)) {
+      qWarning() << "cannot open the database" << filePath;
+    }
+    databaseHelper->loadAnnotationStore();
+  });
+}
+
+void DatabaseWorker::run()
+{
+  // The connection belongs to the thread which creates it
+  DatabaseHelper databaseHelper;
+  forever {
+    Task task;
+    {
+      QMutexLocker locker(&mutex_);
+      while (tasks_.isEmpty() && !stopping_) {
+        if (!databaseHelper.hasPendingWrites()) {
+          taskPosted_.wait(&mutex_);
+        } else if (!taskPosted_.wait(&mutex_, WriteBehindDelay)) {
+          locker.unlock();
+          // Tried again after the next delay if it failed
+          if (!databaseHelper.flush()) {
+            qWarning() << "pending annotations not written, retrying";
+          }
+          locker.relock();
+        }
+      }
+      if (tasks_.isEmpty()) break;
+      // Stays in the queue until done, so that flush waits for it
+      task = tasks_.head();
+    }
+    {
+      PSA_TRACE_SCOPE("DatabaseWorker::task");
+      task(&databaseHelper);
+    }
+    {
+      QMutexLocker locker(&mutex_);
+      tasks_.dequeue();
+      if (tasks_.isEmpty()) queueEmpty_.wakeAll();
+    }
+  }
+}
+
+DatabaseWorker::SyncResult DatabaseWorker::syncPersonBBoxes(
+    DatabaseHelper* databaseHelper, QVector<PersonBBox> personBBoxes,
+    const QVector<bool>& removedMarks, const QVector<bool>& dirtyMarks)
+{
+  QVector<int> provisionalIds(personBBoxes.size(), 0);
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    PersonBBox& personBBox = personBBoxes[i];
+    int bboxId = personBBox.getBBoxId();
+    if (bboxId < -1) {
+      provisionalIds[i] = bboxId;
+      ProvisionalIdMap::const_iterator it =
+          insertedPersonBBoxes_.constFind(bboxId);
+      if (it == insertedPersonBBoxes_.constEnd()) {
+        // Not inserted yet
+        personBBox.setBBoxId(0);
+        continue;
+      }
+      // Inserted by a previous save whose ids have not reached the GUI
+      bboxId = it->getBBoxId();
+      personBBox.setBBoxId(bboxId);
+      if (personBBox.getPersonId() <= 0) {
+        personBBox.setPersonId(it->getPersonId());
+      }
+    }
+    int version = writtenVersions_.value(bboxId, -1);
+    if (version > personBBox.getVersion()) personBBox.setVersion(version);
+  }
+
+  QVector<int> conflicts;
+  databaseHelper->syncPersonBBoxes(&personBBoxes, removedMarks, dirtyMarks,
+                                   &conflicts);
+
+  SyncResult result;
+  foreach (int i, conflicts) {
+    result.conflicts.push_back(personBBoxes[i]);
+  }
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    const PersonBBox& personBBox = personBBoxes[i];
+    if (removedMarks[i] || conflicts.contains(i)) continue;
+    if (personBBox.getBBoxId() > 0) {
+      writtenVersions_.insert(personBBox.getBBoxId(), personBBox.getVersion());
+    }
+    if (provisionalIds[i] != 0) {
+      insertedPersonBBoxes_.insert(provisionalIds[i], personBBox);
+      result.saved.insert(provisionalIds[i], personBBox);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,132 @@
+#ifndef DATABASEWORKER_H
+#define DATABASEWORKER_H
+
+#include "common/PersonBBox.hpp"
+#include "db/DatabaseHelper.h"
+#include <functional>
+#include <type_traits>
+#include <QHash>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+// Owns the database connection on a thread of its own. Tasks are run one by
+// one in the order they are posted, so a read always sees the writes posted
+// before it.
+class DatabaseWorker : public QThread
+{
+  Q_OBJECT
+
+public:
+  typedef std::function<void(DatabaseHelper* databaseHelper)> Task;
+  typedef QHash<int, PersonBBox> ProvisionalIdMap;
+
+  struct SyncResult
+  {
+    // New bboxes keyed by their provisional ids
+    ProvisionalIdMap saved;
+    // Bboxes changed or removed by others, left as they are in the database
+    QVector<PersonBBox> conflicts;
+  };
+
+public:
+  explicit DatabaseWorker(QObject* parent = 0);
+  ~DatabaseWorker();
+
+  void post(const Task& task);
+
+  // Runs query on the worker thread, then callback with its result on the
+  // thread of receiver. Results for a deleted receiver are dropped.
+  template <typename Query, typename Callback>
+  void query(Query query, QObject* receiver, Callback callback);
+
+  // Blocks until query and all the tasks before it are done
+  template <typename Query>
+  typename std::result_of<Query(DatabaseHelper*)>::type call(Query query);
+
+  // Blocks until the queue is empty
+  void flush();
+
+  void init(const QString& filePath, bool concurrent = false);
+
+  // New bboxes must carry provisional ids less than -1 that are unique in
+  // the session. Saving again before the real ids are known then updates
+  // the rows inserted the first time instead of adding them twice. The
+  // callback receives a SyncResult.
+  template <typename Callback>
+  void syncPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
+                        const QVector<bool>& removedMarks,
+                        const QVector<bool>& dirtyMarks,
+                        QObject* receiver, Callback callback);
+
+protected:
+  void run();
+
+private:
+  SyncResult syncPersonBBoxes(DatabaseHelper* databaseHelper,
+                              QVector<PersonBBox> personBBoxes,
+                              const QVector<bool>& removedMarks,
+                              const QVector<bool>& dirtyMarks);
+
+  // Calls function on the thread of receiver, from any thread
+  template <typename Function>
+  static void postToObject(QObject* receiver, Function function);
+
+private:
+  QMutex mutex_;
+  QWaitCondition taskPosted_;
+  QWaitCondition queueEmpty_;
+  QQueue<Task> tasks_;
+  bool stopping_;
+
+  // Touched by the worker thread only. The GUI may lag behind the versions
+  // of the rows written by itself, which must not count as conflicts.
+  ProvisionalIdMap insertedPersonBBoxes_;
+  QHash<int, int> writtenVersions_;
+};
+
+template <typename Query, typename Callback>
+void DatabaseWorker::query(Query query, QObject* receiver, Callback callback)
+{
+  post([=](DatabaseHelper* databaseHelper) {
+    typename std::result_of<Query(DatabaseHelper*)>::type result =
+        query(databaseHelper);
+    postToObject(receiver, [=]() { callback(result); });
+  });
+}
+
+template <typename Query>
+typename std::result_of<Query(DatabaseHelper*)>::type
+DatabaseWorker::call(Query query)
+{
+  typename std::result_of<Query(DatabaseHelper*)>::type result;
+  post([&](DatabaseHelper* databaseHelper) {
+    result = query(databaseHelper);
+  });
+  flush();
+  return result;
+}
+
+template <typename Callback>
+void DatabaseWorker::syncPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
+                                      const QVector<bool>& removedMarks,
+                                      const QVector<bool>& dirtyMarks,
+                                      QObject* receiver, Callback callback)
+{
+  query([=](DatabaseHelper* databaseHelper) {
+    return syncPersonBBoxes(databaseHelper, personBBoxes,
+                            removedMarks, dirtyMarks);
+  }, receiver, callback);
+}
+
+template <typename Function>
+void DatabaseWorker::postToObject(QObject* receiver, Function function)
+{
+  // The queued slot runs in the thread of receiver once the source is gone
+  QObject source;
+  QObject::connect(&source, &QObject::destroyed, receiver, function,
+                   Qt::QueuedConnection);
+}
+
+#endif // DATABASEWORKER_H
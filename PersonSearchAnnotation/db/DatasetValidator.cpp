@@ -0,0 +1,408 @@
+#include "db/DatasetValidator.h"
+#include "utils/Trace.h"
+#include <algorithm>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+
+typedef DatasetValidator::Issue Issue;
+typedef DatasetValidator::IssueType IssueType;
+
+// Share of the union above which two bboxes count as one annotated twice
+static const double DuplicateIoU = 0.9;
+// More shards than threads even out the ranges with more bboxes
+static const int ShardsPerThread = 4;
+
+namespace
+{
+
+struct BBox
+{
+  int bboxId;
+  int personId;
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+struct ShardResult
+{
+  ShardResult() : numImages(0), numBBoxes(0) {}
+
+  qint64 numImages;
+  qint64 numBBoxes;
+  QVector<Issue> issues;
+  QString error;
+};
+
+// Read-only connection owned by the calling thread. Must outlive the
+// queries on it.
+class Connection
+{
+public:
+  explicit Connection(const QString& filePath)
+  {
+    static QAtomicInt serial;
+    name_ = QString("DatasetValidator%1").arg(serial.fetchAndAddRelaxed(1));
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name_);
+    db.setDatabaseName(filePath);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!db.open()) error_ = db.lastError().text();
+  }
+
+  ~Connection()
+  {
+    QSqlDatabase::database(name_, false).close();
+    QSqlDatabase::removeDatabase(name_);
+  }
+
+  QSqlDatabase get() const { return QSqlDatabase::database(name_, false); }
+  // Empty if the connection is open
+  const QString& getError() const { return error_; }
+
+private:
+  QString name_;
+  QString error_;
+};
+
+// Rows read so far are kept, the error makes the report incomplete
+static void failRead(const QSqlQuery& query, ShardResult* result)
+{
+  result->error = query.lastError().text();
+}
+
+}
+
+static Issue makeIssue(IssueType type, int imageId, const BBox& bbox,
+                       int otherBBoxId = 0)
+{
+  Issue issue;
+  issue.type = type;
+  issue.imageId = imageId;
+  issue.personId = bbox.personId;
+  issue.bboxId = bbox.bboxId;
+  issue.otherBBoxId = otherBBoxId;
+  return issue;
+}
+
+static double getIoU(const BBox& a, const BBox& b)
+{
+  qint64 w = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+  qint64 h = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+  if (w <= 0 || h <= 0) return 0;
+  qint64 intersection = w * h;
+  qint64 areaA = static_cast<qint64>(a.width) * a.height;
+  qint64 areaB = static_cast<qint64>(b.width) * b.height;
+  return static_cast<double>(intersection) / (areaA + areaB - intersection);
+}
+
+static bool isBeforeByPerson(const BBox& a, const BBox& b)
+{
+  return a.personId < b.personId;
+}
+
+// All the checks of an image, with its bboxes in id order
+static void checkImage(int imageId, int width, int height, int orientation,
+                       QVector<BBox>* bboxes, QVector<Issue>* issues)
+{
+  // Bboxes are annotated on the image as displayed
+  if (orientation & 0x4) std::swap(width, height);
+  bool hasSize = width > 0 && height > 0;
+  for (int i = 0; i < bboxes->size(); ++i) {
+    const BBox& bbox = (*bboxes)[i];
+    if (bbox.width <= 0 || bbox.height <= 0) {
+      issues->push_back(makeIssue(DatasetValidator::EmptyBBox, imageId, bbox));
+      continue;
+    }
+    if (hasSize && (bbox.x < 0 || bbox.y < 0 ||
+                    bbox.x + bbox.width > width ||
+                    bbox.y + bbox.height > height)) {
+      issues->push_back(makeIssue(DatasetValidator::OutOfImage, imageId,
+                                  bbox));
+    }
+    for (int j = 0; j < i; ++j) {
+      const BBox& other = (*bboxes)[j];
+      if (other.width <= 0 || other.height <= 0) continue;
+      if (getIoU(bbox, other) >= DuplicateIoU) {
+        issues->push_back(makeIssue(DatasetValidator::DuplicateBBox, imageId,
+                                    bbox, other.bboxId));
+        break;
+      }
+    }
+  }
+  // Bboxes of the same person end up next to each other, still in id order
+  std::stable_sort(bboxes->begin(), bboxes->end(), isBeforeByPerson);
+  for (int i = 1, first = 0; i < bboxes->size(); ++i) {
+    if ((*bboxes)[i].personId != (*bboxes)[first].personId) {
+      first = i;
+      continue;
+    }
+    issues->push_back(makeIssue(DatasetValidator::RepeatedPerson, imageId,
+                                (*bboxes)[i], (*bboxes)[first].bboxId));
+  }
+}
+
+static ShardResult checkImages(const QString& filePath, int firstImageId,
+                               int lastImageId)
+{
+  PSA_TRACE_SCOPE("DatasetValidator::checkImages");
+  ShardResult result;
+  Connection connection(filePath);
+  if (!connection.getError().isEmpty()) {
+    result.error = connection.getError();
+    return result;
+  }
+  QSqlQuery query(connection.get());
+  query.setForwardOnly(true);
+  query.prepare("SELECT i.image_id, i.width, i.height, i.orientation,"
+                "       b.bbox_id, b.person_id, b.x, b.y, b.width, b.height "
+                "FROM psa_image i "
+                "LEFT JOIN psa_bbox b ON b.image_id = i.image_id "
+                "WHERE i.image_id BETWEEN ? AND ? "
+                "ORDER BY i.image_id, b.bbox_id");
+  query.bindValue(0, firstImageId);
+  query.bindValue(1, lastImageId);
+  if (!query.exec()) {
+    failRead(query, &result);
+    return result;
+  }
+  QVector<BBox> bboxes;
+  int imageId = 0;
+  int width = 0;
+  int height = 0;
+  int orientation = 0;
+  while (query.next()) {
+    int id = query.value(0).toInt();
+    if (result.numImages == 0 || id != imageId) {
+      if (result.numImages > 0) {
+        checkImage(imageId, width, height, orientation, &bboxes,
+                   &result.issues);
+        bboxes.clear();
+      }
+      imageId = id;
+      width = query.value(1).toInt();
+      height = query.value(2).toInt();
+      orientation = query.value(3).toInt();
+      ++result.numImages;
+    }
+    if (query.isNull(4)) continue;
+    BBox bbox;
+    bbox.bboxId = query.value(4).toInt();
+    bbox.personId = query.value(5).toInt();
+    bbox.x = query.value(6).toInt();
+    bbox.y = query.value(7).toInt();
+    bbox.width = query.value(8).toInt();
+    bbox.height = query.value(9).toInt();
+    bboxes.push_back(bbox);
+    ++result.numBBoxes;
+  }
+  if (query.lastError().isValid()) failRead(query, &result);
+  if (result.numImages > 0) {
+    checkImage(imageId, width, height, orientation, &bboxes, &result.issues);
+  }
+  return result;
+}
+
+// Rows referring to missing ones, which no image range can find
+static ShardResult findOrphans(const QString& filePath, IssueType type)
+{
+  PSA_TRACE_SCOPE("DatasetValidator::findOrphans");
+  ShardResult result;
+  Connection connection(filePath);
+  if (!connection.getError().isEmpty()) {
+    result.error = connection.getError();
+    return result;
+  }
+  QSqlQuery query(connection.get());
+  query.setForwardOnly(true);
+  // Columns are image_id, person_id and bbox_id
+  const char* sql;
+  switch (type) {
+    case DatasetValidator::PersonWithoutBBoxes:
+      sql = "SELECT 0, p.person_id, 0 FROM psa_person p "
+            "WHERE NOT EXISTS (SELECT 1 FROM psa_bbox b"
+            "    WHERE b.person_id = p.person_id)";
+      break;
+    case DatasetValidator::BBoxOfMissingImage:
+      sql = "SELECT b.image_id, b.person_id, b.bbox_id FROM psa_bbox b "
+            "WHERE NOT EXISTS (SELECT 1 FROM psa_image i"
+            "    WHERE i.image_id = b.image_id)";
+      break;
+    case DatasetValidator::BBoxOfMissingPerson:
+      sql = "SELECT b.image_id, b.person_id, b.bbox_id FROM psa_bbox b "
+            "WHERE NOT EXISTS (SELECT 1 FROM psa_person p"
+            "    WHERE p.person_id = b.person_id)";
+      break;
+    default:
+      return result;
+  }
+  if (!query.exec(sql)) {
+    failRead(query, &result);
+    return result;
+  }
+  while (query.next()) {
+    Issue issue;
+    issue.type = type;
+    issue.imageId = query.value(0).toInt();
+    issue.personId = query.value(1).toInt();
+    issue.bboxId = query.value(2).toInt();
+    result.issues.push_back(issue);
+  }
+  if (query.lastError().isValid()) failRead(query, &result);
+  return result;
+}
+
+static bool isBefore(const Issue& a, const Issue& b)
+{
+  if (a.type != b.type) return a.type < b.type;
+  if (a.imageId != b.imageId) return a.imageId < b.imageId;
+  if (a.personId != b.personId) return a.personId < b.personId;
+  return a.bboxId < b.bboxId;
+}
+
+int DatasetValidator::Report::getCount(IssueType type) const
+{
+  int n = 0;
+  foreach (const Issue& issue, issues) {
+    if (issue.type == type) ++n;
+  }
+  return n;
+}
+
+QJsonObject DatasetValidator::Report::toJson() const
+{
+  QJsonObject summary;
+  for (int type = 0; type < NumIssueTypes; ++type) {
+    summary.insert(getIssueName(static_cast<IssueType>(type)),
+                   getCount(static_cast<IssueType>(type)));
+  }
+  QJsonArray issueArray;
+  foreach (const Issue& issue, issues) {
+    QJsonObject object;
+    object.insert("type", getIssueName(issue.type));
+    if (issue.imageId > 0) object.insert("image_id", issue.imageId);
+    if (issue.personId > 0) object.insert("person_id", issue.personId);
+    if (issue.bboxId > 0) object.insert("bbox_id", issue.bboxId);
+    if (issue.otherBBoxId > 0) {
+      object.insert("other_bbox_id", issue.otherBBoxId);
+    }
+    issueArray.append(object);
+  }
+  QJsonObject report;
+  report.insert("database", filePath);
+  report.insert("images", numImages);
+  report.insert("bboxes", numBBoxes);
+  report.insert("threads", numThreads);
+  report.insert("elapsed_ms", elapsed);
+  report.insert("summary", summary);
+  report.insert("issues", issueArray);
+  if (!error.isEmpty()) report.insert("error", error);
+  return report;
+}
+
+bool DatasetValidator::Report::save(const QString& filePath) const
+{
+  QFile file(filePath);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+  return file.write(QJsonDocument(toJson()).toJson()) >= 0;
+}
+
+DatasetValidator::DatasetValidator(const QString& filePath)
+  : filePath_(filePath)
+{
+
+}
+
+DatasetValidator::~DatasetValidator()
+{
+
+}
+
+DatasetValidator::Report DatasetValidator::run(int numThreads)
+{
+  PSA_TRACE_SCOPE("DatasetValidator::run");
+  QElapsedTimer timer;
+  timer.start();
+  if (numThreads <= 0) numThreads = std::max(QThread::idealThreadCount(), 1);
+  Report report;
+  report.filePath = filePath_;
+  report.numThreads = numThreads;
+
+  qint64 minImageId = 0;
+  qint64 maxImageId = -1;
+  {
+    Connection connection(filePath_);
+    QSqlQuery query(connection.get());
+    query.setForwardOnly(true);
+    if (!connection.getError().isEmpty()) {
+      report.error = connection.getError();
+    } else if (!query.exec("SELECT MIN(image_id), MAX(image_id) "
+                           "FROM psa_image")) {
+      report.error = query.lastError().text();
+    } else if (query.next() && !query.isNull(0)) {
+      minImageId = query.value(0).toLongLong();
+      maxImageId = query.value(1).toLongLong();
+    }
+  }
+  // Nothing else can be read either
+  if (!report.error.isEmpty()) {
+    report.elapsed = timer.elapsed();
+    return report;
+  }
+
+  QThreadPool threadPool;
+  threadPool.setMaxThreadCount(numThreads);
+  QVector<QFuture<ShardResult> > futures;
+  // The scans of all the bboxes are the longest, so they start first
+  const IssueType orphanTypes[] = {
+    BBoxOfMissingImage, BBoxOfMissingPerson, PersonWithoutBBoxes
+  };
+  for (size_t i = 0; i < sizeof(orphanTypes) / sizeof(orphanTypes[0]); ++i) {
+    futures.push_back(QtConcurrent::run(&threadPool, findOrphans, filePath_,
+                                        orphanTypes[i]));
+  }
+  // Image ids are mostly dense, so equal ranges hold about as many images
+  qint64 span = maxImageId - minImageId + 1;
+  qint64 numShards = std::min<qint64>(span, numThreads * ShardsPerThread);
+  for (qint64 i = 0; i < numShards; ++i) {
+    int first = static_cast<int>(minImageId + span * i / numShards);
+    int last = static_cast<int>(minImageId + span * (i + 1) / numShards - 1);
+    futures.push_back(QtConcurrent::run(&threadPool, checkImages, filePath_,
+                                        first, last));
+  }
+
+  foreach (const QFuture<ShardResult>& future, futures) {
+    ShardResult result = future.result();
+    report.numImages += result.numImages;
+    report.numBBoxes += result.numBBoxes;
+    report.issues += result.issues;
+    if (report.error.isEmpty()) report.error = result.error;
+  }
+  std::sort(report.issues.begin(), report.issues.end(), isBefore);
+  report.elapsed = timer.elapsed();
+  return report;
+}
+
+QString DatasetValidator::getIssueName(IssueType type)
+{
+  switch (type) {
+    case OutOfImage: return "out_of_image";
+    case EmptyBBox: return "empty_bbox";
+    case DuplicateBBox: return "duplicate_bbox";
+    case RepeatedPerson: return "repeated_person";
+    case PersonWithoutBBoxes: return "person_without_bboxes";
+    case BBoxOfMissingImage: return "bbox_of_missing_image";
+    case BBoxOfMissingPerson: return "bbox_of_missing_person";
+    default: return QString();
+  }
+}
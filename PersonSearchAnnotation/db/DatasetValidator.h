@@ -0,0 +1,77 @@
+#ifndef DATASETVALIDATOR_H
+#define DATASETVALIDATOR_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+
+// Consistency checks of a whole database before a release. Images are split
+// into ranges of ids, each read on a thread of its own through a read-only
+// connection, and all the checks of an image are done in one pass over its
+// bboxes. The file must not have writes pending in other connections.
+class DatasetValidator
+{
+public:
+  enum IssueType
+  {
+    OutOfImage,
+    EmptyBBox,
+    // Overlapping another bbox of the image almost entirely
+    DuplicateBBox,
+    // Same person as another bbox of the image
+    RepeatedPerson,
+    PersonWithoutBBoxes,
+    BBoxOfMissingImage,
+    BBoxOfMissingPerson,
+    NumIssueTypes
+  };
+
+  // Ids which do not apply are 0
+  struct Issue
+  {
+    Issue() : type(OutOfImage), imageId(0), personId(0), bboxId(0),
+              otherBBoxId(0) {}
+
+    IssueType type;
+    int imageId;
+    int personId;
+    int bboxId;
+    int otherBBoxId;
+  };
+
+  struct Report
+  {
+    Report() : numImages(0), numBBoxes(0), numThreads(0), elapsed(0) {}
+
+    int getCount(IssueType type) const;
+    QJsonObject toJson() const;
+    bool save(const QString& filePath) const;
+
+    QString filePath;
+    qint64 numImages;
+    // Of the images found, the ones of missing images are issues
+    qint64 numBBoxes;
+    int numThreads;
+    // Milliseconds
+    qint64 elapsed;
+    // Sorted by type and then by ids
+    QVector<Issue> issues;
+    // Why the file could not be read in full, the issues are then partial
+    QString error;
+  };
+
+public:
+  explicit DatasetValidator(const QString& filePath);
+  ~DatasetValidator();
+
+  // Uses as many threads as cores if numThreads is not positive
+  Report run(int numThreads = 0);
+
+  // Name of the type in the JSON report, such as "out_of_image"
+  static QString getIssueName(IssueType type);
+
+private:
+  QString filePath_;
+};
+
+#endif // DATASETVALIDATOR_H
@@ -0,0 +1,62 @@
+#include "db/FolderDictionary.h"
+#include <QSqlQuery>
+#include <QVariant>
+
+void FolderDictionary::clear()
+{
+  folderIds_.clear();
+  folders_.clear();
+  authors_.clear();
+}
+
+int FolderDictionary::findFolderId(const QString& path)
+{
+  QHash<QString, int>::const_iterator it = folderIds_.constFind(path);
+  if (it != folderIds_.constEnd()) return it.value();
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.prepare("SELECT folder_id, author FROM psa_folder WHERE path = ?");
+  query.bindValue(0, path);
+  query.exec();
+  if (!query.next()) return 0;
+  return insert(query.value(0).toInt(), path, query.value(1).toString());
+}
+
+int FolderDictionary::addFolder(const QString& path, const QString& author)
+{
+  int folderId = findFolderId(path);
+  if (folderId > 0) return folderId;
+  // Another connection may have added it in the meantime
+  QSqlQuery query;
+  query.prepare("INSERT OR IGNORE INTO psa_folder(path, author) VALUES(?, ?)");
+  query.bindValue(0, path);
+  query.bindValue(1, author);
+  query.exec();
+  return findFolderId(path);
+}
+
+FolderDictionary::Folder FolderDictionary::getFolder(int folderId)
+{
+  QHash<int, Folder>::const_iterator it = folders_.constFind(folderId);
+  if (it != folders_.constEnd()) return it.value();
+  QSqlQuery query;
+  query.setForwardOnly(true);
+  query.prepare("SELECT path, author FROM psa_folder WHERE folder_id = ?");
+  query.bindValue(0, folderId);
+  query.exec();
+  if (!query.next()) return Folder();
+  insert(folderId, query.value(0).toString(), query.value(1).toString());
+  return folders_.value(folderId);
+}
+
+int FolderDictionary::insert(int folderId, const QString& path,
+                             const QString& author)
+{
+  Folder folder;
+  folder.path = path;
+  // Finds the copy already held, if any
+  folder.author = *authors_.insert(author);
+  folderIds_.insert(path, folderId);
+  folders_.insert(folderId, folder);
+  return folderId;
+}
@@ -0,0 +1,49 @@
+#ifndef FOLDERDICTIONARY_H
+#define FOLDERDICTIONARY_H
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+
+// Rows of psa_folder cached by id and by path. Folder paths end with a slash,
+// the images root being the empty string. The strings handed out are shared
+// by all the images of a folder, and authors by all the folders of an author.
+// Folders are never removed, so the cache stays valid while other
+// connections add theirs.
+class FolderDictionary
+{
+public:
+  struct Folder
+  {
+    QString path;
+    QString author;
+  };
+
+public:
+  FolderDictionary() {}
+  ~FolderDictionary() {}
+
+  // Must be called when the connection changes, or when a transaction which
+  // added folders is rolled back
+  void clear();
+
+  // Returns 0 if there is no such folder
+  int findFolderId(const QString& path);
+  // Adds the folder if missing. The author is the one it was first added with.
+  int addFolder(const QString& path, const QString& author);
+  // Null strings if there is no such folder
+  Folder getFolder(int folderId);
+
+private:
+  FolderDictionary(const FolderDictionary&);
+  const FolderDictionary& operator = (const FolderDictionary&);
+
+  int insert(int folderId, const QString& path, const QString& author);
+
+private:
+  QHash<QString, int> folderIds_;
+  QHash<int, Folder> folders_;
+  QSet<QString> authors_;
+};
+
+#endif // FOLDERDICTIONARY_H
@@ -0,0 +1,56 @@
+#include "gui/CropList.h"
+#include <QPixmap>
+
+static const QSize IconSize(80, 160);
+static const int ItemSpacing = 4;
+
+CropList::CropList(QWidget* parent)
+  : QListWidget(parent)
+{
+  setViewMode(QListView::IconMode);
+  setIconSize(IconSize);
+  setResizeMode(QListView::Adjust);
+  setMovement(QListView::Static);
+  setUniformItemSizes(true);
+  setSpacing(ItemSpacing);
+
+  connect(&cropCache_, &CropCache::cropLoaded, this, &CropList::cropLoaded);
+}
+
+void CropList::reset()
+{
+  cropCache_.cancel();
+  clear();
+  items_.clear();
+}
+
+void CropList::setPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
+                               const QHash<int, ImageFile>& imageFiles,
+                               const QStringList& texts)
+{
+  reset();
+  // Empty items keep the layout still while the crops come in
+  QPixmap placeholder(IconSize);
+  placeholder.fill(Qt::lightGray);
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    const PersonBBox& personBBox = personBBoxes[i];
+    QListWidgetItem* item = new QListWidgetItem(QIcon(placeholder),
+                                                texts.value(i));
+    item->setData(Qt::UserRole, i);
+    item->setToolTip(imageFiles.value(personBBox.getImageId()).getPath());
+    addItem(item);
+    items_.insert(personBBox.getBBoxId(), item);
+  }
+  cropCache_.request(personBBoxes, imageFiles);
+}
+
+bool CropList::containsBBox(int bboxId) const
+{
+  return items_.contains(bboxId);
+}
+
+void CropList::cropLoaded(int bboxId, const QImage& crop)
+{
+  QListWidgetItem* item = items_.value(bboxId);
+  if (item) item->setIcon(QIcon(QPixmap::fromImage(crop)));
+}
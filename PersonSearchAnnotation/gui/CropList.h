@@ -0,0 +1,39 @@
+#ifndef CROPLIST_H
+#define CROPLIST_H
+
+#include "common/ImageFile.hpp"
+#include "common/PersonBBox.hpp"
+#include "utils/CropCache.h"
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QListWidget>
+
+// Thumbnails of bboxes in a grid, gray until their crops are made
+class CropList : public QListWidget
+{
+  Q_OBJECT
+
+public:
+  explicit CropList(QWidget* parent = 0);
+
+  void reset();
+
+  // One item per bbox, in order, labeled with texts if given. Item i holds
+  // i as its Qt::UserRole data.
+  void setPersonBBoxes(const QVector<PersonBBox>& personBBoxes,
+                       const QHash<int, ImageFile>& imageFiles,
+                       const QStringList& texts = QStringList());
+  bool containsBBox(int bboxId) const;
+
+private slots:
+  void cropLoaded(int bboxId, const QImage& crop);
+
+private:
+  CropCache cropCache_;
+
+  // Items by bbox id
+  QHash<int, QListWidgetItem*> items_;
+};
+
+#endif // CROPLIST_H
@@ -0,0 +1,155 @@
+#include "gui/GalleryModel.h"
+#include <algorithm>
+
+static const int PageSize = 256;
+static const int MaxPages = 64;
+
+GalleryModel::GalleryModel(DatabaseWorker* databaseWorker, QObject* parent)
+  : QAbstractListModel(parent),
+    databaseWorker_(databaseWorker),
+    serial_(0)
+{
+  pages_.setMaxCost(MaxPages);
+  fetchTimer_.setSingleShot(true);
+  fetchTimer_.setInterval(0);
+  connect(&fetchTimer_, &QTimer::timeout,
+          this, &GalleryModel::fetchMissedPages);
+  connect(&thumbnailCache_, &ThumbnailCache::thumbnailLoaded,
+          this, &GalleryModel::thumbnailLoaded);
+}
+
+void GalleryModel::reset()
+{
+  setImageIds(QVector<int>());
+}
+
+void GalleryModel::setImageIds(const QVector<int>& imageIds)
+{
+  beginResetModel();
+  imageIds_ = imageIds;
+  pages_.clear();
+  fetchingPages_.clear();
+  missedPages_.clear();
+  thumbnailRows_.clear();
+  thumbnailCache_.clear();
+  ++serial_;
+  endResetModel();
+}
+
+int GalleryModel::rowCount(const QModelIndex& parent) const
+{
+  return parent.isValid() ? 0 : imageIds_.size();
+}
+
+QVariant GalleryModel::data(const QModelIndex& index, int role) const
+{
+  int row = index.row();
+  if (!index.isValid() || row >= imageIds_.size()) return QVariant();
+  if (role == Qt::DisplayRole) return QString::number(row + 1);
+  if (role == Qt::SizeHintRole) {
+    // Uniform sizes, whether the thumbnail is there or not
+    return ThumbnailCache::ThumbnailSize + QSize(8, 24);
+  }
+  if (role != Qt::DecorationRole && role != Qt::ToolTipRole) {
+    return QVariant();
+  }
+
+  // Views only ask for the visible rows, whose pages are missed at most
+  // once before dataChanged
+  ImageFile imageFile = getImageFile(row);
+  if (imageFile.isNull()) {
+    missedPages_.insert(row / PageSize);
+    fetchTimer_.start();
+    return QVariant();
+  }
+  if (role == Qt::ToolTipRole) return imageFile.getPath();
+  QImage thumbnail = thumbnailCache_.getThumbnail(imageFile);
+  if (thumbnail.isNull()) {
+    thumbnailRows_.insert(imageFile.getImageId(), row);
+  }
+  return thumbnail;
+}
+
+bool GalleryModel::canFetchMore(const QModelIndex& parent) const
+{
+  return !parent.isValid() && !missedPages_.isEmpty();
+}
+
+void GalleryModel::fetchMore(const QModelIndex& parent)
+{
+  if (parent.isValid()) return;
+  QSet<int> missedPages;
+  missedPages.swap(missedPages_);
+  foreach (int page, missedPages) {
+    fetch(page * PageSize);
+  }
+}
+
+int GalleryModel::getImageId(int row) const
+{
+  return imageIds_[row];
+}
+
+int GalleryModel::findRow(int imageId) const
+{
+  return imageIds_.indexOf(imageId);
+}
+
+bool GalleryModel::isFetched(int row) const
+{
+  return pages_.contains(row / PageSize);
+}
+
+ImageFile GalleryModel::getImageFile(int row) const
+{
+  const QVector<ImageFile>* page = pages_.object(row / PageSize);
+  if (!page) return ImageFile();
+  return (*page)[row % PageSize];
+}
+
+void GalleryModel::fetch(int row)
+{
+  int page = row / PageSize;
+  if (pages_.contains(page) || fetchingPages_.contains(page)) return;
+  fetchingPages_.insert(page);
+  QVector<int> imageIds = imageIds_.mid(page * PageSize, PageSize);
+  int serial = serial_;
+  databaseWorker_->query([imageIds](DatabaseHelper* databaseHelper) {
+    return databaseHelper->getImageFilesByIds(imageIds);
+  }, this, [this, serial, page](const QHash<int, ImageFile>& imageFiles) {
+    if (serial != serial_) return;
+    pageFetched(page, imageFiles);
+  });
+}
+
+void GalleryModel::thumbnailLoaded(int imageId, const QImage& /* thumbnail */)
+{
+  QHash<int, int>::iterator it = thumbnailRows_.find(imageId);
+  if (it == thumbnailRows_.end()) return;
+  QModelIndex index = this->index(it.value());
+  thumbnailRows_.erase(it);
+  emit dataChanged(index, index, QVector<int>() << Qt::DecorationRole);
+}
+
+void GalleryModel::fetchMissedPages()
+{
+  if (canFetchMore(QModelIndex())) fetchMore(QModelIndex());
+}
+
+void GalleryModel::pageFetched(int page,
+                               const QHash<int, ImageFile>& imageFiles)
+{
+  fetchingPages_.remove(page);
+  int first = page * PageSize;
+  int last = std::min(first + PageSize, imageIds_.size()) - 1;
+  QVector<ImageFile>* rows = new QVector<ImageFile>(last - first + 1);
+  for (int row = first; row <= last; ++row) {
+    ImageFile imageFile = imageFiles.value(imageIds_[row]);
+    // Removed from the database meanwhile, shown without its file
+    if (imageFile.isNull()) imageFile.setImageId(imageIds_[row]);
+    (*rows)[row - first] = imageFile;
+  }
+  pages_.insert(page, rows);
+  emit dataChanged(this->index(first), this->index(last));
+  emit rowsFetched(first, last);
+}
@@ -0,0 +1,72 @@
+#ifndef GALLERYMODEL_H
+#define GALLERYMODEL_H
+
+#include "common/ImageFile.hpp"
+#include "db/DatabaseWorker.h"
+#include "utils/ThumbnailCache.h"
+#include <QHash>
+#include <QSet>
+#include <QCache>
+#include <QVector>
+#include <QTimer>
+#include <QAbstractListModel>
+
+// The images of the opened folder, shared by the navigators and the
+// filmstrip. Only the image ids are held; the rows are fetched from the
+// database in pages when first needed, and only a bounded number of pages
+// is kept. data() only notes the pages it misses, fetchMore fetches them.
+class GalleryModel : public QAbstractListModel
+{
+  Q_OBJECT
+
+public:
+  explicit GalleryModel(DatabaseWorker* databaseWorker, QObject* parent = 0);
+
+  void reset();
+  void setImageIds(const QVector<int>& imageIds);
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+  // True while pages asked for by data() are waiting to be fetched. Called
+  // back from the event loop if the views do not.
+  bool canFetchMore(const QModelIndex& parent) const;
+  void fetchMore(const QModelIndex& parent);
+
+  int getImageId(int row) const;
+  // Returns -1 if the image is not in the gallery
+  int findRow(int imageId) const;
+
+  bool isFetched(int row) const;
+  // Null if the page of the row is not fetched
+  ImageFile getImageFile(int row) const;
+  // Fetches the page of the row in background and emits rowsFetched
+  void fetch(int row);
+
+signals:
+  void rowsFetched(int first, int last);
+
+private slots:
+  void thumbnailLoaded(int imageId, const QImage& thumbnail);
+  void fetchMissedPages();
+
+private:
+  void pageFetched(int page, const QHash<int, ImageFile>& imageFiles);
+
+private:
+  DatabaseWorker* databaseWorker_;
+  // Requested by data() as the views ask for the rows
+  mutable ThumbnailCache thumbnailCache_;
+
+  QVector<int> imageIds_;
+  // Pages of rows, by page index
+  QCache<int, QVector<ImageFile> > pages_;
+  QSet<int> fetchingPages_;
+  mutable QSet<int> missedPages_;
+  mutable QTimer fetchTimer_;
+  // Bumped by every new list, so that late pages of an old one are dropped
+  int serial_;
+  // Rows waiting for their thumbnails, by image id
+  mutable QHash<int, int> thumbnailRows_;
+};
+
+#endif // GALLERYMODEL_H
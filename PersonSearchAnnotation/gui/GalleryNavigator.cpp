@@ -7,29 +7,32 @@
 
 GalleryNavigator::GalleryNavigator(QWidget* parent)
   : QWidget(parent),
-    currentIndex_(-1)
+    model_(NULL),
+    currentIndex_(-1),
+    pendingIndex_(-1)
 {
   createPanels();
 }
 
-void GalleryNavigator::reset()
+GalleryModel* GalleryNavigator::getModel() const
 {
-  currentIndex_ = -1;
-  imageFiles_.clear();
-  jumpToEdit_->setText("");
-  infoLabel_->setText("");
+  return model_;
 }
 
-QVector<ImageFile> GalleryNavigator::getImageFiles() const
+void GalleryNavigator::setModel(GalleryModel* model)
 {
-  return imageFiles_;
+  if (model_) model_->disconnect(this);
+  model_ = model;
+  connect(model_, &GalleryModel::modelReset,
+          this, &GalleryNavigator::modelReset);
+  connect(model_, &GalleryModel::rowsFetched,
+          this, &GalleryNavigator::rowsFetched);
+  modelReset();
 }
 
-void GalleryNavigator::setImageFiles(const QVector<ImageFile>& imageFiles)
+int GalleryNavigator::getImageCount() const
 {
-  imageFiles_ = imageFiles;
-  currentIndex_ = 0;
-  updateInfo();
+  return model_ ? model_->rowCount() : 0;
 }
 
 int GalleryNavigator::getCurrentIndex() const
@@ -37,14 +40,9 @@ int GalleryNavigator::getCurrentIndex() const
   return currentIndex_;
 }
 
-ImageFile GalleryNavigator::getCurrentImageFile() const
-{
-  return imageFiles_[currentIndex_];
-}
-
 void GalleryNavigator::navigate(int index)
 {
-  if (index < 0 || index >= static_cast<int>(imageFiles_.size())) {
+  if (index < 0 || index >= getImageCount()) {
     QMessageBox::critical(this, tr("无法跳转"),
                           tr("错误的图片序号"),
                           QMessageBox::Ok);
@@ -52,7 +50,33 @@ void GalleryNavigator::navigate(int index)
   }
   currentIndex_ = index;
   updateInfo();
-  emit navigateTo(currentIndex_, imageFiles_[currentIndex_]);
+  if (!model_->isFetched(index)) {
+    pendingIndex_ = index;
+    model_->fetch(index);
+    return;
+  }
+  pendingIndex_ = -1;
+  emit navigateTo(currentIndex_, model_->getImageFile(currentIndex_));
+}
+
+void GalleryNavigator::modelReset()
+{
+  pendingIndex_ = -1;
+  if (getImageCount() == 0) {
+    currentIndex_ = -1;
+    jumpToEdit_->setText("");
+    infoLabel_->setText("");
+    return;
+  }
+  currentIndex_ = 0;
+  updateInfo();
+}
+
+void GalleryNavigator::rowsFetched(int first, int last)
+{
+  if (pendingIndex_ < first || pendingIndex_ > last) return;
+  pendingIndex_ = -1;
+  emit navigateTo(currentIndex_, model_->getImageFile(currentIndex_));
 }
 
 void GalleryNavigator::jump()
@@ -104,5 +128,5 @@ void GalleryNavigator::createPanels()
 void GalleryNavigator::updateInfo()
 {
   jumpToEdit_->setText(QString::number(currentIndex_ + 1));
-  infoLabel_->setText(QString(" / %1").arg(imageFiles_.size()));
+  infoLabel_->setText(QString(" / %1").arg(getImageCount()));
 }
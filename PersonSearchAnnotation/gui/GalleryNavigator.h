@@ -2,9 +2,8 @@
 #define GALLERYNAVIGATOR_H
 
 #include "common/ImageFile.hpp"
-#include <QVector>
+#include "gui/GalleryModel.h"
 #include <QWidget>
-#include <QStringList>
 
 class QLineEdit;
 class QLabel;
@@ -16,22 +15,26 @@ class GalleryNavigator : public QWidget
 public:
   explicit GalleryNavigator(QWidget* parent = 0);
 
-  void reset();
-
-  QVector<ImageFile> getImageFiles() const;
-  void setImageFiles(const QVector<ImageFile>& imageFiles);
+  // Shared with the other navigators, not owned
+  GalleryModel* getModel() const;
+  void setModel(GalleryModel* model);
 
+  int getImageCount() const;
   int getCurrentIndex() const;
-  ImageFile getCurrentImageFile() const;
 
 public slots:
   void jump();
   void next();
   void prev();
+  // Emits navigateTo once the row is fetched
   void navigate(int index);
 
 signals:
-  void navigateTo(int index, ImageFile imageFile);
+  void navigateTo(int index, const ImageFile& imageFile);
+
+private slots:
+  void modelReset();
+  void rowsFetched(int first, int last);
 
 private:
   void createPanels();
@@ -41,8 +44,10 @@ private:
   QLineEdit* jumpToEdit_;
   QLabel* infoLabel_;
 
-  QVector<ImageFile> imageFiles_;
+  GalleryModel* model_;
   int currentIndex_;
+  // Waiting for its row, -1 if none
+  int pendingIndex_;
 };
 
 #endif // GALLERYNAVIGATOR_H
@@ -1,10 +1,12 @@
 #include "gui/ImageArea.h"
 #include "utils/util_functions.h"
+#include "utils/Trace.h"
 #include <cmath>
 #include <algorithm>
 #include <QWheelEvent>
 #include <QMouseEvent>
 #include <QGraphicsItem>
+#include <QtConcurrent>
 #include <QDebug>
 
 using namespace psa;
@@ -36,11 +38,17 @@ static const int NumPresetColors = 10;
 static const int PersonIdRectWidth = 100;
 static const int PersonIdRectHeight = 50;
 
+// Upscaling of the decoded image which is still not noticeable
+static const qreal MaxUpscale = 1.2;
+
 ImageArea::ImageArea(QWidget* parent)
   : QGraphicsView(parent),
     permissionFlags_(AllowSelection),
     mode_(ModeSelection),
+    renderMode_(RenderModeCached),
     state_(StateIdleForSelection),
+    imageId_(-1),
+    fullResolutionRequested_(false),
     needClearSelection_(false),
     horizontalRuler_(NULL),
     verticalRuler_(NULL)
@@ -49,7 +57,6 @@ ImageArea::ImageArea(QWidget* parent)
   scene->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
 
   setScene(scene);
-  setViewportUpdateMode(FullViewportUpdate);
   setRenderHint(QPainter::Antialiasing);
   setTransformationAnchor(AnchorUnderMouse);
 
@@ -57,7 +64,10 @@ ImageArea::ImageArea(QWidget* parent)
 
   connect(this->scene(), &QGraphicsScene::selectionChanged,
           this, &ImageArea::rectItemsSelectionChanged);
+  connect(&tilePyramidWatcher_, &QFutureWatcher<TilePyramid>::finished,
+          this, &ImageArea::tilePyramidBuilt);
   updateBehaviors();
+  updateRendering();
 }
 
 void ImageArea::reset()
@@ -67,11 +77,14 @@ void ImageArea::reset()
   needClearSelection_ = false;
   image_ = QImage();
   imageId_ = -1;
+  fullResolutionRequested_ = false;
+  tilePyramid_ = TilePyramid();
   personBBoxes_.clear();
   removedMarks_.clear();
+  dirtyMarks_.clear();
   updateBehaviors();
-  scene()->clear();
-  viewport()->update();
+  clearScene();
+  invalidateBackground();
 }
 
 ImageArea::PermissionFlags ImageArea::getPermissionFlags() const
@@ -116,22 +129,78 @@ void ImageArea::setMode(Mode mode)
   updateBehaviors();
 }
 
-void ImageArea::setImage(const QImage& image, int imageId)
+ImageArea::RenderMode ImageArea::getRenderMode() const
 {
-  image_ = image;
+  return renderMode_;
+}
+
+void ImageArea::setRenderMode(RenderMode renderMode)
+{
+  renderMode_ = renderMode;
+  updateRendering();
+}
+
+void ImageArea::prepareImage(const QSize& size, int imageId)
+{
+  PSA_TRACE_SCOPE("ImageArea::prepareImage");
+  image_ = QImage();
   imageId_ = imageId;
+  fullResolutionRequested_ = false;
+  tilePyramid_ = TilePyramid();
 
-  qreal w = static_cast<qreal>(image.width());
-  qreal h = static_cast<qreal>(image.height());
+  qreal w = static_cast<qreal>(size.width());
+  qreal h = static_cast<qreal>(size.height());
 
   scene()->setSceneRect(-w / 2, -h / 2, w, h);
-  scene()->clear();
+  clearScene();
 
   qreal bestScaleFactor = std::min((width() - 10) / w, (height() - 10) / h);
   resetTransform();
   scale(bestScaleFactor, bestScaleFactor);
 
-  viewport()->update();
+  invalidateBackground();
+}
+
+void ImageArea::setImage(const QImage& image, int imageId)
+{
+  PSA_TRACE_SCOPE("ImageArea::setImage");
+  // Keep the boxes and the zoom if the scene was prepared for this image
+  if (imageId != imageId_) {
+    prepareImage(image.size(), imageId);
+  }
+  // Ask again once more detail arrives, in case the request was dropped
+  // while a smaller decode was running
+  if (image.width() > image_.width()) fullResolutionRequested_ = false;
+  image_ = image;
+
+  // Paint the full image until the pyramid is ready
+  tilePyramid_ = TilePyramid();
+  if (!image.isNull()) {
+    tilePyramidWatcher_.setFuture(QtConcurrent::run(&TilePyramid::build, image));
+  }
+
+  invalidateBackground();
+  checkResolution();
+}
+
+int ImageArea::getImageId() const
+{
+  return imageId_;
+}
+
+bool ImageArea::hasImage() const
+{
+  return !image_.isNull();
+}
+
+QImage ImageArea::getImage() const
+{
+  return image_;
+}
+
+bool ImageArea::hasFullResolution() const
+{
+  return image_.width() >= sceneRect().width();
 }
 
 PersonBBox ImageArea::getSelectedPersonBBox() const
@@ -154,17 +223,53 @@ QVector<bool> ImageArea::getRemovedMarks() const
   return removedMarks_;
 }
 
+QVector<bool> ImageArea::getDirtyMarks() const
+{
+  return dirtyMarks_;
+}
+
+void ImageArea::markPersonBBoxesSaved(const QVector<PersonBBox>& personBBoxes)
+{
+  for (int i = 0; i < personBBoxes.size() && i < personBBoxes_.size(); ++i) {
+    PersonBBox& personBBox = personBBoxes_[i];
+    int personId = personBBox.getPersonId();
+    // New bboxes got their ids, as well as new persons
+    personBBox.setBBoxId(personBBoxes[i].getBBoxId());
+    personBBox.setPersonId(personBBoxes[i].getPersonId());
+    dirtyMarks_[i] = false;
+    if (personId != personBBox.getPersonId() && !removedMarks_[i]) {
+      updatePersonIdLabel(i);
+    }
+  }
+}
+
+void ImageArea::resolveProvisionalIds(
+    const QHash<int, PersonBBox>& savedPersonBBoxes)
+{
+  for (int i = 0; i < personBBoxes_.size(); ++i) {
+    PersonBBox& personBBox = personBBoxes_[i];
+    if (personBBox.getBBoxId() >= -1) continue;
+    QHash<int, PersonBBox>::const_iterator it =
+        savedPersonBBoxes.constFind(personBBox.getBBoxId());
+    if (it == savedPersonBBoxes.constEnd()) continue;
+    personBBox.setBBoxId(it->getBBoxId());
+    // Keep the person id if relabeled in the meantime
+    if (personBBox.getPersonId() > 0) continue;
+    personBBox.setPersonId(it->getPersonId());
+    if (!removedMarks_[i]) updatePersonIdLabel(i);
+  }
+}
+
 void ImageArea::setPersonBBoxes(const QVector<PersonBBox>& personBBoxes)
 {
-  scene()->clear();
+  PSA_TRACE_SCOPE("ImageArea::setPersonBBoxes");
+  clearScene();
   for (int i = 0; i < personBBoxes.size(); ++i) {
     drawPersonBBox(personBBoxes[i], i);
   }
   personBBoxes_ = personBBoxes;
-  removedMarks_.resize(personBBoxes_.size());
-  for (int i = 0; i < removedMarks_.size(); ++i) {
-    removedMarks_[i] = false;
-  }
+  removedMarks_.fill(false, personBBoxes_.size());
+  dirtyMarks_.fill(false, personBBoxes_.size());
   if (permissionFlags_.testFlag(AllowAnnotation)) {
     horizontalRuler_ = scene()->addLine(
         -scene()->width() / 2, 0, scene()->width() / 2, 0,
@@ -185,17 +290,23 @@ void ImageArea::setPersonIdOfSelectedBBox(int personId)
   for (int i = 0; i < scene()->selectedItems().size(); ++i) {
     QGraphicsRectItem* bbox = dynamic_cast<QGraphicsRectItem*>(
         scene()->selectedItems().at(i));
-    int index = bbox->data(BBoxIndex).toInt();
-    // Update data
-    PersonBBox& personBBox = personBBoxes_[index];
-    personBBox.setPersonId(personId);
-    // Update drawing
-    QColor color = PresetColors[personId % NumPresetColors];
-    bbox->setPen(QPen(color, 8, Qt::SolidLine));
-    getPersonIdRectItem(index)->setPen(QPen(color, 0, Qt::SolidLine));
-    getPersonIdRectItem(index)->setBrush(QBrush(color));
-    getPersonIdTextItem(index)->setText(QString::number(personId));
+    setPersonIdOfBBox(bbox->data(BBoxIndex).toInt(), personId);
+  }
+}
+
+bool ImageArea::setPersonIdOfBBox(int index, int personId)
+{
+  if (index < 0 || index >= personBBoxes_.size() || removedMarks_[index]) {
+    return false;
   }
+  // Update data
+  PersonBBox& personBBox = personBBoxes_[index];
+  if (personBBox.getPersonId() == personId) return true;
+  personBBox.setPersonId(personId);
+  dirtyMarks_[index] = true;
+  // Update drawing
+  updatePersonIdLabel(index);
+  return true;
 }
 
 void ImageArea::toggleHard()
@@ -204,13 +315,8 @@ void ImageArea::toggleHard()
     int index = item->data(BBoxIndex).toInt();
     PersonBBox& personBBox = personBBoxes_[index];
     personBBox.setHard(!personBBox.isHard());
-    if (personBBox.isHard()) {
-      getPersonIdTextItem(index)->setText(
-          QString::number(personBBox.getPersonId()) + "*");
-    } else {
-      getPersonIdTextItem(index)->setText(
-          QString::number(personBBox.getPersonId()));
-    }
+    dirtyMarks_[index] = true;
+    updatePersonIdLabel(index);
   }
 }
 
@@ -230,10 +336,26 @@ void ImageArea::wheelEvent(QWheelEvent* event)
   scaleView(pow(2.0, event->delta() / 240.0));
 }
 
-void ImageArea::drawBackground(QPainter* painter, const QRectF& /* rect */)
+void ImageArea::paintEvent(QPaintEvent* event)
 {
+  {
+    PSA_TRACE_SCOPE("ImageArea::paintEvent");
+    QGraphicsView::paintEvent(event);
+  }
+  if (Trace::isEnabled()) emit painted();
+}
+
+void ImageArea::drawBackground(QPainter* painter, const QRectF& rect)
+{
+  PSA_TRACE_SCOPE("ImageArea::drawBackground");
   QRectF sceneRect = this->sceneRect();
-  if (!image_.isNull()) {
+  if (!tilePyramid_.isNull()) {
+    // Device pixels per pixel of the decoded image
+    qreal scale = transform().mapRect(QRectF(0, 0, 1, 1)).width() *
+                  viewport()->devicePixelRatio() *
+                  sceneRect.width() / image_.width();
+    tilePyramid_.draw(painter, sceneRect, rect, scale);
+  } else if (!image_.isNull()) {
     painter->drawImage(sceneRect, image_);
   }
 }
@@ -331,6 +453,7 @@ void ImageArea::mousePressEvent(QMouseEvent* event)
         int index = addPersonBBox(x, y, width, height);
         drawPersonBBox(personBBoxes_[index], index);
         state_ = StateIdleForAnnotation;
+        emit personBBoxDrawn(index);
         break;
       }
       default:
@@ -406,13 +529,15 @@ void ImageArea::mouseMoveEvent(QMouseEvent* event)
     }
   } else if (mode_ == ModeAnnotationByDragDrop) {
     QPointF movingPoint = mapToScene(event->pos());
-    // Move the rulers
-    if (!horizontalRuler_->isVisible()) horizontalRuler_->setVisible(true);
-    if (!verticalRuler_->isVisible()) verticalRuler_->setVisible(true);
-    horizontalRuler_->setLine(-scene()->width() / 2.0, movingPoint.y(),
-                              scene()->width() / 2.0, movingPoint.y());
-    verticalRuler_->setLine(movingPoint.x(), -scene()->height() / 2.0,
-                            movingPoint.x(), scene()->height() / 2.0);
+    // Move the rulers, missing until the bboxes are loaded
+    if (horizontalRuler_ && verticalRuler_) {
+      if (!horizontalRuler_->isVisible()) horizontalRuler_->setVisible(true);
+      if (!verticalRuler_->isVisible()) verticalRuler_->setVisible(true);
+      horizontalRuler_->setLine(-scene()->width() / 2.0, movingPoint.y(),
+                                scene()->width() / 2.0, movingPoint.y());
+      verticalRuler_->setLine(movingPoint.x(), -scene()->height() / 2.0,
+                              movingPoint.x(), scene()->height() / 2.0);
+    }
     switch(state_) {
       case StateDragging:
       {
@@ -457,6 +582,7 @@ void ImageArea::mouseReleaseEvent(QMouseEvent* event)
     int index = addPersonBBox(x, y, width, height);
     drawPersonBBox(personBBoxes_[index], index);
     state_ = StateIdleForAnnotation;
+    emit personBBoxDrawn(index);
     return;
   } else {
     QGraphicsView::mouseReleaseEvent(event);
@@ -492,48 +618,16 @@ void ImageArea::keyPressEvent(QKeyEvent* event)
       break;
     }
     case Qt::Key_Left:
-      if (permissionFlags_.testFlag(AllowMoving)) {
-        for (int i = 0; i < scene()->selectedItems().size(); ++i) {
-          QGraphicsRectItem* bbox = dynamic_cast<QGraphicsRectItem*>(
-              scene()->selectedItems().at(i));
-          bbox->setPos(bbox->pos().x() - delta.x(), bbox->pos().y());
-          updatePersonIdPos(bbox);
-        }
-      }
-      syncSelectedPersonBBox();
+      moveSelectedPersonBBoxes(-delta.x(), 0);
       break;
     case Qt::Key_Right:
-      if (permissionFlags_.testFlag(AllowMoving)) {
-        for (int i = 0; i < scene()->selectedItems().size(); ++i) {
-          QGraphicsRectItem* bbox = dynamic_cast<QGraphicsRectItem*>(
-              scene()->selectedItems().at(i));
-          bbox->setPos(bbox->pos().x() + delta.x(), bbox->pos().y());
-          updatePersonIdPos(bbox);
-        }
-      }
-      syncSelectedPersonBBox();
+      moveSelectedPersonBBoxes(delta.x(), 0);
       break;
     case Qt::Key_Up:
-      if (permissionFlags_.testFlag(AllowMoving)) {
-        for (int i = 0; i < scene()->selectedItems().size(); ++i) {
-          QGraphicsRectItem* bbox = dynamic_cast<QGraphicsRectItem*>(
-              scene()->selectedItems().at(i));
-          bbox->setPos(bbox->pos().x(), bbox->pos().y() - delta.y());
-          updatePersonIdPos(bbox);
-        }
-      }
-      syncSelectedPersonBBox();
+      moveSelectedPersonBBoxes(0, -delta.y());
       break;
     case Qt::Key_Down:
-      if (permissionFlags_.testFlag(AllowMoving)) {
-        for (int i = 0; i < scene()->selectedItems().size(); ++i) {
-          QGraphicsRectItem* bbox = dynamic_cast<QGraphicsRectItem*>(
-              scene()->selectedItems().at(i));
-          bbox->setPos(bbox->pos().x(), bbox->pos().y() + delta.y());
-          updatePersonIdPos(bbox);
-        }
-      }
-      syncSelectedPersonBBox();
+      moveSelectedPersonBBoxes(0, delta.y());
       break;
     case Qt::Key_Delete:
     case Qt::Key_Backspace:
@@ -541,14 +635,8 @@ void ImageArea::keyPressEvent(QKeyEvent* event)
         foreach (QGraphicsItem* bbox, scene()->selectedItems()) {
           int index = bbox->data(BBoxIndex).toInt();
           removedMarks_[index] = true;
-          QGraphicsItem* personIdRect = getPersonIdRectItem(index);
-          QGraphicsItem* personIdText = getPersonIdTextItem(index);
-          scene()->removeItem(bbox);
-          scene()->removeItem(personIdRect);
-          scene()->removeItem(personIdText);
-          delete bbox;
-          delete personIdRect;
-          delete personIdText;
+          dirtyMarks_[index] = true;
+          erasePersonBBox(index);
         }
       }
       break;
@@ -572,6 +660,17 @@ void ImageArea::rectItemsSelectionChanged()
   }
 }
 
+void ImageArea::tilePyramidBuilt()
+{
+  TilePyramid tilePyramid = tilePyramidWatcher_.result();
+  // Discard pyramids of the images which are not shown anymore
+  if (image_.isNull() || tilePyramid.getCacheKey() != image_.cacheKey()) {
+    return;
+  }
+  tilePyramid_ = tilePyramid;
+  invalidateBackground();
+}
+
 void ImageArea::updateBehaviors()
 {
   if (mode_ == ModeSelection && permissionFlags_.testFlag(AllowSelection)) {
@@ -593,12 +692,56 @@ void ImageArea::updateBehaviors()
   }
 }
 
+void ImageArea::updateRendering()
+{
+  if (renderMode_ == RenderModeCached) {
+    // Keep the painted background as a device pixmap and only repaint the
+    // regions touched by the moving items.
+    setCacheMode(CacheBackground);
+    setViewportUpdateMode(MinimalViewportUpdate);
+    setOptimizationFlag(DontSavePainterState, true);
+  } else {
+    setCacheMode(CacheNone);
+    setViewportUpdateMode(FullViewportUpdate);
+    setOptimizationFlag(DontSavePainterState, false);
+  }
+  QGraphicsItem::CacheMode itemCacheMode =
+      renderMode_ == RenderModeCached ? QGraphicsItem::DeviceCoordinateCache :
+                                        QGraphicsItem::NoCache;
+  foreach (QGraphicsItem* item, scene()->items()) {
+    if (item->data(ItemType).toInt() == PersonIdTextItem) {
+      item->setCacheMode(itemCacheMode);
+    }
+  }
+  invalidateBackground();
+}
+
+void ImageArea::invalidateBackground()
+{
+  resetCachedContent();
+  viewport()->update();
+}
+
 void ImageArea::scaleView(qreal scaleFactor)
 {
   qreal factor = transform().scale(scaleFactor, scaleFactor).mapRect(
         QRectF(0, 0, 1, 1)).width();
   if (factor < 0.07 || factor > 20) return;
   scale(scaleFactor, scaleFactor);
+  checkResolution();
+}
+
+void ImageArea::checkResolution()
+{
+  if (image_.isNull() || hasFullResolution() || fullResolutionRequested_) {
+    return;
+  }
+  qreal scale = transform().mapRect(QRectF(0, 0, 1, 1)).width() *
+                viewport()->devicePixelRatio() *
+                sceneRect().width() / image_.width();
+  if (scale <= MaxUpscale) return;
+  fullResolutionRequested_ = true;
+  emit fullResolutionNeeded(imageId_);
 }
 
 void ImageArea::removeHeadMark()
@@ -609,8 +752,8 @@ void ImageArea::removeHeadMark()
 
 void ImageArea::removeRulers()
 {
-  horizontalRuler_->setVisible(false);
-  verticalRuler_->setVisible(false);
+  if (horizontalRuler_) horizontalRuler_->setVisible(false);
+  if (verticalRuler_) verticalRuler_->setVisible(false);
 }
 
 ImageArea::CornerType ImageArea::atCorner(const QRectF& rect,
@@ -626,35 +769,17 @@ ImageArea::CornerType ImageArea::atCorner(const QRectF& rect,
 
 QGraphicsRectItem* ImageArea::getPersonBBoxItem(int index)
 {
-  foreach (QGraphicsItem* item, scene()->items()) {
-    if (item->data(BBoxIndex).toInt() == index &&
-        item->data(ItemType).toInt() == PersonBBoxItem) {
-      return dynamic_cast<QGraphicsRectItem*>(item);
-    }
-  }
-  return NULL;
+  return personBBoxItems_[index].bbox;
 }
 
 QGraphicsRectItem* ImageArea::getPersonIdRectItem(int index)
 {
-  foreach (QGraphicsItem* item, scene()->items()) {
-    if (item->data(BBoxIndex).toInt() == index &&
-        item->data(ItemType).toInt() == PersonIdRectItem) {
-      return dynamic_cast<QGraphicsRectItem*>(item);
-    }
-  }
-  return NULL;
+  return personBBoxItems_[index].personIdRect;
 }
 
 QGraphicsSimpleTextItem* ImageArea::getPersonIdTextItem(int index)
 {
-  foreach (QGraphicsItem* item, scene()->items()) {
-    if (item->data(BBoxIndex).toInt() == index &&
-        item->data(ItemType).toInt() == PersonIdTextItem) {
-      return dynamic_cast<QGraphicsSimpleTextItem*>(item);
-    }
-  }
-  return NULL;
+  return personBBoxItems_[index].personIdText;
 }
 
 int ImageArea::addPersonBBox(qreal x, qreal y, qreal width, qreal height)
@@ -667,6 +792,7 @@ int ImageArea::addPersonBBox(qreal x, qreal y, qreal width, qreal height)
   personBBox.setHard(false);
   personBBoxes_.push_back(personBBox);
   removedMarks_.push_back(false);
+  dirtyMarks_.push_back(true);
   return personBBoxes_.size() - 1;
 }
 
@@ -701,18 +827,76 @@ void ImageArea::drawPersonBBox(const PersonBBox& personBBox, int index)
       text, QFont("Arial", 42, QFont::Bold));
   personIdText->setPos(rect.x() + 10, rect.y() - PersonIdRectHeight - 3);
   personIdText->setBrush(QBrush(Qt::white));
+  if (renderMode_ == RenderModeCached) {
+    // Rasterizing the large bold label is the most expensive part of an item
+    personIdText->setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+  }
   personIdText->setData(BBoxIndex, index);
   personIdText->setData(ItemType, PersonIdTextItem);
+  // Register the items
+  if (index >= personBBoxItems_.size()) personBBoxItems_.resize(index + 1);
+  PersonBBoxItems& items = personBBoxItems_[index];
+  items.bbox = bbox;
+  items.personIdRect = personIdRect;
+  items.personIdText = personIdText;
+}
+
+void ImageArea::erasePersonBBox(int index)
+{
+  PersonBBoxItems& items = personBBoxItems_[index];
+  scene()->removeItem(items.bbox);
+  scene()->removeItem(items.personIdRect);
+  scene()->removeItem(items.personIdText);
+  delete items.bbox;
+  delete items.personIdRect;
+  delete items.personIdText;
+  items = PersonBBoxItems();
+}
+
+void ImageArea::clearScene()
+{
+  scene()->clear();
+  personBBoxItems_.clear();
+  // Deleted with the scene, made again by setPersonBBoxes
+  horizontalRuler_ = NULL;
+  verticalRuler_ = NULL;
+}
+
+void ImageArea::moveSelectedPersonBBoxes(qreal dx, qreal dy)
+{
+  if (permissionFlags_.testFlag(AllowMoving)) {
+    foreach (QGraphicsItem* item, scene()->selectedItems()) {
+      QGraphicsRectItem* bbox = static_cast<QGraphicsRectItem*>(item);
+      bbox->moveBy(dx, dy);
+      updatePersonIdPos(bbox);
+    }
+  }
+  syncSelectedPersonBBox();
 }
 
 void ImageArea::updatePersonIdPos(QGraphicsRectItem* bbox)
 {
   QRectF rect = bbox->mapRectToScene(bbox->boundingRect());
   int index = bbox->data(BBoxIndex).toInt();
-  getPersonIdRectItem(index)->setPos(rect.x() + PersonIdRectWidth / 2.0,
-                                     rect.y() - PersonIdRectHeight / 2.0);
-  getPersonIdTextItem(index)->setPos(rect.x() + 10,
-                                     rect.y() - PersonIdRectHeight - 3);
+  const PersonBBoxItems& items = personBBoxItems_[index];
+  items.personIdRect->setPos(rect.x() + PersonIdRectWidth / 2.0,
+                             rect.y() - PersonIdRectHeight / 2.0);
+  items.personIdText->setPos(rect.x() + 10,
+                             rect.y() - PersonIdRectHeight - 3);
+}
+
+void ImageArea::updatePersonIdLabel(int index)
+{
+  const PersonBBox& personBBox = personBBoxes_[index];
+  const PersonBBoxItems& items = personBBoxItems_[index];
+  QColor color = PresetColors[personBBox.getPersonId() % NumPresetColors];
+  QString text = QString::number(personBBox.getPersonId());
+  if (personBBox.isHard()) text += "*";
+  items.bbox->setPen(
+      QPen(color, 8, Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin));
+  items.personIdRect->setPen(QPen(color, 0, Qt::SolidLine));
+  items.personIdRect->setBrush(QBrush(color));
+  items.personIdText->setText(text);
 }
 
 void ImageArea::syncSelectedPersonBBox()
@@ -722,9 +906,19 @@ void ImageArea::syncSelectedPersonBBox()
   for (int i = 0; i < scene()->selectedItems().size(); ++i) {
     QGraphicsRectItem* item = dynamic_cast<QGraphicsRectItem*>(
         scene()->selectedItems().at(i));
-    PersonBBox& personBBox = personBBoxes_[item->data(BBoxIndex).toInt()];
+    int index = item->data(BBoxIndex).toInt();
+    PersonBBox& personBBox = personBBoxes_[index];
     QRectF rect = item->mapRectToScene(item->rect());
-    personBBox.setBBox(rect.x() + w / 2.0, rect.y() + h / 2.0,
-                       rect.width(), rect.height());
+    int x = static_cast<int>(rect.x() + w / 2.0);
+    int y = static_cast<int>(rect.y() + h / 2.0);
+    int width = static_cast<int>(rect.width());
+    int height = static_cast<int>(rect.height());
+    // Merely clicking on a bbox should not make it dirty
+    if (x == personBBox.x() && y == personBBox.y() &&
+        width == personBBox.width() && height == personBBox.height()) {
+      continue;
+    }
+    personBBox.setBBox(x, y, width, height);
+    dirtyMarks_[index] = true;
   }
 }
@@ -2,8 +2,11 @@
 #define IMAGEAREA_H
 
 #include "common/PersonBBox.hpp"
+#include "gui/TilePyramid.h"
 #include <QVector>
+#include <QHash>
 #include <QGraphicsView>
+#include <QFutureWatcher>
 #include <QFlags>
 
 class ImageArea : public QGraphicsView
@@ -28,6 +31,12 @@ public:
     ModeAnnotationByDragDrop
   };
 
+  enum RenderMode
+  {
+    RenderModeFull,
+    RenderModeCached
+  };
+
 public:
   explicit ImageArea(QWidget* parent = 0);
 
@@ -37,14 +46,34 @@ public:
   void setPermissionFlags(PermissionFlags permissionFlags);
 
   void setMode(Mode mode);
+
+  RenderMode getRenderMode() const;
+  void setRenderMode(RenderMode renderMode);
+
+  // Lays out the scene for an image which is still being decoded. The scene
+  // is in the pixels of the original image, whatever size it is decoded at.
+  void prepareImage(const QSize& size, int imageId);
+  // Keeps the scene and the zoom if it is already prepared for the image
   void setImage(const QImage& image, int imageId);
+  int getImageId() const;
+  bool hasImage() const;
+  // May be decoded at reduced size, see prepareImage
+  QImage getImage() const;
+  bool hasFullResolution() const;
   void setPersonBBoxes(const QVector<PersonBBox>& personBBoxes);
 
   PersonBBox getSelectedPersonBBox() const;
   QVector<PersonBBox> getPersonBBoxes() const;
   QVector<bool> getRemovedMarks() const;
+  QVector<bool> getDirtyMarks() const;
+
+  void markPersonBBoxesSaved(const QVector<PersonBBox>& personBBoxes);
+  // Replaces provisional bbox ids by the ones assigned by the database
+  void resolveProvisionalIds(const QHash<int, PersonBBox>& savedPersonBBoxes);
 
   void setPersonIdOfSelectedBBox(int personId);
+  // Returns false if the bbox has been removed
+  bool setPersonIdOfBBox(int index, int personId);
 
   void toggleHard();
 
@@ -53,9 +82,16 @@ public:
 
 signals:
   void personBBoxSelected();
+  // A new bbox has been drawn, at index in getPersonBBoxes
+  void personBBoxDrawn(int index);
+  // Emitted after each paint while tracing
+  void painted();
+  // Zoomed in past the detail of an image decoded at reduced size
+  void fullResolutionNeeded(int imageId);
 
 protected:
   void wheelEvent(QWheelEvent* event);
+  void paintEvent(QPaintEvent* event);
   void drawBackground(QPainter* painter, const QRectF& rect);
   void mousePressEvent(QMouseEvent* event);
   void mouseMoveEvent(QMouseEvent* event);
@@ -65,6 +101,7 @@ protected:
 private:
   PermissionFlags permissionFlags_;
   Mode mode_;
+  RenderMode renderMode_;
 
   enum State
   {
@@ -91,9 +128,26 @@ private:
 
   QImage image_;
   int imageId_;
+  bool fullResolutionRequested_;
+
+  TilePyramid tilePyramid_;
+  QFutureWatcher<TilePyramid> tilePyramidWatcher_;
 
   QVector<PersonBBox> personBBoxes_;
   QVector<bool> removedMarks_;
+  // Modified or newly added since loaded or last saved
+  QVector<bool> dirtyMarks_;
+
+  // Graphics items of each person bbox, addressed by the bbox index
+  struct PersonBBoxItems
+  {
+    PersonBBoxItems() : bbox(NULL), personIdRect(NULL), personIdText(NULL) {}
+
+    QGraphicsRectItem* bbox;
+    QGraphicsRectItem* personIdRect;
+    QGraphicsSimpleTextItem* personIdText;
+  };
+  QVector<PersonBBoxItems> personBBoxItems_;
 
   bool needClearSelection_;
 
@@ -102,11 +156,15 @@ private:
 
 private slots:
   void rectItemsSelectionChanged();
+  void tilePyramidBuilt();
 
 private:
   void updateBehaviors();
+  void updateRendering();
+  void invalidateBackground();
 
   void scaleView(qreal scaleFactor);
+  void checkResolution();
 
   void removeHeadMark();
   void removeRulers();
@@ -119,7 +177,11 @@ private:
 
   int addPersonBBox(qreal x, qreal y, qreal width, qreal height);
   void drawPersonBBox(const PersonBBox& personBBox, int index);
+  void erasePersonBBox(int index);
+  void clearScene();
+  void moveSelectedPersonBBoxes(qreal dx, qreal dy);
   void updatePersonIdPos(QGraphicsRectItem* bbox);
+  void updatePersonIdLabel(int index);
   void syncSelectedPersonBBox();
 };
 
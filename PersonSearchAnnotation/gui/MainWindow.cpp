@@ -1,28 +1,65 @@
 #include "gui/MainWindow.h"
 #include "gui/PreferencesDialog.h"
 #include "utils/PreferencesManager.h"
+#include "utils/Trace.h"
 #include "utils/util_functions.h"
+#include <algorithm>
 #include <QVector>
+#include <QPair>
+#include <QSet>
 #include <QMenuBar>
-#include <QImageReader>
+#include <QListView>
+#include <QStatusBar>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QTextCodec>
 #include <QFileDialog>
 #include <QCloseEvent>
 #include <QMessageBox>
+#include <QtConcurrent>
 #include <QDebug>
 
 using namespace psa;
 
+static const int StatusTimeout = 5000;
+static const int MaxNavigationTimes = 5;
+static const int MaxSuggestions = 8;
+
+static bool isLonger(const QPair<qint64, QString>& a,
+                     const QPair<qint64, QString>& b)
+{
+  return a.first > b.first;
+}
+
 MainWindow::MainWindow(QWidget* parent)
-  : QMainWindow(parent)
+  : QMainWindow(parent),
+    nextProvisionalId_(-2),
+    personCropsRequest_(0),
+    appearanceEngine_(&databaseWorker_),
+    suggestedBBoxIndex_(-1),
+    suggestionsRequest_(0),
+    validating_(false),
+    navigationBegin_(-1),
+    showNavigationTimes_(false)
 {
+  databaseWorker_.start();
+
   setCodecs("UTF-8");
   setWindowTitle(tr("行人搜索标注工具"));
 
-  createMenus();
+  // The menus list the docks
   createPanels();
+  createMenus();
+
+  applyPreferences();
+  connect(&PreferencesManager::instance(),
+          &PreferencesManager::preferenceChanged,
+          this, &MainWindow::preferenceChanged);
+  connect(&appearanceEngine_, &AppearanceEngine::suggestionsReady,
+          this, &MainWindow::suggestionsReady);
+  connect(&validationWatcher_,
+          &QFutureWatcher<DatasetValidator::Report>::finished,
+          this, &MainWindow::datasetValidated);
 
   loadDatabase(PreferencesManager::instance().getDatabaseFilePath());
 }
@@ -35,25 +72,34 @@ MainWindow::~MainWindow()
 void MainWindow::closeEvent(QCloseEvent* event)
 {
   save();
+  // Wait only for the pending writes
+  databaseWorker_.flush();
   event->accept();
 }
 
 void MainWindow::openFolder()
 {
-  const PreferencesManager& pm = PreferencesManager::instance();
-  QString folderPath = QFileDialog::getExistingDirectory(
-      this, tr("打开图片文件夹"), pm.getImagesRootDirectory(),
-      QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
-  if (!isValidFolder(QDir(pm.getImagesRootDirectory()).absolutePath(),
-                     QDir(folderPath).absolutePath())) {
-    QMessageBox::critical(this, tr("无法打开文件夹"),
-        tr("文件夹必须存放在根目录下"),
-        QMessageBox::Ok);
-    return;
-  }
+  QString folderPath = chooseFolder();
+  if (folderPath.isEmpty()) return;
   loadFolder(folderPath);
 }
 
+void MainWindow::openFolderRecursively()
+{
+  QString folderPath = chooseFolder();
+  if (folderPath.isEmpty()) return;
+  loadFolder(folderPath, true);
+}
+
+void MainWindow::openAllImages()
+{
+  databaseWorker_.query([](DatabaseHelper* databaseHelper) {
+    return databaseHelper->getImageIds();
+  }, this, [this](const QVector<int>& imageIds) {
+    openImages(imageIds);
+  });
+}
+
 void MainWindow::openDatabase()
 {
   const PreferencesManager& pm = PreferencesManager::instance();
@@ -72,8 +118,60 @@ void MainWindow::editPreferences()
 
 void MainWindow::save()
 {
-  databaseHelper_.syncPersonBBoxes(annotationArea_->getPersonBBoxes(),
-                                   annotationArea_->getRemovedMarks());
+  PSA_TRACE_SCOPE("MainWindow::save");
+  QVector<PersonBBox> personBBoxes = annotationArea_->getPersonBBoxes();
+  QVector<bool> removedMarks = annotationArea_->getRemovedMarks();
+  QVector<bool> dirtyMarks = annotationArea_->getDirtyMarks();
+  bool modified = false;
+  QVector<int> removedBBoxIds;
+  // The shown person gains, moves or loses bboxes
+  int shownPersonId = personCropDock_->getPersonId();
+  bool shownPersonChanged = false;
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    PersonBBox& personBBox = personBBoxes[i];
+    bool changed;
+    if (removedMarks[i]) {
+      changed = personBBox.getBBoxId() != 0;
+      if (personBBox.getBBoxId() > 0) {
+        removedBBoxIds.push_back(personBBox.getBBoxId());
+      }
+    } else if (personBBox.getBBoxId() == 0) {
+      personBBox.setBBoxId(nextProvisionalId_--);
+      changed = true;
+    } else {
+      changed = dirtyMarks[i];
+    }
+    modified |= changed;
+    // The shown bboxes cover those relabeled away from the person
+    shownPersonChanged |= changed && shownPersonId > 0 &&
+        (personBBox.getPersonId() == shownPersonId ||
+         personCropDock_->containsBBox(personBBox.getBBoxId()));
+  }
+  if (!modified) return;
+
+  // Not waited for, the worker keeps the writes in order
+  databaseWorker_.syncPersonBBoxes(
+      personBBoxes, removedMarks, dirtyMarks, this,
+      [this, shownPersonId, shownPersonChanged](
+          const DatabaseWorker::SyncResult& result) {
+    annotationArea_->resolveProvisionalIds(result.saved);
+    if (shownPersonChanged &&
+        personCropDock_->getPersonId() == shownPersonId) {
+      loadPersonCrops(shownPersonId);
+    }
+    if (!result.conflicts.isEmpty()) {
+      statusBar()->showMessage(
+          tr("%1 个标注框已被其他人修改或删除，未保存").arg(
+              result.conflicts.size()));
+    }
+  });
+  // Queued behind the writes
+  appearanceEngine_.update(annotationArea_->getImageId(), removedBBoxIds);
+  // Removed bboxes are deleted only once
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    if (removedMarks[i]) personBBoxes[i].setBBoxId(0);
+  }
+  annotationArea_->markPersonBBoxesSaved(personBBoxes);
 }
 
 void MainWindow::exportToPersonTxt()
@@ -81,7 +179,11 @@ void MainWindow::exportToPersonTxt()
   QString filePath = QFileDialog::getSaveFileName(
       this, tr("导出为 按行人标注"), "person_annotation.txt");
   if (filePath.isEmpty()) return;
-  databaseHelper_.exportToPersonTxt(filePath);
+  databaseWorker_.query([filePath](DatabaseHelper* databaseHelper) {
+    return databaseHelper->exportToPersonTxt(filePath);
+  }, this, [this, filePath](bool exported) {
+    showExported(filePath, exported);
+  });
 }
 
 void MainWindow::exportToImageTxt()
@@ -89,7 +191,101 @@ void MainWindow::exportToImageTxt()
   QString filePath = QFileDialog::getSaveFileName(
       this, tr("导出为 按图片标注"), "image_annotation.txt");
   if (filePath.isEmpty()) return;
-  databaseHelper_.exportToImageTxt(filePath);
+  databaseWorker_.query([filePath](DatabaseHelper* databaseHelper) {
+    return databaseHelper->exportToImageTxt(filePath);
+  }, this, [this, filePath](bool exported) {
+    showExported(filePath, exported);
+  });
+}
+
+void MainWindow::exportToBinary()
+{
+  QString filePath = QFileDialog::getSaveFileName(
+      this, tr("导出为 二进制标注"), "annotation.psab",
+      tr("二进制标注 (*.psab)"));
+  if (filePath.isEmpty()) return;
+  databaseWorker_.query([filePath](DatabaseHelper* databaseHelper) {
+    return databaseHelper->exportToBinary(filePath);
+  }, this, [this, filePath](bool exported) {
+    showExported(filePath, exported);
+  });
+}
+
+void MainWindow::showExported(const QString& filePath, bool exported)
+{
+  if (exported) {
+    statusBar()->showMessage(tr("已导出 ") + filePath, StatusTimeout);
+  } else {
+    QMessageBox::critical(this, tr("无法导出"), filePath, QMessageBox::Ok);
+  }
+}
+
+void MainWindow::validateDataset()
+{
+  if (validating_) return;
+  validating_ = true;
+  statusBar()->showMessage(tr("正在检查数据集……"));
+  // The validator reads the file through connections of its own, once the
+  // writes kept in memory are there
+  databaseWorker_.query([](DatabaseHelper* databaseHelper) {
+    databaseHelper->flush();
+    return databaseHelper->getFilePath();
+  }, this, [this](const QString& filePath) {
+    validationWatcher_.setFuture(QtConcurrent::run([filePath]() {
+      return DatasetValidator(filePath).run();
+    }));
+  });
+}
+
+void MainWindow::datasetValidated()
+{
+  validating_ = false;
+  statusBar()->clearMessage();
+  DatasetValidator::Report report = validationWatcher_.result();
+  if (!report.error.isEmpty()) {
+    QMessageBox::critical(this, tr("无法检查数据集"), report.error,
+                          QMessageBox::Ok);
+    return;
+  }
+  // In the order of DatasetValidator::IssueType
+  QStringList labels;
+  labels << tr("超出图片的框") << tr("面积为零的框") << tr("重复的框")
+         << tr("在同一图片中重复出现的行人") << tr("没有框的行人")
+         << tr("图片不存在的框") << tr("行人不存在的框");
+  QString text = tr("共 %1 张图片，%2 个框，用时 %3 秒\n")
+      .arg(report.numImages).arg(report.numBBoxes)
+      .arg(report.elapsed / 1000.0, 0, 'f', 1);
+  for (int type = 0; type < DatasetValidator::NumIssueTypes; ++type) {
+    text += QString("\n%1: %2").arg(labels.value(type)).arg(
+        report.getCount(static_cast<DatasetValidator::IssueType>(type)));
+  }
+  QMessageBox::StandardButton button = QMessageBox::information(
+      this, tr("检查数据集"), text, QMessageBox::Save | QMessageBox::Close);
+  if (button != QMessageBox::Save) return;
+  QString filePath = QFileDialog::getSaveFileName(
+      this, tr("保存检查报告"), "validation_report.json",
+      tr("JSON 文件 (*.json)"));
+  if (filePath.isEmpty()) return;
+  if (!report.save(filePath)) {
+    QMessageBox::critical(this, tr("无法保存检查报告"), filePath,
+                          QMessageBox::Ok);
+  }
+}
+
+void MainWindow::importFromPersonTxt()
+{
+  QString filePath = QFileDialog::getOpenFileName(
+      this, tr("导入 按行人标注"), QString(), tr("文本文件 (*.txt)"));
+  if (filePath.isEmpty()) return;
+  importFromTxt(filePath, true);
+}
+
+void MainWindow::importFromImageTxt()
+{
+  QString filePath = QFileDialog::getOpenFileName(
+      this, tr("导入 按图片标注"), QString(), tr("文本文件 (*.txt)"));
+  if (filePath.isEmpty()) return;
+  importFromTxt(filePath, false);
 }
 
 void MainWindow::modeAction()
@@ -114,35 +310,97 @@ void MainWindow::toggleHardAction()
   annotationArea_->toggleHard();
 }
 
+void MainWindow::cachedRenderingAction(bool checked)
+{
+  ImageArea::RenderMode renderMode =
+      checked ? ImageArea::RenderModeCached : ImageArea::RenderModeFull;
+  viewArea_->setRenderMode(renderMode);
+  annotationArea_->setRenderMode(renderMode);
+}
+
+void MainWindow::traceAction(bool checked)
+{
+  Trace::setEnabled(checked);
+  navigationBegin_ = -1;
+}
+
+void MainWindow::navigationTimesAction(bool checked)
+{
+  showNavigationTimes_ = checked;
+}
+
+void MainWindow::exportTrace()
+{
+  QString filePath = QFileDialog::getSaveFileName(
+      this, tr("导出性能跟踪"), "trace.json", tr("Chrome 跟踪 (*.json)"));
+  if (filePath.isEmpty()) return;
+  if (!Trace::writeChromeTrace(filePath)) {
+    QMessageBox::critical(this, tr("无法导出性能跟踪"), filePath,
+                          QMessageBox::Ok);
+    return;
+  }
+  statusBar()->showMessage(tr("已导出 ") + filePath, StatusTimeout);
+}
+
 void MainWindow::viewNavigateTo(int /* index */, const ImageFile& imageFile)
-{  
-  QDir root(PreferencesManager::instance().getImagesRootDirectory());
-  QString absPath = root.filePath(imageFile.getPath());
-  QImageReader imageReader(absPath);
-  imageReader.setAutoTransform(true);
-  viewArea_->setImage(imageReader.read(), imageFile.getImageId());
-  viewArea_->setPersonBBoxes(
-      databaseHelper_.getPersonBBoxesByImageId(imageFile.getImageId()));
+{
+  PSA_TRACE_SCOPE("MainWindow::viewNavigateTo");
+  showImage(viewArea_, imageFile);
+  loadPersonBBoxes(viewArea_, imageFile.getImageId());
 }
 
 void MainWindow::annotationNavigateTo(int index, const ImageFile& imageFile)
 {
+  // Ends with the first paint of both the image and its bboxes
+  if (Trace::isEnabled()) navigationBegin_ = Trace::now();
+  PSA_TRACE_SCOPE("MainWindow::annotationNavigateTo");
   save();
+  resetSuggestions();
   // Show next image file
-  QDir root(PreferencesManager::instance().getImagesRootDirectory());
-  QString absPath = root.filePath(imageFile.getPath());
-  QImageReader imageReader(absPath);
-  imageReader.setAutoTransform(true);
-  annotationArea_->setImage(imageReader.read(), imageFile.getImageId());
-  annotationArea_->setPersonBBoxes(
-      databaseHelper_.getPersonBBoxesByImageId(imageFile.getImageId()));
+  showImage(annotationArea_, imageFile);
+  loadPersonBBoxes(annotationArea_, imageFile.getImageId());
   viewGalleryNavigator_->navigate(index > 0 ? index - 1 : 0);
+  prefetchNeighbors(index);
+  filmstrip_->setCurrentIndex(galleryModel_->index(index));
+  filmstrip_->scrollTo(filmstrip_->currentIndex());
+}
+
+void MainWindow::imageLoaded(int imageId, const QImage& image)
+{
+  PSA_TRACE_SCOPE("MainWindow::imageLoaded");
+  if (image.isNull()) return;
+  // Either the first image, or the full resolution one replacing it
+  QList<ImageArea*> imageAreas;
+  imageAreas << viewArea_ << annotationArea_;
+  foreach (ImageArea* imageArea, imageAreas) {
+    if (imageArea->getImageId() == imageId &&
+        (!imageArea->hasImage() || !imageArea->hasFullResolution())) {
+      imageArea->setImage(image, imageId);
+    }
+  }
+}
+
+void MainWindow::fullResolutionNeeded(int imageId)
+{
+  // Only the images shown can be zoomed in
+  QList<GalleryNavigator*> navigators;
+  navigators << viewGalleryNavigator_ << annotationGalleryNavigator_;
+  foreach (GalleryNavigator* navigator, navigators) {
+    int index = navigator->getCurrentIndex();
+    if (index < 0) continue;
+    ImageFile imageFile = galleryModel_->getImageFile(index);
+    if (imageFile.getImageId() == imageId) {
+      imageCache_.requestFullResolution(imageFile);
+      return;
+    }
+  }
 }
 
 void MainWindow::viewPersonBBoxSelected()
 {
   PersonBBox viewPersonBBox = viewArea_->getSelectedPersonBBox();
   PersonBBox annotationPersonBBox = annotationArea_->getSelectedPersonBBox();
+  if (!viewPersonBBox.isNull()) showPersonCrops(viewPersonBBox.getPersonId());
   if (viewPersonBBox.isNull() || annotationPersonBBox.isNull()) return;
   if (viewPersonBBox.getPersonId() <= 0) return;
   annotationArea_->setPersonIdOfSelectedBBox(viewPersonBBox.getPersonId());
@@ -154,6 +412,9 @@ void MainWindow::annotationPersonBBoxSelected()
 {
   PersonBBox viewPersonBBox = viewArea_->getSelectedPersonBBox();
   PersonBBox annotationPersonBBox = annotationArea_->getSelectedPersonBBox();
+  if (!annotationPersonBBox.isNull()) {
+    showPersonCrops(annotationPersonBBox.getPersonId());
+  }
   if (viewPersonBBox.isNull() || annotationPersonBBox.isNull()) return;
   if (viewPersonBBox.getPersonId() <= 0) return;
   annotationArea_->setPersonIdOfSelectedBBox(viewPersonBBox.getPersonId());
@@ -161,6 +422,113 @@ void MainWindow::annotationPersonBBoxSelected()
   annotationArea_->clearSelectionAfterMouseReleased();
 }
 
+void MainWindow::annotationPersonBBoxDrawn(int index)
+{
+  QImage image = annotationArea_->getImage();
+  if (image.isNull() || !suggestionDock_->isVisible()) return;
+  QVector<PersonBBox> personBBoxes = annotationArea_->getPersonBBoxes();
+  QVector<bool> removedMarks = annotationArea_->getRemovedMarks();
+  // A person appears once in an image
+  QSet<int> excludedPersonIds;
+  for (int i = 0; i < personBBoxes.size(); ++i) {
+    int personId = personBBoxes[i].getPersonId();
+    if (!removedMarks[i] && personId > 0) excludedPersonIds.insert(personId);
+  }
+  // The image may be decoded at reduced size
+  qreal scale = image.width() / annotationArea_->sceneRect().width();
+  const PersonBBox& personBBox = personBBoxes[index];
+  QRect rect(qRound(personBBox.x() * scale), qRound(personBBox.y() * scale),
+             qRound(personBBox.width() * scale),
+             qRound(personBBox.height() * scale));
+  // The suggestions of the previous bbox are stale, even those on the way
+  resetSuggestions();
+  suggestedBBoxIndex_ = index;
+  appearanceEngine_.suggest(image, rect, excludedPersonIds, MaxSuggestions);
+}
+
+void MainWindow::suggestionsReady(const AppearanceEngine::Matches& matches)
+{
+  if (suggestedBBoxIndex_ < 0) return;
+  typedef QPair<QVector<PersonBBox>, QHash<int, ImageFile> > Suggestions;
+  int request = ++suggestionsRequest_;
+  databaseWorker_.query([matches](DatabaseHelper* databaseHelper) {
+    QVector<PersonBBox> personBBoxes;
+    QVector<int> imageIds;
+    foreach (const AppearanceIndex::Match& match, matches) {
+      PersonBBox personBBox = databaseHelper->getPersonBBox(match.bboxId);
+      if (personBBox.isNull()) continue;
+      personBBoxes.push_back(personBBox);
+      imageIds.push_back(personBBox.getImageId());
+    }
+    return qMakePair(personBBoxes,
+                     databaseHelper->getImageFilesByIds(imageIds));
+  }, this, [this, request](const Suggestions& suggestions) {
+    if (suggestionsRequest_ != request) return;
+    suggestionDock_->setSuggestions(suggestions.first, suggestions.second);
+  });
+}
+
+void MainWindow::personSuggested(int personId)
+{
+  if (suggestedBBoxIndex_ < 0) return;
+  annotationArea_->setPersonIdOfBBox(suggestedBBoxIndex_, personId);
+}
+
+void MainWindow::annotationAreaPainted()
+{
+  if (navigationBegin_ < 0) return;
+  if (!annotationArea_->hasImage() || !annotationArea_->isEnabled()) return;
+  qint64 navigationEnd = Trace::now();
+  if (showNavigationTimes_) showNavigationTimes(navigationBegin_, navigationEnd);
+  Trace::record("MainWindow::navigation", navigationBegin_, navigationEnd);
+  navigationBegin_ = -1;
+}
+
+void MainWindow::personCropActivated(const PersonBBox& personBBox)
+{
+  // Show the image in the view pane, if it is in the opened folder
+  int index = galleryModel_->findRow(personBBox.getImageId());
+  if (index < 0) {
+    statusBar()->showMessage(tr("该图片不在打开的文件夹中"), StatusTimeout);
+    return;
+  }
+  viewGalleryNavigator_->navigate(index);
+}
+
+void MainWindow::filmstripActivated(const QModelIndex& index)
+{
+  annotationGalleryNavigator_->navigate(index.row());
+}
+
+void MainWindow::galleryRowsFetched(int first, int last)
+{
+  // A page of the neighbors prefetchNeighbors had to skip
+  int index = annotationGalleryNavigator_->getCurrentIndex();
+  if (index < 0) return;
+  int prefetchDepth = PreferencesManager::instance().getPrefetchDepth();
+  if (last >= index - 1 - prefetchDepth && first <= index + prefetchDepth) {
+    prefetchNeighbors(index);
+  }
+}
+
+void MainWindow::preferenceChanged(const QString& key)
+{
+  // Decoded images are keyed by image id, whatever root they came from
+  if (key == "imagesRootDirectory") imageCache_.clear();
+  applyPreferences();
+}
+
+void MainWindow::applyPreferences()
+{
+  const PreferencesManager& pm = PreferencesManager::instance();
+  imageCache_.setMaxCost(pm.getImageCacheSize() * 1024);
+  imageCache_.setThreadCount(pm.getDecodingThreadCount());
+  int databaseCacheSize = pm.getDatabaseCacheSize() * 1024;
+  databaseWorker_.post([databaseCacheSize](DatabaseHelper* databaseHelper) {
+    databaseHelper->setCacheSize(databaseCacheSize);
+  });
+}
+
 void MainWindow::setCodecs(const char* codec)
 {
   QTextCodec::setCodecForLocale(QTextCodec::codecForName(codec));
@@ -172,6 +540,14 @@ void MainWindow::createMenus()
   QAction* openFolderAction = fileMenu->addAction(tr("打开图片文件夹"));
   openFolderAction->setShortcut(QKeySequence::Open);
   connect(openFolderAction, &QAction::triggered, this, &MainWindow::openFolder);
+  QAction* openFolderRecursivelyAction = fileMenu->addAction(
+      tr("打开图片文件夹（包含子文件夹）"));
+  connect(openFolderRecursivelyAction, &QAction::triggered,
+          this, &MainWindow::openFolderRecursively);
+  QAction* openAllImagesAction = fileMenu->addAction(
+      tr("打开数据库中的全部图片"));
+  connect(openAllImagesAction, &QAction::triggered,
+          this, &MainWindow::openAllImages);
   QAction* openDatabaseAction = fileMenu->addAction(tr("打开标注数据库"));
   connect(openDatabaseAction, &QAction::triggered, this, &MainWindow::openDatabase);
   QAction* saveAction = fileMenu->addAction(tr("保存"));
@@ -186,12 +562,51 @@ void MainWindow::createMenus()
       tr("导出为 按图片标注"));
   connect(exportToImageTxtAction, &QAction::triggered,
           this, &MainWindow::exportToImageTxt);
+  QAction* exportToBinaryAction = fileMenu->addAction(
+      tr("导出为 二进制标注"));
+  connect(exportToBinaryAction, &QAction::triggered,
+          this, &MainWindow::exportToBinary);
+  QAction* validateDatasetAction = fileMenu->addAction(tr("检查数据集"));
+  connect(validateDatasetAction, &QAction::triggered,
+          this, &MainWindow::validateDataset);
+  fileMenu->addSeparator();
+  QAction* importFromPersonTxtAction = fileMenu->addAction(
+      tr("导入 按行人标注"));
+  connect(importFromPersonTxtAction, &QAction::triggered,
+          this, &MainWindow::importFromPersonTxt);
+  QAction* importFromImageTxtAction = fileMenu->addAction(
+      tr("导入 按图片标注"));
+  connect(importFromImageTxtAction, &QAction::triggered,
+          this, &MainWindow::importFromImageTxt);
 
   QMenu* editMenu = menuBar()->addMenu(tr("&编辑"));
   QAction* editPreferencesAction = editMenu->addAction(tr("选项"));
   connect(editPreferencesAction, &QAction::triggered,
           this, &MainWindow::editPreferences);
 
+  QMenu* viewMenu = menuBar()->addMenu(tr("&视图"));
+  QAction* cachedRenderingAction = viewMenu->addAction(tr("缓存渲染"));
+  cachedRenderingAction->setCheckable(true);
+  cachedRenderingAction->setChecked(true);
+  connect(cachedRenderingAction, &QAction::toggled,
+          this, &MainWindow::cachedRenderingAction);
+  viewMenu->addAction(personCropDock_->toggleViewAction());
+  viewMenu->addAction(suggestionDock_->toggleViewAction());
+  viewMenu->addSeparator();
+  QAction* traceAction = viewMenu->addAction(tr("性能跟踪"));
+  traceAction->setCheckable(true);
+  connect(traceAction, &QAction::toggled, this, &MainWindow::traceAction);
+  QAction* navigationTimesAction = viewMenu->addAction(tr("显示切换图片耗时"));
+  navigationTimesAction->setCheckable(true);
+  navigationTimesAction->setEnabled(false);
+  connect(traceAction, &QAction::toggled,
+          navigationTimesAction, &QAction::setEnabled);
+  connect(navigationTimesAction, &QAction::toggled,
+          this, &MainWindow::navigationTimesAction);
+  QAction* exportTraceAction = viewMenu->addAction(tr("导出性能跟踪"));
+  connect(exportTraceAction, &QAction::triggered,
+          this, &MainWindow::exportTrace);
+
   QMenu* annoMenu = menuBar()->addMenu(tr("&标注"));
   QAction* selectionAction = annoMenu->addAction(tr("选择行人模式"));
   selectionAction->setCheckable(true);
@@ -231,8 +646,21 @@ void MainWindow::createMenus()
 
 void MainWindow::createPanels()
 {
+  galleryModel_ = new GalleryModel(&databaseWorker_, this);
+  connect(galleryModel_, &GalleryModel::rowsFetched,
+          this, &MainWindow::galleryRowsFetched);
   viewGalleryNavigator_ = new GalleryNavigator;
+  viewGalleryNavigator_->setModel(galleryModel_);
   annotationGalleryNavigator_ = new GalleryNavigator;
+  annotationGalleryNavigator_->setModel(galleryModel_);
+  // Only the visible thumbnails are ever asked for
+  filmstrip_ = new QListView;
+  filmstrip_->setModel(galleryModel_);
+  filmstrip_->setFlow(QListView::LeftToRight);
+  filmstrip_->setWrapping(false);
+  filmstrip_->setUniformItemSizes(true);
+  filmstrip_->setIconSize(ThumbnailCache::ThumbnailSize);
+  filmstrip_->setFixedHeight(ThumbnailCache::ThumbnailSize.height() + 48);
   viewArea_ = new ImageArea;
   viewArea_->setPermissionFlags(ImageArea::AllowSelection);
   annotationArea_ = new ImageArea;
@@ -246,10 +674,22 @@ void MainWindow::createPanels()
           this, &MainWindow::viewNavigateTo);
   connect(annotationGalleryNavigator_, &GalleryNavigator::navigateTo,
           this, &MainWindow::annotationNavigateTo);
+  connect(&imageCache_, &ImageCache::imageLoaded,
+          this, &MainWindow::imageLoaded);
   connect(viewArea_, &ImageArea::personBBoxSelected,
           this, &MainWindow::viewPersonBBoxSelected);
   connect(annotationArea_, &ImageArea::personBBoxSelected,
           this, &MainWindow::annotationPersonBBoxSelected);
+  connect(annotationArea_, &ImageArea::personBBoxDrawn,
+          this, &MainWindow::annotationPersonBBoxDrawn);
+  connect(annotationArea_, &ImageArea::painted,
+          this, &MainWindow::annotationAreaPainted);
+  connect(viewArea_, &ImageArea::fullResolutionNeeded,
+          this, &MainWindow::fullResolutionNeeded);
+  connect(annotationArea_, &ImageArea::fullResolutionNeeded,
+          this, &MainWindow::fullResolutionNeeded);
+  connect(filmstrip_, &QListView::activated,
+          this, &MainWindow::filmstripActivated);
 
   QVBoxLayout* viewPanelLayout = new QVBoxLayout;
   viewPanelLayout->addWidget(viewGalleryNavigator_);
@@ -259,35 +699,217 @@ void MainWindow::createPanels()
   annotationPanelLayout->addWidget(annotationGalleryNavigator_);
   annotationPanelLayout->addWidget(annotationArea_);
 
+  QHBoxLayout* panelsLayout = new QHBoxLayout;
+  panelsLayout->addLayout(viewPanelLayout);
+  panelsLayout->addLayout(annotationPanelLayout);
+
   QWidget* mainFrame = new QWidget;
-  QHBoxLayout* mainFrameLayout = new QHBoxLayout;
-  mainFrameLayout->addLayout(viewPanelLayout);
-  mainFrameLayout->addLayout(annotationPanelLayout);
+  QVBoxLayout* mainFrameLayout = new QVBoxLayout;
+  mainFrameLayout->addLayout(panelsLayout);
+  mainFrameLayout->addWidget(filmstrip_);
   mainFrame->setLayout(mainFrameLayout);
 
   setCentralWidget(mainFrame);
+
+  personCropDock_ = new PersonCropDock(this);
+  addDockWidget(Qt::RightDockWidgetArea, personCropDock_);
+  connect(personCropDock_, &PersonCropDock::personBBoxActivated,
+          this, &MainWindow::personCropActivated);
+  suggestionDock_ = new SuggestionDock(this);
+  addDockWidget(Qt::RightDockWidgetArea, suggestionDock_);
+  connect(suggestionDock_, &SuggestionDock::personSuggested,
+          this, &MainWindow::personSuggested);
   showMaximized();
 }
 
-void MainWindow::loadFolder(const QString& folderPath)
+void MainWindow::showImage(ImageArea* imageArea, const ImageFile& imageFile)
+{
+  PSA_TRACE_SCOPE("MainWindow::showImage");
+  int imageId = imageFile.getImageId();
+  // Decode no more pixels than the area shows when fitting the image
+  QWidget* viewport = imageArea->viewport();
+  imageCache_.setDecodeSize(viewport->size() * viewport->devicePixelRatio());
+  if (!imageFile.hasSize()) {
+    // The scene takes the size of the image, decoded at full resolution
+    imageArea->setImage(imageCache_.getImage(imageFile), imageId);
+    return;
+  }
+  // Boxes can be shown and edited while the pixels are being decoded
+  imageArea->prepareImage(imageFile.getDisplaySize(), imageId);
+  if (imageCache_.contains(imageId)) {
+    imageArea->setImage(imageCache_.getImage(imageFile), imageId);
+    return;
+  }
+  imageCache_.request(imageFile);
+}
+
+void MainWindow::loadPersonBBoxes(ImageArea* imageArea, int imageId)
+{
+  // Not editable until loaded, or the loaded bboxes would replace new ones
+  imageArea->setEnabled(false);
+  int request = ++personBBoxesRequests_[imageArea];
+  databaseWorker_.query([imageId](DatabaseHelper* databaseHelper) {
+    return databaseHelper->getPersonBBoxesByImageId(imageId);
+  }, this, [this, imageArea, request](const QVector<PersonBBox>& personBBoxes) {
+    if (personBBoxesRequests_.value(imageArea) != request) return;
+    PSA_TRACE_SCOPE("MainWindow::personBBoxesLoaded");
+    imageArea->setPersonBBoxes(personBBoxes);
+    imageArea->setEnabled(true);
+  });
+}
+
+void MainWindow::showPersonCrops(int personId)
+{
+  if (personId <= 0 || !personCropDock_->isVisible()) return;
+  if (personId == personCropDock_->getPersonId()) return;
+  loadPersonCrops(personId);
+}
+
+void MainWindow::loadPersonCrops(int personId)
+{
+  typedef QPair<QVector<PersonBBox>, QHash<int, ImageFile> > PersonCrops;
+  int request = ++personCropsRequest_;
+  databaseWorker_.query([personId](DatabaseHelper* databaseHelper) {
+    QVector<PersonBBox> personBBoxes =
+        databaseHelper->getPersonBBoxesByPersonId(personId);
+    QVector<int> imageIds;
+    foreach (const PersonBBox& personBBox, personBBoxes) {
+      imageIds.push_back(personBBox.getImageId());
+    }
+    return qMakePair(personBBoxes,
+                     databaseHelper->getImageFilesByIds(imageIds));
+  }, this, [this, personId, request](const PersonCrops& personCrops) {
+    if (personCropsRequest_ != request) return;
+    personCropDock_->setPersonBBoxes(personId, personCrops.first,
+                                     personCrops.second);
+  });
+}
+
+void MainWindow::resetSuggestions()
+{
+  suggestedBBoxIndex_ = -1;
+  ++suggestionsRequest_;
+  suggestionDock_->reset();
+}
+
+void MainWindow::importFromTxt(const QString& filePath, bool byPerson)
+{
+  // The imported groups replace the bboxes, so the edits go in first
+  save();
+  databaseWorker_.query([filePath, byPerson](DatabaseHelper* databaseHelper) {
+    QString errorMessage;
+    bool ok = byPerson ?
+        databaseHelper->importFromPersonTxt(filePath, &errorMessage) :
+        databaseHelper->importFromImageTxt(filePath, &errorMessage);
+    return ok ? QString() : errorMessage;
+  }, this, [this, filePath](const QString& errorMessage) {
+    if (!errorMessage.isEmpty()) {
+      QMessageBox::critical(this, tr("无法导入标注"),
+                            filePath + "\n" + errorMessage, QMessageBox::Ok);
+      return;
+    }
+    statusBar()->showMessage(tr("已导入 ") + filePath, StatusTimeout);
+    resetSuggestions();
+    appearanceEngine_.reload();
+    // Show the imported bboxes
+    if (viewArea_->getImageId() >= 0) {
+      loadPersonBBoxes(viewArea_, viewArea_->getImageId());
+    }
+    if (annotationArea_->getImageId() >= 0) {
+      loadPersonBBoxes(annotationArea_, annotationArea_->getImageId());
+    }
+  });
+}
+
+void MainWindow::prefetchNeighbors(int index)
+{
+  // The view pane always shows the frame before the annotation pane, so
+  // decode the next frames and the ones before the view pane's, nearest first.
+  int prefetchDepth = PreferencesManager::instance().getPrefetchDepth();
+  QVector<int> rows;
+  for (int d = 1; d <= prefetchDepth; ++d) {
+    if (index + d < galleryModel_->rowCount()) rows.push_back(index + d);
+    if (index - 1 - d >= 0) rows.push_back(index - 1 - d);
+  }
+  QVector<ImageFile> imageFiles;
+  foreach (int row, rows) {
+    ImageFile imageFile = galleryModel_->getImageFile(row);
+    // Prefetched again by galleryRowsFetched once their page is there
+    if (imageFile.isNull()) {
+      galleryModel_->fetch(row);
+    } else {
+      imageFiles.push_back(imageFile);
+    }
+  }
+  imageCache_.prefetch(imageFiles);
+}
+
+void MainWindow::showNavigationTimes(qint64 begin, qint64 end)
+{
+  // Total time of each scope on all threads, longest first
+  QHash<QString, qint64> durations;
+  foreach (const Trace::Event& event, Trace::getEvents(begin)) {
+    if (event.end <= end) durations[event.name] += event.end - event.begin;
+  }
+  QVector<QPair<qint64, QString> > times;
+  for (QHash<QString, qint64>::const_iterator it = durations.constBegin();
+       it != durations.constEnd(); ++it) {
+    times.push_back(qMakePair(it.value(), it.key()));
+  }
+  std::sort(times.begin(), times.end(), isLonger);
+
+  QStringList parts;
+  for (int i = 0; i < times.size() && i < MaxNavigationTimes; ++i) {
+    parts.push_back(QString("%1 %2 ms").arg(times[i].second)
+                    .arg(times[i].first / 1e6, 0, 'f', 1));
+  }
+  statusBar()->showMessage(
+      tr("切换图片 %1 ms：").arg((end - begin) / 1e6, 0, 'f', 1) +
+      parts.join(tr("，")));
+}
+
+QString MainWindow::chooseFolder()
 {
-  // Get folder's relative path to the root directory
   const PreferencesManager& pm = PreferencesManager::instance();
-  QDir root(pm.getImagesRootDirectory());
-  QString relPath = root.relativeFilePath(folderPath);
-  // Use its prefix as the author
-  QString prefix = relPath.split("/", QString::SkipEmptyParts).front();
-
-  QStringList paths;
-  listImageFiles(folderPath, &paths);
-  for (int i = 0; i < paths.size(); ++i) {
-    paths[i] = root.relativeFilePath(paths[i]);
+  QString folderPath = QFileDialog::getExistingDirectory(
+      this, tr("打开图片文件夹"), pm.getImagesRootDirectory(),
+      QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+  if (!isValidFolder(QDir(pm.getImagesRootDirectory()).absolutePath(),
+                     QDir(folderPath).absolutePath())) {
+    QMessageBox::critical(this, tr("无法打开文件夹"),
+        tr("文件夹必须存放在根目录下"),
+        QMessageBox::Ok);
+    return QString();
   }
-  QVector<ImageFile> imageFiles = databaseHelper_.addAndQueryImageFiles(
-      paths, prefix);
+  return folderPath;
+}
+
+void MainWindow::loadFolder(const QString& folderPath, bool recursive)
+{
+  const PreferencesManager& pm = PreferencesManager::instance();
+  QString rootDir = pm.getImagesRootDirectory();
+  databaseWorker_.query([=](DatabaseHelper* databaseHelper) {
+    // Only the ids are kept, the gallery fetches the rows when shown
+    QVector<ImageFile> imageFiles =
+        databaseHelper->importFolder(rootDir, folderPath, recursive);
+    QVector<int> imageIds;
+    imageIds.reserve(imageFiles.size());
+    foreach (const ImageFile& imageFile, imageFiles) {
+      imageIds.push_back(imageFile.getImageId());
+    }
+    return imageIds;
+  }, this, [this](const QVector<int>& imageIds) {
+    openImages(imageIds);
+  });
+}
 
-  viewGalleryNavigator_->setImageFiles(imageFiles);
-  annotationGalleryNavigator_->setImageFiles(imageFiles);
+void MainWindow::openImages(const QVector<int>& imageIds)
+{
+  galleryModel_->setImageIds(imageIds);
+  if (imageIds.isEmpty()) {
+    statusBar()->showMessage(tr("没有图片"), StatusTimeout);
+    return;
+  }
   annotationGalleryNavigator_->navigate(0);
   actionModeMap_.key(ImageArea::ModeSelection)->trigger();
 }
@@ -297,12 +919,22 @@ void MainWindow::loadDatabase(const QString& filePath)
   // Save current annotation
   save();
   // Reset widgets
-  viewGalleryNavigator_->reset();
-  annotationGalleryNavigator_->reset();
+  galleryModel_->reset();
   viewArea_->reset();
   annotationArea_->reset();
+  // Drop the bboxes still being loaded from the previous database
+  ++personBBoxesRequests_[viewArea_];
+  ++personBBoxesRequests_[annotationArea_];
+  ++personCropsRequest_;
+  personCropDock_->reset();
+  resetSuggestions();
+  viewArea_->setEnabled(true);
+  annotationArea_->setEnabled(true);
+  imageCache_.clear();
   // Load new database
-  databaseHelper_.init(filePath);
+  databaseWorker_.init(filePath,
+                       PreferencesManager::instance().getConcurrentMode());
+  appearanceEngine_.reload();
   // Set this database as the default one
   PreferencesManager::instance().setDatabaseFilePath(filePath);
   setWindowTitle(tr("行人搜索标注工具 - ") + QFileInfo(filePath).fileName());
@@ -3,11 +3,20 @@
 
 #include "common/ImageFile.hpp"
 #include "common/PersonBBox.hpp"
+#include "gui/GalleryModel.h"
 #include "gui/GalleryNavigator.h"
 #include "gui/ImageArea.h"
-#include "db/DatabaseHelper.h"
+#include "gui/PersonCropDock.h"
+#include "gui/SuggestionDock.h"
+#include "db/DatabaseWorker.h"
+#include "utils/ImageCache.h"
+#include "utils/AppearanceEngine.h"
 #include <QMap>
+#include <QHash>
 #include <QMainWindow>
+#include <QFutureWatcher>
+
+class QListView;
 
 class MainWindow : public QMainWindow
 {
@@ -22,28 +31,62 @@ protected:
 
 private slots:
   void openFolder();
+  void openFolderRecursively();
+  void openAllImages();
   void openDatabase();
   void editPreferences();
   void save();
   void exportToPersonTxt();
   void exportToImageTxt();
+  void exportToBinary();
+  void validateDataset();
+  void datasetValidated();
+  void importFromPersonTxt();
+  void importFromImageTxt();
 
   void modeAction();
   void nextAction();
   void prevAction();
   void toggleHardAction();
+  void cachedRenderingAction(bool checked);
+  void traceAction(bool checked);
+  void navigationTimesAction(bool checked);
+  void exportTrace();
 
   void viewNavigateTo(int index, const ImageFile& imageFile);
   void annotationNavigateTo(int index, const ImageFile& imageFile);
+  void imageLoaded(int imageId, const QImage& image);
+  void fullResolutionNeeded(int imageId);
   void viewPersonBBoxSelected();
   void annotationPersonBBoxSelected();
+  void annotationPersonBBoxDrawn(int index);
+  void suggestionsReady(const AppearanceEngine::Matches& matches);
+  void personSuggested(int personId);
+  void annotationAreaPainted();
+  void filmstripActivated(const QModelIndex& index);
+  void galleryRowsFetched(int first, int last);
+  void personCropActivated(const PersonBBox& personBBox);
+  void preferenceChanged(const QString& key);
 
 private:
+  void applyPreferences();
   void setCodecs(const char* codec = "UTF-8");
   void createMenus();
   void createPanels();
 
-  void loadFolder(const QString& folderPath);
+  void showImage(ImageArea* imageArea, const ImageFile& imageFile);
+  void loadPersonBBoxes(ImageArea* imageArea, int imageId);
+  void showPersonCrops(int personId);
+  void loadPersonCrops(int personId);
+  void resetSuggestions();
+  void importFromTxt(const QString& filePath, bool byPerson);
+  void showExported(const QString& filePath, bool exported);
+  void prefetchNeighbors(int index);
+  void showNavigationTimes(qint64 begin, qint64 end);
+
+  QString chooseFolder();
+  void loadFolder(const QString& folderPath, bool recursive = false);
+  void openImages(const QVector<int>& imageIds);
   void loadDatabase(const QString& filePath);
 
   bool isValidFolder(const QString& root, const QString& folder);
@@ -51,13 +94,33 @@ private:
 private:
   QMap<QAction*, ImageArea::Mode> actionModeMap_;
 
+  GalleryModel* galleryModel_;
   GalleryNavigator* viewGalleryNavigator_;
   GalleryNavigator* annotationGalleryNavigator_;
+  QListView* filmstrip_;
 
   ImageArea* viewArea_;
   ImageArea* annotationArea_;
+  PersonCropDock* personCropDock_;
+  SuggestionDock* suggestionDock_;
+
+  DatabaseWorker databaseWorker_;
+  int nextProvisionalId_;
+  // Only the latest load of an image area is applied
+  QHash<ImageArea*, int> personBBoxesRequests_;
+  int personCropsRequest_;
+  ImageCache imageCache_;
+  AppearanceEngine appearanceEngine_;
+  // Bbox of the annotation area the suggestions are for, -1 if none
+  int suggestedBBoxIndex_;
+  int suggestionsRequest_;
+  // Runs off the worker, which keeps serving the loads meanwhile
+  QFutureWatcher<DatasetValidator::Report> validationWatcher_;
+  bool validating_;
 
-  DatabaseHelper databaseHelper_;
+  // Start of the navigation not painted yet while tracing, -1 if none
+  qint64 navigationBegin_;
+  bool showNavigationTimes_;
 };
 
 #endif // MAINWINDOW_H
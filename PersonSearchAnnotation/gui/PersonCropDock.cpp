@@ -0,0 +1,48 @@
+#include "gui/PersonCropDock.h"
+#include "gui/CropList.h"
+
+PersonCropDock::PersonCropDock(QWidget* parent)
+  : QDockWidget(tr("行人"), parent),
+    personId_(0)
+{
+  setObjectName("PersonCropDock");
+  cropList_ = new CropList;
+  setWidget(cropList_);
+
+  connect(cropList_, &QListWidget::itemActivated,
+          this, &PersonCropDock::itemActivated);
+}
+
+void PersonCropDock::reset()
+{
+  cropList_->reset();
+  personBBoxes_.clear();
+  personId_ = 0;
+  setWindowTitle(tr("行人"));
+}
+
+int PersonCropDock::getPersonId() const
+{
+  return personId_;
+}
+
+bool PersonCropDock::containsBBox(int bboxId) const
+{
+  return cropList_->containsBBox(bboxId);
+}
+
+void PersonCropDock::setPersonBBoxes(int personId,
+                                     const QVector<PersonBBox>& personBBoxes,
+                                     const QHash<int, ImageFile>& imageFiles)
+{
+  personId_ = personId;
+  personBBoxes_ = personBBoxes;
+  setWindowTitle(tr("行人 %1（%2 个标注框）").arg(personId)
+                 .arg(personBBoxes.size()));
+  cropList_->setPersonBBoxes(personBBoxes, imageFiles);
+}
+
+void PersonCropDock::itemActivated(QListWidgetItem* item)
+{
+  emit personBBoxActivated(personBBoxes_[item->data(Qt::UserRole).toInt()]);
+}
@@ -0,0 +1,41 @@
+#ifndef PERSONCROPDOCK_H
+#define PERSONCROPDOCK_H
+
+#include "common/ImageFile.hpp"
+#include "common/PersonBBox.hpp"
+#include <QHash>
+#include <QVector>
+#include <QDockWidget>
+
+class CropList;
+class QListWidgetItem;
+
+// Thumbnails of all the bboxes of a person
+class PersonCropDock : public QDockWidget
+{
+  Q_OBJECT
+
+public:
+  explicit PersonCropDock(QWidget* parent = 0);
+
+  void reset();
+
+  int getPersonId() const;
+  bool containsBBox(int bboxId) const;
+  void setPersonBBoxes(int personId, const QVector<PersonBBox>& personBBoxes,
+                       const QHash<int, ImageFile>& imageFiles);
+
+signals:
+  void personBBoxActivated(const PersonBBox& personBBox);
+
+private slots:
+  void itemActivated(QListWidgetItem* item);
+
+private:
+  CropList* cropList_;
+
+  int personId_;
+  QVector<PersonBBox> personBBoxes_;
+};
+
+#endif // PERSONCROPDOCK_H
@@ -1,10 +1,14 @@
 #include "gui/PreferencesDialog.h"
 #include "utils/PreferencesManager.h"
+#include <algorithm>
 #include <QIcon>
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QLabel>
 #include <QPushButton>
+#include <QGroupBox>
+#include <QFormLayout>
+#include <QThread>
 
 PreferencesDialog::PreferencesDialog(QWidget* parent)
   : QDialog(parent)
@@ -22,6 +26,11 @@ void PreferencesDialog::save()
 {
   PreferencesManager& pm = PreferencesManager::instance();
   pm.setImagesRootDirectory(imagesRootDirectory_->text());
+  pm.setConcurrentMode(concurrentMode_->isChecked());
+  pm.setImageCacheSize(imageCacheSize_->value());
+  pm.setPrefetchDepth(prefetchDepth_->value());
+  pm.setDecodingThreadCount(decodingThreadCount_->value());
+  pm.setDatabaseCacheSize(databaseCacheSize_->value());
   close();
 }
 
@@ -44,6 +53,30 @@ void PreferencesDialog::createPanels()
   connect(imagesRootDirectoryButton, &QPushButton::clicked,
           this, &PreferencesDialog::chooseImagesRoot);
 
+  // Takes effect when the database is opened next time
+  concurrentMode_ = new QCheckBox(tr("多人同时标注同一数据库（重新打开后生效）"));
+
+  // Performance knobs, applied as soon as they are saved
+  imageCacheSize_ = new QSpinBox;
+  imageCacheSize_->setRange(64, 64 * 1024);
+  imageCacheSize_->setSingleStep(64);
+  imageCacheSize_->setSuffix(" MB");
+  prefetchDepth_ = new QSpinBox;
+  prefetchDepth_->setRange(0, 16);
+  decodingThreadCount_ = new QSpinBox;
+  decodingThreadCount_->setRange(1, std::max(QThread::idealThreadCount(), 1));
+  databaseCacheSize_ = new QSpinBox;
+  databaseCacheSize_->setRange(2, 4 * 1024);
+  databaseCacheSize_->setSingleStep(16);
+  databaseCacheSize_->setSuffix(" MB");
+  QFormLayout* performanceLayout = new QFormLayout;
+  performanceLayout->addRow(tr("图片缓存大小"), imageCacheSize_);
+  performanceLayout->addRow(tr("预读图片数（每侧）"), prefetchDepth_);
+  performanceLayout->addRow(tr("解码线程数"), decodingThreadCount_);
+  performanceLayout->addRow(tr("数据库缓存大小"), databaseCacheSize_);
+  QGroupBox* performanceGroup = new QGroupBox(tr("性能"));
+  performanceGroup->setLayout(performanceLayout);
+
   QPushButton* saveButton = new QPushButton(tr("保存"));
   QPushButton* cancelButton = new QPushButton(tr("取消"));
   connect(saveButton, &QPushButton::clicked, this, &PreferencesDialog::save);
@@ -53,8 +86,10 @@ void PreferencesDialog::createPanels()
   layout->addWidget(new QLabel(tr("图片文件夹根目录")), 0, 0);
   layout->addWidget(imagesRootDirectory_, 0, 1, 1, 2);
   layout->addWidget(imagesRootDirectoryButton, 0, 3);
-  layout->addWidget(saveButton, 1, 0, 1, 2);
-  layout->addWidget(cancelButton, 1, 2, 1, 2);
+  layout->addWidget(concurrentMode_, 1, 0, 1, 4);
+  layout->addWidget(performanceGroup, 2, 0, 1, 4);
+  layout->addWidget(saveButton, 3, 0, 1, 2);
+  layout->addWidget(cancelButton, 3, 2, 1, 2);
   setLayout(layout);
 }
 
@@ -62,5 +97,10 @@ void PreferencesDialog::loadPreferences()
 {
   PreferencesManager& pm = PreferencesManager::instance();
   imagesRootDirectory_->setText(pm.getImagesRootDirectory());
+  concurrentMode_->setChecked(pm.getConcurrentMode());
+  imageCacheSize_->setValue(pm.getImageCacheSize());
+  prefetchDepth_->setValue(pm.getPrefetchDepth());
+  decodingThreadCount_->setValue(pm.getDecodingThreadCount());
+  databaseCacheSize_->setValue(pm.getDatabaseCacheSize());
 }
 
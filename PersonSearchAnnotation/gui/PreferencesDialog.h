@@ -3,6 +3,8 @@
 
 #include <QDialog>
 #include <QLineEdit>
+#include <QCheckBox>
+#include <QSpinBox>
 
 class PreferencesDialog : public QDialog
 {
@@ -17,6 +19,11 @@ public slots:
 
 private:
   QLineEdit* imagesRootDirectory_;
+  QCheckBox* concurrentMode_;
+  QSpinBox* imageCacheSize_;
+  QSpinBox* prefetchDepth_;
+  QSpinBox* decodingThreadCount_;
+  QSpinBox* databaseCacheSize_;
 
 private:
   void chooseImagesRoot();
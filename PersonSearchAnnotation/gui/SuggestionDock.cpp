@@ -0,0 +1,36 @@
+#include "gui/SuggestionDock.h"
+#include "gui/CropList.h"
+
+SuggestionDock::SuggestionDock(QWidget* parent)
+  : QDockWidget(tr("建议的行人"), parent)
+{
+  setObjectName("SuggestionDock");
+  cropList_ = new CropList;
+  setWidget(cropList_);
+
+  connect(cropList_, &QListWidget::itemActivated,
+          this, &SuggestionDock::itemActivated);
+}
+
+void SuggestionDock::reset()
+{
+  cropList_->reset();
+  personBBoxes_.clear();
+}
+
+void SuggestionDock::setSuggestions(const QVector<PersonBBox>& personBBoxes,
+                                    const QHash<int, ImageFile>& imageFiles)
+{
+  personBBoxes_ = personBBoxes;
+  QStringList personIds;
+  foreach (const PersonBBox& personBBox, personBBoxes) {
+    personIds.push_back(QString::number(personBBox.getPersonId()));
+  }
+  cropList_->setPersonBBoxes(personBBoxes, imageFiles, personIds);
+}
+
+void SuggestionDock::itemActivated(QListWidgetItem* item)
+{
+  int index = item->data(Qt::UserRole).toInt();
+  emit personSuggested(personBBoxes_[index].getPersonId());
+}
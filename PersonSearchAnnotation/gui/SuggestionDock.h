@@ -0,0 +1,39 @@
+#ifndef SUGGESTIONDOCK_H
+#define SUGGESTIONDOCK_H
+
+#include "common/ImageFile.hpp"
+#include "common/PersonBBox.hpp"
+#include <QHash>
+#include <QVector>
+#include <QDockWidget>
+
+class CropList;
+class QListWidgetItem;
+
+// Persons who look like the bbox just drawn, each shown by its closest bbox
+class SuggestionDock : public QDockWidget
+{
+  Q_OBJECT
+
+public:
+  explicit SuggestionDock(QWidget* parent = 0);
+
+  void reset();
+
+  // Nearest first, one bbox per person
+  void setSuggestions(const QVector<PersonBBox>& personBBoxes,
+                      const QHash<int, ImageFile>& imageFiles);
+
+signals:
+  void personSuggested(int personId);
+
+private slots:
+  void itemActivated(QListWidgetItem* item);
+
+private:
+  CropList* cropList_;
+
+  QVector<PersonBBox> personBBoxes_;
+};
+
+#endif // SUGGESTIONDOCK_H
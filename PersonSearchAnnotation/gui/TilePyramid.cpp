@@ -0,0 +1,91 @@
+#include "gui/TilePyramid.h"
+#include "utils/Trace.h"
+#include <cmath>
+#include <algorithm>
+#include <QPainter>
+
+static const int TileSize = 512;
+
+TilePyramid TilePyramid::build(const QImage& image)
+{
+  PSA_TRACE_SCOPE("TilePyramid::build");
+  TilePyramid pyramid;
+  if (image.isNull()) return pyramid;
+  pyramid.cacheKey_ = image.cacheKey();
+
+  QImage level = image.convertToFormat(image.hasAlphaChannel() ?
+      QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+  pyramid.levels_.push_back(makeLevel(level));
+  while (std::max(level.width(), level.height()) > TileSize) {
+    level = level.scaled(std::max(level.width() / 2, 1),
+                         std::max(level.height() / 2, 1),
+                         Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    pyramid.levels_.push_back(makeLevel(level));
+  }
+  return pyramid;
+}
+
+int TilePyramid::getLevelForScale(qreal scale) const
+{
+  if (scale <= 0 || levels_.isEmpty()) return 0;
+  // Use the smallest level which still has at least one pixel per device pixel
+  int level = static_cast<int>(std::floor(std::log(1.0 / scale) / std::log(2.0)));
+  return std::min(std::max(level, 0), levels_.size() - 1);
+}
+
+void TilePyramid::draw(QPainter* painter, const QRectF& target,
+                       const QRectF& exposed, qreal scale) const
+{
+  if (levels_.isEmpty()) return;
+  const Level& level = levels_[getLevelForScale(scale)];
+  qreal sx = target.width() / level.image.width();
+  qreal sy = target.height() / level.image.height();
+
+  QRectF visible = exposed.intersected(target);
+  if (visible.isEmpty()) return;
+  int c0 = static_cast<int>((visible.left() - target.left()) / (TileSize * sx));
+  int c1 = static_cast<int>((visible.right() - target.left()) / (TileSize * sx));
+  int r0 = static_cast<int>((visible.top() - target.top()) / (TileSize * sy));
+  int r1 = static_cast<int>((visible.bottom() - target.top()) / (TileSize * sy));
+  c0 = std::max(c0, 0);
+  r0 = std::max(r0, 0);
+  c1 = std::min(c1, level.columns - 1);
+  r1 = std::min(r1, level.rows - 1);
+
+  painter->save();
+  // Antialiased edges would leave seams between adjacent tiles
+  painter->setRenderHint(QPainter::Antialiasing, false);
+  painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+  for (int r = r0; r <= r1; ++r) {
+    for (int c = c0; c <= c1; ++c) {
+      const QImage& tile = level.tiles[r * level.columns + c];
+      QRectF rect(target.left() + c * TileSize * sx,
+                  target.top() + r * TileSize * sy,
+                  tile.width() * sx, tile.height() * sy);
+      painter->drawImage(rect, tile);
+    }
+  }
+  painter->restore();
+}
+
+TilePyramid::Level TilePyramid::makeLevel(const QImage& image)
+{
+  Level level;
+  level.image = image;
+  level.columns = (image.width() + TileSize - 1) / TileSize;
+  level.rows = (image.height() + TileSize - 1) / TileSize;
+  const uchar* bits = level.image.constBits();
+  int bytesPerLine = level.image.bytesPerLine();
+  int bytesPerPixel = level.image.depth() / 8;
+  for (int r = 0; r < level.rows; ++r) {
+    for (int c = 0; c < level.columns; ++c) {
+      int x = c * TileSize;
+      int y = r * TileSize;
+      int w = std::min(TileSize, image.width() - x);
+      int h = std::min(TileSize, image.height() - y);
+      level.tiles.push_back(QImage(bits + y * bytesPerLine + x * bytesPerPixel,
+                                   w, h, bytesPerLine, image.format()));
+    }
+  }
+  return level;
+}
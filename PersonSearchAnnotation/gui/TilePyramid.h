@@ -0,0 +1,47 @@
+#ifndef TILEPYRAMID_H
+#define TILEPYRAMID_H
+
+#include <QVector>
+#include <QImage>
+#include <QRectF>
+
+class QPainter;
+
+class TilePyramid
+{
+public:
+  TilePyramid() : cacheKey_(0) {}
+  ~TilePyramid() {}
+
+  // Heavy. Safe to be called from a worker thread.
+  static TilePyramid build(const QImage& image);
+
+  bool isNull() const { return levels_.isEmpty(); }
+
+  // Cache key of the image this pyramid is built from
+  inline qint64 getCacheKey() const { return cacheKey_; }
+
+  int getLevelCount() const { return levels_.size(); }
+  int getLevelForScale(qreal scale) const;
+
+  void draw(QPainter* painter, const QRectF& target, const QRectF& exposed,
+            qreal scale) const;
+
+private:
+  struct Level
+  {
+    QImage image;
+    int columns;
+    int rows;
+    // Tiles share the pixels of the level image
+    QVector<QImage> tiles;
+  };
+
+  static Level makeLevel(const QImage& image);
+
+private:
+  qint64 cacheKey_;
+  QVector<Level> levels_;
+};
+
+#endif // TILEPYRAMID_H
@@ -0,0 +1,67 @@
+#include "utils/util_functions.h"
+#include <QtTest>
+#include <QDir>
+#include <QDateTime>
+#include <QFile>
+#include <QTemporaryDir>
+
+class UtilFunctionsTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void listImageFilesRecursivelySkipsLinkLoops();
+  void trimDirectoryRemovesOldestFiles();
+};
+
+void UtilFunctionsTest::listImageFilesRecursivelySkipsLinkLoops()
+{
+#ifdef Q_OS_UNIX
+  QTemporaryDir temporaryDir;
+  QVERIFY(temporaryDir.isValid());
+  QDir root(temporaryDir.path());
+  QVERIFY(root.mkpath("a/b"));
+  QFile image(root.filePath("a/b/1.jpg"));
+  QVERIFY(image.open(QIODevice::WriteOnly));
+  image.close();
+  // a/b/loop -> .., which leads back to a
+  QVERIFY(QFile::link("..", root.filePath("a/b/loop")));
+
+  QStringList imageFilePaths;
+  psa::listImageFilesRecursively(root.filePath("a"), &imageFilePaths, 4);
+  QCOMPARE(imageFilePaths.size(), 1);
+  QVERIFY(imageFilePaths.first().endsWith("/1.jpg"));
+#else
+  QSKIP("Needs symlinks");
+#endif
+}
+
+void UtilFunctionsTest::trimDirectoryRemovesOldestFiles()
+{
+  QTemporaryDir temporaryDir;
+  QVERIFY(temporaryDir.isValid());
+  QDir root(temporaryDir.path());
+  QVERIFY(root.mkpath("a"));
+  QDateTime now = QDateTime::currentDateTime();
+  const char* const names[] = {"a/old", "new", "a/newest"};
+  for (int i = 0; i < 3; ++i) {
+    QFile file(root.filePath(names[i]));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(QByteArray(100, 'x')), qint64(100));
+    QVERIFY(file.setFileTime(now.addSecs(i - 3),
+                             QFileDevice::FileModificationTime));
+  }
+
+  // Under the limit
+  psa::trimDirectory(root.path(), 300, 100);
+  QVERIFY(root.exists("a/old"));
+
+  psa::trimDirectory(root.path(), 250, 150);
+  QVERIFY(!root.exists("a/old"));
+  QVERIFY(!root.exists("new"));
+  QVERIFY(root.exists("a/newest"));
+}
+
+QTEST_APPLESS_MAIN(UtilFunctionsTest)
+
+#include "UtilFunctionsTest.moc"
@@ -0,0 +1,14 @@
+QT += core gui sql testlib
+
+QMAKE_MAC_SDK = macosx10.11
+
+TARGET = psa-tests
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+include(../core.pri)
+
+SOURCES += \
+  UtilFunctionsTest.cpp
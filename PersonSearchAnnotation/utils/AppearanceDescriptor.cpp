@@ -0,0 +1,89 @@
+#include "utils/AppearanceDescriptor.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <QColor>
+
+// Crops are resampled to this size before being described
+static const int CropWidth = 32;
+static const int CropHeight = 64;
+// Pixels darker or less saturated than these have no reliable hue
+static const int MinColoredValue = 48;
+static const int MinColoredSaturation = 64;
+// Color tells persons apart better than texture
+static const float ColorScale = 255.0f;
+static const float TextureScale = 128.0f;
+
+static const float Pi = 3.14159265f;
+
+static void quantize(const float* bins, int numBins, float scale, char* out)
+{
+  float sum = 0;
+  for (int i = 0; i < numBins; ++i) {
+    sum += bins[i];
+  }
+  for (int i = 0; i < numBins; ++i) {
+    float value = sum > 0 ? scale * std::sqrt(bins[i] / sum) : 0;
+    out[i] = static_cast<char>(
+        static_cast<unsigned char>(std::min(255.0f, value + 0.5f)));
+  }
+}
+
+QByteArray AppearanceDescriptor::compute(const QImage& image,
+                                         const QRect& rect)
+{
+  QRect cropRect = rect & image.rect();
+  if (cropRect.isEmpty()) return QByteArray();
+  QImage crop = image.copy(cropRect)
+      .scaled(CropWidth, CropHeight, Qt::IgnoreAspectRatio,
+              Qt::SmoothTransformation)
+      .convertToFormat(QImage::Format_RGB32);
+
+  float colors[NumStripes][NumHueBins + NumLightnessBins] = {};
+  float orientations[NumStripes][NumOrientationBins] = {};
+  int grays[CropHeight][CropWidth];
+  for (int y = 0; y < CropHeight; ++y) {
+    const QRgb* line = reinterpret_cast<const QRgb*>(crop.constScanLine(y));
+    float* stripeColors = colors[y * NumStripes / CropHeight];
+    for (int x = 0; x < CropWidth; ++x) {
+      QRgb rgb = line[x];
+      grays[y][x] = qGray(rgb);
+      int value = std::max(qRed(rgb), std::max(qGreen(rgb), qBlue(rgb)));
+      int minimum = std::min(qRed(rgb), std::min(qGreen(rgb), qBlue(rgb)));
+      int chroma = value - minimum;
+      if (value < MinColoredValue ||
+          chroma * 255 < MinColoredSaturation * value) {
+        stripeColors[NumHueBins + value * NumLightnessBins / 256] += 1;
+      } else {
+        // Bins are centered on red, which wraps around
+        int hue = QColor(rgb).hsvHue();
+        int binWidth = 360 / NumHueBins;
+        stripeColors[(hue + binWidth / 2) / binWidth % NumHueBins] += 1;
+      }
+    }
+  }
+  for (int y = 1; y < CropHeight - 1; ++y) {
+    float* stripeOrientations = orientations[y * NumStripes / CropHeight];
+    for (int x = 1; x < CropWidth - 1; ++x) {
+      int dx = grays[y][x + 1] - grays[y][x - 1];
+      int dy = grays[y + 1][x] - grays[y - 1][x];
+      int magnitude = std::abs(dx) + std::abs(dy);
+      if (magnitude == 0) continue;
+      // Orientations are folded into [0, pi), bins centered on the axes
+      float angle = std::atan2(static_cast<float>(dy), static_cast<float>(dx));
+      if (angle < 0) angle += Pi;
+      int bin = static_cast<int>(angle * NumOrientationBins / Pi + 0.5f);
+      stripeOrientations[bin % NumOrientationBins] += magnitude;
+    }
+  }
+
+  QByteArray descriptor(Size, 0);
+  char* out = descriptor.data();
+  for (int stripe = 0; stripe < NumStripes; ++stripe) {
+    quantize(colors[stripe], NumHueBins + NumLightnessBins, ColorScale, out);
+    out += NumHueBins + NumLightnessBins;
+    quantize(orientations[stripe], NumOrientationBins, TextureScale, out);
+    out += NumOrientationBins;
+  }
+  return descriptor;
+}
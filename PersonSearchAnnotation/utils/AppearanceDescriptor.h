@@ -0,0 +1,31 @@
+#ifndef APPEARANCEDESCRIPTOR_H
+#define APPEARANCEDESCRIPTOR_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+
+// Compact color and texture signature of a person crop. The crop is cut into
+// horizontal stripes, roughly head, torso, thighs and legs. Each stripe has a
+// histogram of the hues of its colored pixels and the lightness of its gray
+// ones, then a histogram of its gradient orientations. Bins hold the square
+// roots of the frequencies scaled to bytes, so that the L1 distance of two
+// descriptors follows the Hellinger distance of their histograms.
+class AppearanceDescriptor
+{
+public:
+  static const int NumStripes = 4;
+  static const int NumHueBins = 8;
+  static const int NumLightnessBins = 4;
+  static const int NumOrientationBins = 4;
+  static const int NumBinsPerStripe =
+      NumHueBins + NumLightnessBins + NumOrientationBins;
+  // In bytes
+  static const int Size = NumStripes * NumBinsPerStripe;
+
+public:
+  // Describes the part of image in rect, empty if they do not overlap
+  static QByteArray compute(const QImage& image, const QRect& rect);
+};
+
+#endif // APPEARANCEDESCRIPTOR_H
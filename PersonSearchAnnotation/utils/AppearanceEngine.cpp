@@ -0,0 +1,207 @@
+#include "utils/AppearanceEngine.h"
+#include "utils/AppearanceDescriptor.h"
+#include "utils/PreferencesManager.h"
+#include "utils/Trace.h"
+#include "db/DatabaseWorker.h"
+#include <algorithm>
+#include <QDir>
+#include <QPair>
+#include <QImageReader>
+#include <QtConcurrent>
+
+// Images whose bboxes are looked up at once
+static const int ImagesPerBatch = 64;
+// Images are decoded at reduced size as long as their smallest bboxes keep
+// this height, well above the size descriptors are made at
+static const int MinDecodedBBoxHeight = 128;
+
+AppearanceEngine::AppearanceEngine(DatabaseWorker* databaseWorker,
+                                   QObject* parent)
+  : QObject(parent),
+    databaseWorker_(databaseWorker),
+    describing_(false),
+    describingGeneration_(0),
+    generation_(0)
+{
+  indexThreadPool_.setMaxThreadCount(1);
+  // Decoding runs in the background, leaving the cores to the GUI
+  describeThreadPool_.setMaxThreadCount(1);
+  connect(&searchWatcher_, &QFutureWatcher<Matches>::finished,
+          this, &AppearanceEngine::searched);
+  connect(&describeWatcher_, &QFutureWatcher<DescribedBatch>::finished,
+          this, &AppearanceEngine::described);
+}
+
+AppearanceEngine::~AppearanceEngine()
+{
+  // The tasks refer to this
+  indexThreadPool_.clear();
+  indexThreadPool_.waitForDone();
+  describeThreadPool_.waitForDone();
+}
+
+void AppearanceEngine::reload()
+{
+  int generation = ++generation_;
+  pendingImageIds_.clear();
+  typedef QPair<AppearanceIndex, QVector<int> > Loaded;
+  databaseWorker_->query([](DatabaseHelper* databaseHelper) {
+    return qMakePair(databaseHelper->loadAppearanceIndex(),
+                     databaseHelper->getImageIds());
+  }, this, [this, generation](const Loaded& loaded) {
+    if (generation != generation_) return;
+    AppearanceIndex index = loaded.first;
+    QtConcurrent::run(&indexThreadPool_, [this, index]() {
+      index_ = index;
+    });
+    pendingImageIds_ = loaded.second.toList();
+    describeNext();
+  });
+}
+
+void AppearanceEngine::update(int imageId,
+                              const QVector<int>& removedBBoxIds)
+{
+  if (!removedBBoxIds.isEmpty()) {
+    QtConcurrent::run(&indexThreadPool_, [this, removedBBoxIds]() {
+      foreach (int bboxId, removedBBoxIds) {
+        index_.remove(bboxId);
+      }
+    });
+  }
+  // The persons may have changed, the new and moved bboxes are described
+  // ahead of the others
+  int generation = generation_;
+  databaseWorker_->query([imageId](DatabaseHelper* databaseHelper) {
+    return databaseHelper->getPersonBBoxesByImageId(imageId);
+  }, this, [this, generation](const QVector<PersonBBox>& personBBoxes) {
+    if (generation != generation_) return;
+    QtConcurrent::run(&indexThreadPool_, [this, personBBoxes]() {
+      foreach (const PersonBBox& personBBox, personBBoxes) {
+        index_.setPersonId(personBBox.getBBoxId(), personBBox.getPersonId());
+      }
+    });
+  });
+  pendingImageIds_.removeOne(imageId);
+  pendingImageIds_.prepend(imageId);
+  describeNext();
+}
+
+void AppearanceEngine::suggest(const QImage& image, const QRect& rect,
+                               const QSet<int>& excludedPersonIds,
+                               int maxCount)
+{
+  searchWatcher_.setFuture(QtConcurrent::run(&indexThreadPool_,
+      [this, image, rect, excludedPersonIds, maxCount]() {
+    return index_.search(AppearanceDescriptor::compute(image, rect),
+                         maxCount, excludedPersonIds);
+  }));
+}
+
+void AppearanceEngine::searched()
+{
+  emit suggestionsReady(searchWatcher_.result());
+}
+
+void AppearanceEngine::described()
+{
+  describing_ = false;
+  DescribedBatch batch = describeWatcher_.result();
+  if (describingGeneration_ == generation_) {
+    databaseWorker_->post([batch](DatabaseHelper* databaseHelper) {
+      databaseHelper->saveDescriptors(batch.personBBoxes, batch.descriptors);
+    });
+    QtConcurrent::run(&indexThreadPool_, [this, batch]() {
+      for (int i = 0; i < batch.personBBoxes.size(); ++i) {
+        const PersonBBox& personBBox = batch.personBBoxes[i];
+        index_.insert(personBBox.getBBoxId(), personBBox.getPersonId(),
+                      batch.descriptors[i]);
+      }
+    });
+  }
+  describeNext();
+}
+
+void AppearanceEngine::describeNext()
+{
+  if (describing_ || pendingImageIds_.isEmpty()) return;
+  describing_ = true;
+  QVector<int> imageIds;
+  while (imageIds.size() < ImagesPerBatch && !pendingImageIds_.isEmpty()) {
+    imageIds.push_back(pendingImageIds_.takeFirst());
+  }
+  typedef QPair<QVector<PersonBBox>, QHash<int, ImageFile> > Undescribed;
+  int generation = generation_;
+  databaseWorker_->query([imageIds](DatabaseHelper* databaseHelper) {
+    QVector<PersonBBox> personBBoxes =
+        databaseHelper->getUndescribedPersonBBoxes(imageIds);
+    QVector<int> undescribedImageIds;
+    foreach (const PersonBBox& personBBox, personBBoxes) {
+      if (undescribedImageIds.isEmpty() ||
+          undescribedImageIds.last() != personBBox.getImageId()) {
+        undescribedImageIds.push_back(personBBox.getImageId());
+      }
+    }
+    return qMakePair(personBBoxes,
+                     databaseHelper->getImageFilesByIds(undescribedImageIds));
+  }, this, [this, generation](const Undescribed& undescribed) {
+    if (generation != generation_ || undescribed.first.isEmpty()) {
+      describing_ = false;
+      describeNext();
+      return;
+    }
+    describingGeneration_ = generation;
+    describeWatcher_.setFuture(QtConcurrent::run(
+        &describeThreadPool_, &AppearanceEngine::describe,
+        PreferencesManager::instance().getImagesRootDirectory(),
+        undescribed.first, undescribed.second));
+  });
+}
+
+AppearanceEngine::DescribedBatch AppearanceEngine::describe(
+    const QString& rootDir, const QVector<PersonBBox>& personBBoxes,
+    const QHash<int, ImageFile>& imageFiles)
+{
+  PSA_TRACE_SCOPE("AppearanceEngine::describe");
+  DescribedBatch batch;
+  batch.personBBoxes = personBBoxes;
+  batch.descriptors.resize(personBBoxes.size());
+  QDir root(rootDir);
+  // The bboxes come grouped by image, each image is decoded once
+  int begin = 0;
+  while (begin < personBBoxes.size()) {
+    int imageId = personBBoxes[begin].getImageId();
+    int end = begin;
+    int minHeight = personBBoxes[begin].height();
+    while (end < personBBoxes.size() &&
+           personBBoxes[end].getImageId() == imageId) {
+      minHeight = std::min(minHeight, personBBoxes[end].height());
+      ++end;
+    }
+    ImageFile imageFile = imageFiles.value(imageId);
+    QImageReader imageReader(root.filePath(imageFile.getPath()));
+    imageReader.setAutoTransform(true);
+    qreal scale = 1.0;
+    if (imageFile.hasSize() && minHeight > MinDecodedBBoxHeight) {
+      scale = static_cast<qreal>(MinDecodedBBoxHeight) / minHeight;
+      QSize scaledSize = imageFile.getDisplaySize() * scale;
+      // QImageReader scales before applying the orientation
+      if (imageFile.getOrientation() &
+          QImageIOHandler::TransformationRotate90) {
+        scaledSize.transpose();
+      }
+      imageReader.setScaledSize(scaledSize.expandedTo(QSize(1, 1)));
+    }
+    QImage image = imageReader.read();
+    for (int i = begin; !image.isNull() && i < end; ++i) {
+      const PersonBBox& personBBox = personBBoxes[i];
+      QRect rect(qRound(personBBox.x() * scale),
+                 qRound(personBBox.y() * scale),
+                 qRound(personBBox.width() * scale),
+                 qRound(personBBox.height() * scale));
+      batch.descriptors[i] = AppearanceDescriptor::compute(image, rect);
+    }
+    begin = end;
+  }
+  return batch;
+}
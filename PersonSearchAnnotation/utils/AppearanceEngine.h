@@ -0,0 +1,85 @@
+#ifndef APPEARANCEENGINE_H
+#define APPEARANCEENGINE_H
+
+#include "common/ImageFile.hpp"
+#include "common/PersonBBox.hpp"
+#include "utils/AppearanceIndex.h"
+#include <QObject>
+#include <QImage>
+#include <QRect>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QVector>
+#include <QThreadPool>
+#include <QFutureWatcher>
+
+class DatabaseWorker;
+
+// Suggests the persons of new bboxes by their appearance. Every bbox of the
+// database is described in background, image by image, and the descriptors
+// are stored so that only new and moved bboxes are described again. The
+// index is touched by one thread, which serves the searches in turn.
+class AppearanceEngine : public QObject
+{
+  Q_OBJECT
+
+public:
+  typedef QVector<AppearanceIndex::Match> Matches;
+
+  struct DescribedBatch
+  {
+    QVector<PersonBBox> personBBoxes;
+    // Empty for the bboxes outside their images
+    QVector<QByteArray> descriptors;
+  };
+
+public:
+  explicit AppearanceEngine(DatabaseWorker* databaseWorker,
+                            QObject* parent = 0);
+  ~AppearanceEngine();
+
+  // Loads the index of the database opened in the worker, then describes
+  // the bboxes missing from it
+  void reload();
+  // After the bboxes of an image have been saved
+  void update(int imageId, const QVector<int>& removedBBoxIds);
+
+  // Ranks the persons for the part of image in rect. Only the latest
+  // request emits suggestionsReady.
+  void suggest(const QImage& image, const QRect& rect,
+               const QSet<int>& excludedPersonIds, int maxCount);
+
+signals:
+  void suggestionsReady(const AppearanceEngine::Matches& matches);
+
+private slots:
+  void searched();
+  void described();
+
+private:
+  void describeNext();
+
+  static DescribedBatch describe(const QString& rootDir,
+                                 const QVector<PersonBBox>& personBBoxes,
+                                 const QHash<int, ImageFile>& imageFiles);
+
+private:
+  DatabaseWorker* databaseWorker_;
+
+  // Runs the tasks on index_ one by one, in order
+  QThreadPool indexThreadPool_;
+  AppearanceIndex index_;
+  QFutureWatcher<Matches> searchWatcher_;
+
+  QThreadPool describeThreadPool_;
+  QFutureWatcher<DescribedBatch> describeWatcher_;
+  // Images left to describe, the updated ones first
+  QList<int> pendingImageIds_;
+  bool describing_;
+  int describingGeneration_;
+  // Bumped by every reload
+  int generation_;
+};
+
+#endif // APPEARANCEENGINE_H
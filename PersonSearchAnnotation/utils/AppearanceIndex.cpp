@@ -0,0 +1,266 @@
+#include "utils/AppearanceIndex.h"
+#include "utils/AppearanceDescriptor.h"
+#include "utils/Trace.h"
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PSA_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Rows whose distances are computed at once, small enough for the stack
+static const int BlockSize = 1024;
+
+static_assert(AppearanceDescriptor::Size == 64,
+              "The distance kernels are unrolled for 64-byte descriptors");
+
+// L1 distances between query and count descriptors stored back to back
+typedef void (*DistanceKernel)(const quint8* query, const quint8* rows,
+                               int count, int* distances);
+
+#ifndef PSA_X86_64
+
+static void computeDistancesScalar(const quint8* query, const quint8* rows,
+                                   int count, int* distances)
+{
+  for (int i = 0; i < count; ++i) {
+    const quint8* row = rows + i * AppearanceDescriptor::Size;
+    int distance = 0;
+    for (int j = 0; j < AppearanceDescriptor::Size; ++j) {
+      distance += std::abs(query[j] - row[j]);
+    }
+    distances[i] = distance;
+  }
+}
+
+#else
+
+// SSE2 is part of x86-64
+static void computeDistancesSse2(const quint8* query, const quint8* rows,
+                                 int count, int* distances)
+{
+  const __m128i* q = reinterpret_cast<const __m128i*>(query);
+  __m128i q0 = _mm_loadu_si128(q);
+  __m128i q1 = _mm_loadu_si128(q + 1);
+  __m128i q2 = _mm_loadu_si128(q + 2);
+  __m128i q3 = _mm_loadu_si128(q + 3);
+  for (int i = 0; i < count; ++i) {
+    const __m128i* r = reinterpret_cast<const __m128i*>(
+        rows + i * AppearanceDescriptor::Size);
+    // Each sad sums the absolute differences of two halves of 8 bytes
+    __m128i sum = _mm_add_epi64(_mm_sad_epu8(q0, _mm_loadu_si128(r)),
+                                _mm_sad_epu8(q1, _mm_loadu_si128(r + 1)));
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(q2, _mm_loadu_si128(r + 2)));
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(q3, _mm_loadu_si128(r + 3)));
+    sum = _mm_add_epi64(sum, _mm_srli_si128(sum, 8));
+    distances[i] = _mm_cvtsi128_si32(sum);
+  }
+}
+
+#ifndef _MSC_VER
+__attribute__((target("avx2")))
+#endif
+static void computeDistancesAvx2(const quint8* query, const quint8* rows,
+                                 int count, int* distances)
+{
+  const __m256i* q = reinterpret_cast<const __m256i*>(query);
+  __m256i q0 = _mm256_loadu_si256(q);
+  __m256i q1 = _mm256_loadu_si256(q + 1);
+  for (int i = 0; i < count; ++i) {
+    const __m256i* r = reinterpret_cast<const __m256i*>(
+        rows + i * AppearanceDescriptor::Size);
+    __m256i sum = _mm256_add_epi64(
+        _mm256_sad_epu8(q0, _mm256_loadu_si256(r)),
+        _mm256_sad_epu8(q1, _mm256_loadu_si256(r + 1)));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi64(half, _mm_srli_si128(half, 8));
+    distances[i] = _mm_cvtsi128_si32(half);
+  }
+}
+
+static bool hasAvx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  // The OS must save the AVX registers too
+  const int OsxsaveAvx = (1 << 27) | (1 << 28);
+  if ((info[2] & OsxsaveAvx) != OsxsaveAvx) return false;
+  if ((_xgetbv(0) & 0x6) != 0x6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // PSA_X86_64
+
+struct Kernel
+{
+  DistanceKernel function;
+  const char* name;
+};
+
+static Kernel selectKernel()
+{
+  Kernel kernel;
+#ifdef PSA_X86_64
+  if (hasAvx2()) {
+    kernel.function = computeDistancesAvx2;
+    kernel.name = "avx2";
+  } else {
+    kernel.function = computeDistancesSse2;
+    kernel.name = "sse2";
+  }
+#else
+  kernel.function = computeDistancesScalar;
+  kernel.name = "scalar";
+#endif
+  return kernel;
+}
+
+static const Kernel& getKernel()
+{
+  static const Kernel kernel = selectKernel();
+  return kernel;
+}
+
+AppearanceIndex::AppearanceIndex()
+{
+
+}
+
+int AppearanceIndex::size() const
+{
+  return bboxIds_.size();
+}
+
+void AppearanceIndex::reserve(int size)
+{
+  descriptors_.reserve(size * AppearanceDescriptor::Size);
+  bboxIds_.reserve(size);
+  personIds_.reserve(size);
+  rows_.reserve(size);
+}
+
+void AppearanceIndex::clear()
+{
+  descriptors_.clear();
+  bboxIds_.clear();
+  personIds_.clear();
+  rows_.clear();
+}
+
+void AppearanceIndex::insert(int bboxId, int personId,
+                             const QByteArray& descriptor)
+{
+  if (descriptor.size() != AppearanceDescriptor::Size) return;
+  const quint8* bins = reinterpret_cast<const quint8*>(descriptor.constData());
+  QHash<int, int>::const_iterator it = rows_.constFind(bboxId);
+  if (it != rows_.constEnd()) {
+    int row = it.value();
+    personIds_[row] = personId;
+    std::copy(bins, bins + AppearanceDescriptor::Size,
+              descriptors_.begin() + row * AppearanceDescriptor::Size);
+    return;
+  }
+  int row = bboxIds_.size();
+  rows_.insert(bboxId, row);
+  bboxIds_.push_back(bboxId);
+  personIds_.push_back(personId);
+  descriptors_.resize((row + 1) * AppearanceDescriptor::Size);
+  std::copy(bins, bins + AppearanceDescriptor::Size,
+            descriptors_.begin() + row * AppearanceDescriptor::Size);
+}
+
+void AppearanceIndex::remove(int bboxId)
+{
+  QHash<int, int>::iterator it = rows_.find(bboxId);
+  if (it == rows_.end()) return;
+  int row = it.value();
+  rows_.erase(it);
+  // Move the last row into the hole
+  int last = bboxIds_.size() - 1;
+  if (row != last) {
+    bboxIds_[row] = bboxIds_[last];
+    personIds_[row] = personIds_[last];
+    std::copy(descriptors_.constBegin() + last * AppearanceDescriptor::Size,
+              descriptors_.constEnd(),
+              descriptors_.begin() + row * AppearanceDescriptor::Size);
+    rows_[bboxIds_[row]] = row;
+  }
+  bboxIds_.resize(last);
+  personIds_.resize(last);
+  descriptors_.resize(last * AppearanceDescriptor::Size);
+}
+
+void AppearanceIndex::setPersonId(int bboxId, int personId)
+{
+  QHash<int, int>::const_iterator it = rows_.constFind(bboxId);
+  if (it != rows_.constEnd()) personIds_[it.value()] = personId;
+}
+
+QVector<AppearanceIndex::Match> AppearanceIndex::search(
+    const QByteArray& descriptor, int maxCount,
+    const QSet<int>& excludedPersonIds) const
+{
+  PSA_TRACE_SCOPE("AppearanceIndex::search");
+  QVector<Match> matches;
+  if (descriptor.size() != AppearanceDescriptor::Size || maxCount <= 0) {
+    return matches;
+  }
+  matches.reserve(maxCount + 1);
+  const quint8* query = reinterpret_cast<const quint8*>(descriptor.constData());
+  DistanceKernel computeDistances = getKernel().function;
+  int distances[BlockSize];
+  for (int begin = 0; begin < bboxIds_.size(); begin += BlockSize) {
+    int count = std::min(BlockSize, bboxIds_.size() - begin);
+    computeDistances(
+        query, descriptors_.constData() + begin * AppearanceDescriptor::Size,
+        count, distances);
+    for (int i = 0; i < count; ++i) {
+      int distance = distances[i];
+      // Most rows stop here once the matches are full
+      if (matches.size() == maxCount &&
+          distance >= matches.last().distance) {
+        continue;
+      }
+      int row = begin + i;
+      int personId = personIds_[row];
+      if (personId <= 0 || excludedPersonIds.contains(personId)) continue;
+      // One match per person, by its closest bbox
+      int k = 0;
+      while (k < matches.size() && matches[k].personId != personId) ++k;
+      if (k < matches.size()) {
+        if (distance >= matches[k].distance) continue;
+        matches.remove(k);
+      } else if (matches.size() == maxCount) {
+        matches.removeLast();
+      }
+      Match match;
+      match.personId = personId;
+      match.bboxId = bboxIds_[row];
+      match.distance = distance;
+      int position = 0;
+      while (position < matches.size() &&
+             matches[position].distance <= distance) {
+        ++position;
+      }
+      matches.insert(position, match);
+    }
+  }
+  return matches;
+}
+
+const char* AppearanceIndex::getKernelName()
+{
+  return getKernel().name;
+}
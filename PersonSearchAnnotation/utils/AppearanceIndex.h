@@ -0,0 +1,53 @@
+#ifndef APPEARANCEINDEX_H
+#define APPEARANCEINDEX_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+
+// Appearance descriptors of the bboxes, searched by brute force. They are
+// kept back to back in one array, which the distance kernel streams through
+// with SSE2 or AVX2 as the processor allows, picked at run time.
+class AppearanceIndex
+{
+public:
+  struct Match
+  {
+    Match() : personId(0), bboxId(0), distance(0) {}
+
+    int personId;
+    // The bbox of the person closest to the query
+    int bboxId;
+    int distance;
+  };
+
+public:
+  AppearanceIndex();
+
+  int size() const;
+  void reserve(int size);
+  void clear();
+
+  // Replaces the descriptor of the bbox if it has one already
+  void insert(int bboxId, int personId, const QByteArray& descriptor);
+  void remove(int bboxId);
+  void setPersonId(int bboxId, int personId);
+
+  // The persons closest to descriptor by their closest bboxes, nearest
+  // first. Bboxes of no person are left out.
+  QVector<Match> search(const QByteArray& descriptor, int maxCount,
+                        const QSet<int>& excludedPersonIds = QSet<int>()) const;
+
+  // Instruction set of the distance kernel, such as "avx2"
+  static const char* getKernelName();
+
+private:
+  QVector<quint8> descriptors_;
+  QVector<int> bboxIds_;
+  QVector<int> personIds_;
+  // Rows by bbox id
+  QHash<int, int> rows_;
+};
+
+#endif // APPEARANCEINDEX_H
@@ -0,0 +1,80 @@
+#include "utils/BufferedReader.h"
+#include <cstring>
+#include <QFile>
+#include <QFileInfo>
+
+BufferedReader::BufferedReader(int capacity)
+  : file_(NULL),
+    buffer_(capacity),
+    begin_(0),
+    end_(0),
+    eof_(false),
+    position_(0),
+    fileSize_(0)
+{
+
+}
+
+BufferedReader::~BufferedReader()
+{
+  close();
+}
+
+bool BufferedReader::open(const QString& filePath)
+{
+  close();
+  file_ = fopen(QFile::encodeName(filePath).constData(), "rb");
+  if (file_ != NULL) fileSize_ = QFileInfo(filePath).size();
+  return file_ != NULL;
+}
+
+void BufferedReader::close()
+{
+  if (file_ != NULL) fclose(file_);
+  file_ = NULL;
+  begin_ = 0;
+  end_ = 0;
+  eof_ = false;
+  position_ = 0;
+  fileSize_ = 0;
+}
+
+bool BufferedReader::readLine(const char** line, int* size)
+{
+  if (file_ == NULL) return false;
+  char* newline = NULL;
+  while (true) {
+    newline = static_cast<char*>(
+        memchr(&buffer_[0] + begin_, '\n', end_ - begin_));
+    if (newline != NULL || eof_) break;
+    if (!fill()) break;
+  }
+  int lineEnd = newline ? static_cast<int>(newline - &buffer_[0]) : end_;
+  if (newline == NULL && lineEnd == begin_) return false;
+
+  *line = &buffer_[0] + begin_;
+  *size = lineEnd - begin_;
+  // Files written on Windows end their lines with CRLF
+  if (*size > 0 && (*line)[*size - 1] == '\r') --*size;
+  int next = newline ? lineEnd + 1 : lineEnd;
+  position_ += next - begin_;
+  begin_ = next;
+  return true;
+}
+
+bool BufferedReader::fill()
+{
+  // Keep the partial line at the front of the buffer
+  int pending = end_ - begin_;
+  if (pending == static_cast<int>(buffer_.size())) {
+    // A line longer than the buffer
+    buffer_.resize(buffer_.size() * 2);
+  }
+  memmove(&buffer_[0], &buffer_[0] + begin_, pending);
+  begin_ = 0;
+  end_ = pending;
+  size_t n = fread(&buffer_[0] + end_, 1, buffer_.size() - end_, file_);
+  end_ += static_cast<int>(n);
+  if (n == 0) eof_ = true;
+  return n > 0;
+}
@@ -0,0 +1,43 @@
+#ifndef BUFFEREDREADER_H
+#define BUFFEREDREADER_H
+
+#include <cstdio>
+#include <vector>
+#include <QString>
+
+class BufferedReader
+{
+public:
+  explicit BufferedReader(int capacity = 1 << 20);
+  ~BufferedReader();
+
+  bool open(const QString& filePath);
+  void close();
+
+  inline bool isOpen() const { return file_ != NULL; }
+
+  // Points line to the next line without the line break, valid until the
+  // next call. The buffer grows to hold lines longer than it.
+  bool readLine(const char** line, int* size);
+
+  // Bytes consumed so far, for progress reports
+  inline qint64 getPosition() const { return position_; }
+  inline qint64 getFileSize() const { return fileSize_; }
+
+private:
+  BufferedReader(const BufferedReader&);
+  const BufferedReader& operator = (const BufferedReader&);
+
+  bool fill();
+
+private:
+  FILE* file_;
+  std::vector<char> buffer_;
+  int begin_;
+  int end_;
+  bool eof_;
+  qint64 position_;
+  qint64 fileSize_;
+};
+
+#endif // BUFFEREDREADER_H
@@ -0,0 +1,74 @@
+#include "utils/BufferedWriter.h"
+#include "utils/util_functions.h"
+#include <cstring>
+#include <QFile>
+
+BufferedWriter::BufferedWriter(int capacity)
+  : file_(NULL),
+    buffer_(capacity),
+    size_(0),
+    failed_(false)
+{
+
+}
+
+BufferedWriter::~BufferedWriter()
+{
+  close();
+}
+
+bool BufferedWriter::open(const QString& filePath, bool binary)
+{
+  close();
+  file_ = fopen(QFile::encodeName(filePath).constData(), binary ? "wb" : "w");
+  failed_ = false;
+  return file_ != NULL;
+}
+
+bool BufferedWriter::close()
+{
+  if (file_ == NULL) return false;
+  bool ok = flush();
+  ok = fclose(file_) == 0 && ok;
+  file_ = NULL;
+  return ok;
+}
+
+void BufferedWriter::write(const char* data, int size)
+{
+  if (size_ + size > static_cast<int>(buffer_.size())) {
+    flush();
+    // Too large to be buffered at all
+    if (size > static_cast<int>(buffer_.size())) {
+      if (file_ == NULL ||
+          static_cast<int>(fwrite(data, 1, size, file_)) != size) {
+        failed_ = true;
+      }
+      return;
+    }
+  }
+  memcpy(&buffer_[size_], data, size);
+  size_ += size;
+}
+
+void BufferedWriter::write(char c)
+{
+  if (size_ == static_cast<int>(buffer_.size())) flush();
+  buffer_[size_++] = c;
+}
+
+void BufferedWriter::writeNumber(int value)
+{
+  char text[16];
+  write(text, psa::formatNumber(value, text));
+}
+
+bool BufferedWriter::flush()
+{
+  if (file_ == NULL) return false;
+  if (static_cast<int>(fwrite(&buffer_[0], 1, size_, file_)) != size_) {
+    failed_ = true;
+  }
+  size_ = 0;
+  return !failed_;
+}
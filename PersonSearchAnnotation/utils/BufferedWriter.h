@@ -0,0 +1,42 @@
+#ifndef BUFFEREDWRITER_H
+#define BUFFEREDWRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <QString>
+#include <QByteArray>
+
+class BufferedWriter
+{
+public:
+  explicit BufferedWriter(int capacity = 1 << 20);
+  ~BufferedWriter();
+
+  bool open(const QString& filePath, bool binary = false);
+  // Returns false if any write since open failed
+  bool close();
+
+  inline bool isOpen() const { return file_ != NULL; }
+
+  void write(const char* data, int size);
+  void write(const QByteArray& data) { write(data.constData(), data.size()); }
+  void write(const std::string& data) { write(data.data(), data.size()); }
+  void write(char c);
+  void writeNumber(int value);
+
+  bool flush();
+
+private:
+  BufferedWriter(const BufferedWriter&);
+  const BufferedWriter& operator = (const BufferedWriter&);
+
+private:
+  FILE* file_;
+  std::vector<char> buffer_;
+  int size_;
+  // Set by the first failed write, until the next open
+  bool failed_;
+};
+
+#endif // BUFFEREDWRITER_H
@@ -0,0 +1,170 @@
+#include "utils/CropCache.h"
+#include "utils/PreferencesManager.h"
+#include "utils/Trace.h"
+#include "utils/util_functions.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QRunnable>
+#include <QImageReader>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+static const int MaxCroppingThreads = 2;
+static const int ThumbnailHeight = 160;
+// Disk budget of the crops. The least recently used ones are removed past
+// it, checked at the first crop made and after every TrimInterval bytes.
+static const qint64 MaxCacheSize = 256 * 1024 * 1024;
+static const qint64 TrimmedCacheSize = 192 * 1024 * 1024;
+static const int TrimInterval = 16 * 1024 * 1024;
+
+// Makes the crops of all the bboxes of one image, decoding it at most once
+class CropTask : public QRunnable
+{
+public:
+  CropTask(CropCache* cache, int generation, const QString& absPath,
+           const QVector<PersonBBox>& personBBoxes)
+    : cache_(cache), generation_(generation), absPath_(absPath),
+      personBBoxes_(personBBoxes) {}
+
+  void run()
+  {
+    PSA_TRACE_SCOPE("CropTask::run");
+    QByteArray fileKey = psa::getFileKey(absPath_);
+    QImage image;
+    foreach (const PersonBBox& personBBox, personBBoxes_) {
+      if (isCancelled()) return;
+      QString cachePath = cache_->getCachePath(fileKey, personBBox);
+      QImage crop = loadCrop(cachePath);
+      if (crop.isNull()) {
+        if (image.isNull()) {
+          QImageReader imageReader(absPath_);
+          imageReader.setAutoTransform(true);
+          image = imageReader.read();
+          if (image.isNull()) return;
+        }
+        crop = makeCrop(image, personBBox);
+        if (crop.isNull()) continue;
+        QDir().mkpath(QFileInfo(cachePath).path());
+        if (crop.save(cachePath, "JPG")) cache_->cropSaved(cachePath);
+      }
+      QMetaObject::invokeMethod(cache_, "deliver", Qt::QueuedConnection,
+                                Q_ARG(int, generation_),
+                                Q_ARG(int, personBBox.getBBoxId()),
+                                Q_ARG(QImage, crop));
+    }
+  }
+
+private:
+  bool isCancelled() const
+  {
+    return cache_->generation_.load() != generation_;
+  }
+
+  static QImage loadCrop(const QString& cachePath)
+  {
+    QImage crop;
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly)) return crop;
+    // Marks the crop as used for the eviction
+    file.setFileTime(QDateTime::currentDateTime(),
+                     QFileDevice::FileModificationTime);
+    crop.load(&file, "JPG");
+    return crop;
+  }
+
+  static QImage makeCrop(const QImage& image, const PersonBBox& personBBox)
+  {
+    QRect rect = QRect(personBBox.x(), personBBox.y(),
+                       personBBox.width(), personBBox.height()) &
+                 image.rect();
+    if (rect.isEmpty()) return QImage();
+    return image.copy(rect).scaledToHeight(ThumbnailHeight,
+                                           Qt::SmoothTransformation);
+  }
+
+private:
+  CropCache* cache_;
+  int generation_;
+  QString absPath_;
+  QVector<PersonBBox> personBBoxes_;
+};
+
+CropCache::CropCache(QObject* parent)
+  : QObject(parent),
+    generation_(0),
+    savedSize_(TrimInterval)
+{
+  cacheDir_ = QDir(QStandardPaths::writableLocation(
+      QStandardPaths::CacheLocation)).filePath("crops");
+  threadPool_.setMaxThreadCount(MaxCroppingThreads);
+}
+
+CropCache::~CropCache()
+{
+  cancel();
+  threadPool_.waitForDone();
+}
+
+void CropCache::request(const QVector<PersonBBox>& personBBoxes,
+                        const QHash<int, ImageFile>& imageFiles)
+{
+  cancel();
+  int generation = generation_.load();
+  // Group the bboxes by image, keeping the order of their first bboxes
+  QVector<int> imageIds;
+  QHash<int, QVector<PersonBBox> > imagePersonBBoxes;
+  foreach (const PersonBBox& personBBox, personBBoxes) {
+    int imageId = personBBox.getImageId();
+    if (!imageFiles.contains(imageId)) continue;
+    if (!imagePersonBBoxes.contains(imageId)) imageIds.push_back(imageId);
+    imagePersonBBoxes[imageId].push_back(personBBox);
+  }
+  QDir root(PreferencesManager::instance().getImagesRootDirectory());
+  foreach (int imageId, imageIds) {
+    QString absPath = root.filePath(imageFiles.value(imageId).getPath());
+    threadPool_.start(new CropTask(this, generation, absPath,
+                                   imagePersonBBoxes.value(imageId)));
+  }
+}
+
+void CropCache::cancel()
+{
+  generation_.ref();
+  threadPool_.clear();
+}
+
+void CropCache::deliver(int generation, int bboxId, const QImage& crop)
+{
+  if (generation != generation_.load()) return;
+  emit cropLoaded(bboxId, crop);
+}
+
+void CropCache::cropSaved(const QString& cachePath)
+{
+  int size = static_cast<int>(QFileInfo(cachePath).size());
+  int savedSize = savedSize_.fetchAndAddRelaxed(size) + size;
+  // Another task may be trimming already
+  if (savedSize < TrimInterval ||
+      !savedSize_.testAndSetRelaxed(savedSize, 0)) {
+    return;
+  }
+  PSA_TRACE_SCOPE("CropCache::trim");
+  psa::trimDirectory(cacheDir_, MaxCacheSize, TrimmedCacheSize);
+}
+
+QString CropCache::getCachePath(const QByteArray& fileKey,
+                                const PersonBBox& personBBox) const
+{
+  QByteArray key = fileKey;
+  key += '|' + QByteArray::number(personBBox.x());
+  key += '|' + QByteArray::number(personBBox.y());
+  key += '|' + QByteArray::number(personBBox.width());
+  key += '|' + QByteArray::number(personBBox.height());
+  key += '|' + QByteArray::number(ThumbnailHeight);
+  QString hash = QCryptographicHash::hash(
+      key, QCryptographicHash::Sha1).toHex();
+  // Spread over subdirectories to keep them small
+  return QDir(cacheDir_).filePath(hash.left(2) + "/" + hash + ".jpg");
+}
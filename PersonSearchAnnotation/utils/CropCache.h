@@ -0,0 +1,54 @@
+#ifndef CROPCACHE_H
+#define CROPCACHE_H
+
+#include "common/ImageFile.hpp"
+#include "common/PersonBBox.hpp"
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QVector>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+// Thumbnails of bboxes, made in background and kept on disk under keys
+// derived from the image file and the bbox geometry. A moved bbox or a
+// replaced image gets a new key, so stale thumbnails are never shown.
+// The least recently used thumbnails are removed past a disk budget.
+class CropCache : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit CropCache(QObject* parent = 0);
+  ~CropCache();
+
+  // Emits cropLoaded for each bbox whose image is in imageFiles. Crops of
+  // the previous request which are not made yet are dropped.
+  void request(const QVector<PersonBBox>& personBBoxes,
+               const QHash<int, ImageFile>& imageFiles);
+  void cancel();
+
+signals:
+  void cropLoaded(int bboxId, const QImage& crop);
+
+private slots:
+  void deliver(int generation, int bboxId, const QImage& crop);
+
+private:
+  friend class CropTask;
+
+  QString getCachePath(const QByteArray& fileKey,
+                       const PersonBBox& personBBox) const;
+  // Called by the tasks, trims the cache from time to time
+  void cropSaved(const QString& cachePath);
+
+private:
+  QString cacheDir_;
+  QThreadPool threadPool_;
+  // Bumped by every request and cancel
+  QAtomicInt generation_;
+  // Bytes saved since the last trim
+  QAtomicInt savedSize_;
+};
+
+#endif // CROPCACHE_H
@@ -0,0 +1,238 @@
+#include "utils/ImageCache.h"
+#include "utils/PreferencesManager.h"
+#include "utils/Trace.h"
+#include <QDir>
+#include <QRunnable>
+#include <QImageReader>
+#include <QImageIOHandler>
+#include <QMutexLocker>
+
+static const int DefaultMaxCost = 512 * 1024;
+static const int MaxDecodingThreads = 2;
+
+static const int PrefetchPriority = 0;
+static const int RequestPriority = 1;
+
+class ImageDecodeTask : public QRunnable
+{
+public:
+  ImageDecodeTask(ImageCache* cache, int imageId, const QString& absPath,
+                  const QSize& scaledSize)
+    : cache_(cache), imageId_(imageId), absPath_(absPath),
+      scaledSize_(scaledSize) {}
+
+  void run()
+  {
+    {
+      QMutexLocker locker(&cache_->mutex_);
+      // Cancelled by a newer prefetch or taken over by getImage
+      if (!cache_->queued_.remove(imageId_)) return;
+      cache_->requested_.remove(imageId_);
+      cache_->running_.insert(imageId_);
+    }
+    cache_->decoded(imageId_, ImageCache::decode(absPath_, scaledSize_));
+  }
+
+private:
+  ImageCache* cache_;
+  int imageId_;
+  QString absPath_;
+  QSize scaledSize_;
+};
+
+ImageCache::ImageCache(QObject* parent)
+  : QObject(parent)
+{
+  cache_.setMaxCost(DefaultMaxCost);
+  threadPool_.setMaxThreadCount(MaxDecodingThreads);
+}
+
+ImageCache::~ImageCache()
+{
+  {
+    QMutexLocker locker(&mutex_);
+    queued_.clear();
+    requested_.clear();
+  }
+  threadPool_.waitForDone();
+}
+
+void ImageCache::clear()
+{
+  QMutexLocker locker(&mutex_);
+  queued_.clear();
+  requested_.clear();
+  while (!running_.isEmpty()) {
+    decodedCondition_.wait(&mutex_);
+  }
+  decoded_.clear();
+  cache_.clear();
+}
+
+int ImageCache::getMaxCost() const
+{
+  return cache_.maxCost();
+}
+
+void ImageCache::setMaxCost(int maxCost)
+{
+  cache_.setMaxCost(maxCost);
+}
+
+int ImageCache::getThreadCount() const
+{
+  return threadPool_.maxThreadCount();
+}
+
+void ImageCache::setThreadCount(int threadCount)
+{
+  threadPool_.setMaxThreadCount(threadCount);
+}
+
+QSize ImageCache::getDecodeSize() const
+{
+  return decodeSize_;
+}
+
+void ImageCache::setDecodeSize(const QSize& decodeSize)
+{
+  decodeSize_ = decodeSize;
+}
+
+bool ImageCache::contains(int imageId) const
+{
+  return cache_.contains(imageId);
+}
+
+QImage ImageCache::getImage(const ImageFile& imageFile)
+{
+  PSA_TRACE_SCOPE("ImageCache::getImage");
+  int imageId = imageFile.getImageId();
+  if (QImage* image = cache_.object(imageId)) return *image;
+
+  QImage image;
+  {
+    QMutexLocker locker(&mutex_);
+    queued_.remove(imageId);
+    requested_.remove(imageId);
+    // Wait for the prefetching thread rather than decoding twice
+    while (running_.contains(imageId)) {
+      decodedCondition_.wait(&mutex_);
+    }
+    image = decoded_.take(imageId);
+  }
+  if (image.isNull()) {
+    image = decode(getAbsolutePath(imageFile), getScaledSize(imageFile));
+  }
+  insert(imageId, image);
+  return image;
+}
+
+void ImageCache::request(const ImageFile& imageFile)
+{
+  QMutexLocker locker(&mutex_);
+  requested_.insert(imageFile.getImageId());
+  enqueue(imageFile, RequestPriority);
+}
+
+void ImageCache::requestFullResolution(const ImageFile& imageFile)
+{
+  QMutexLocker locker(&mutex_);
+  requested_.insert(imageFile.getImageId());
+  enqueue(imageFile, RequestPriority, true);
+}
+
+void ImageCache::prefetch(const QVector<ImageFile>& imageFiles)
+{
+  QMutexLocker locker(&mutex_);
+  // Frames queued by the previous prefetch are not neighbors anymore
+  queued_ = requested_;
+  foreach (const ImageFile& imageFile, imageFiles) {
+    enqueue(imageFile, PrefetchPriority);
+  }
+}
+
+void ImageCache::collectDecoded()
+{
+  QHash<int, QImage> decoded;
+  {
+    QMutexLocker locker(&mutex_);
+    decoded.swap(decoded_);
+  }
+  for (QHash<int, QImage>::const_iterator it = decoded.constBegin();
+       it != decoded.constEnd(); ++it) {
+    insert(it.key(), it.value());
+    emit imageLoaded(it.key(), it.value());
+  }
+}
+
+QString ImageCache::getAbsolutePath(const ImageFile& imageFile) const
+{
+  QDir root(PreferencesManager::instance().getImagesRootDirectory());
+  return root.filePath(imageFile.getPath());
+}
+
+QSize ImageCache::getScaledSize(const ImageFile& imageFile) const
+{
+  // The scene is laid out in the original size, which must be known
+  if (!decodeSize_.isValid() || !imageFile.hasSize()) return QSize();
+  QSize displaySize = imageFile.getDisplaySize();
+  if (displaySize.width() <= decodeSize_.width() &&
+      displaySize.height() <= decodeSize_.height()) {
+    return QSize();
+  }
+  QSize scaledSize = displaySize.scaled(decodeSize_, Qt::KeepAspectRatio);
+  // QImageReader scales before applying the orientation
+  if (imageFile.getOrientation() & QImageIOHandler::TransformationRotate90) {
+    scaledSize.transpose();
+  }
+  return scaledSize.expandedTo(QSize(1, 1));
+}
+
+void ImageCache::insert(int imageId, const QImage& image)
+{
+  if (image.isNull()) return;
+  cache_.insert(imageId, new QImage(image), image.byteCount() / 1024 + 1);
+}
+
+void ImageCache::enqueue(const ImageFile& imageFile, int priority,
+                         bool fullResolution)
+{
+  // Called with the mutex locked
+  int imageId = imageFile.getImageId();
+  QSize scaledSize = fullResolution ? QSize() : getScaledSize(imageFile);
+  const QImage* image = cache_.object(imageId);
+  if (image && (!fullResolution ||
+                image->size() == imageFile.getDisplaySize())) {
+    return;
+  }
+  // Requested again by the view once the running decode is shown
+  if (running_.contains(imageId) || decoded_.contains(imageId)) return;
+  // Already queued ones are started again with the new priority, and the
+  // task which comes later finds nothing to do.
+  queued_.insert(imageId);
+  threadPool_.start(new ImageDecodeTask(
+      this, imageId, getAbsolutePath(imageFile), scaledSize), priority);
+}
+
+void ImageCache::decoded(int imageId, const QImage& image)
+{
+  {
+    QMutexLocker locker(&mutex_);
+    running_.remove(imageId);
+    decoded_.insert(imageId, image);
+    decodedCondition_.wakeAll();
+  }
+  QMetaObject::invokeMethod(this, "collectDecoded", Qt::QueuedConnection);
+}
+
+QImage ImageCache::decode(const QString& absPath, const QSize& scaledSize)
+{
+  PSA_TRACE_SCOPE("ImageCache::decode");
+  QImageReader imageReader(absPath);
+  imageReader.setAutoTransform(true);
+  // JPEG is scaled while decoding the DCT blocks, far cheaper than reading
+  // the full image
+  if (scaledSize.isValid()) imageReader.setScaledSize(scaledSize);
+  return imageReader.read();
+}
@@ -0,0 +1,79 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "common/ImageFile.hpp"
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+
+class ImageCache : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit ImageCache(QObject* parent = 0);
+  ~ImageCache();
+
+  void clear();
+
+  // Budget of the decoded images in kilobytes
+  int getMaxCost() const;
+  void setMaxCost(int maxCost);
+
+  int getThreadCount() const;
+  void setThreadCount(int threadCount);
+
+  // Images of known size are decoded to fit in this size, in device pixels.
+  // An invalid size decodes them at full resolution.
+  QSize getDecodeSize() const;
+  void setDecodeSize(const QSize& decodeSize);
+
+  bool contains(int imageId) const;
+  QImage getImage(const ImageFile& imageFile);
+  // Decodes in background ahead of any prefetching, emits imageLoaded
+  void request(const ImageFile& imageFile);
+  // Replaces an image decoded at reduced size, emits imageLoaded
+  void requestFullResolution(const ImageFile& imageFile);
+  void prefetch(const QVector<ImageFile>& imageFiles);
+
+signals:
+  void imageLoaded(int imageId, const QImage& image);
+
+private slots:
+  void collectDecoded();
+
+private:
+  friend class ImageDecodeTask;
+
+  QString getAbsolutePath(const ImageFile& imageFile) const;
+  QSize getScaledSize(const ImageFile& imageFile) const;
+  void insert(int imageId, const QImage& image);
+  void enqueue(const ImageFile& imageFile, int priority,
+               bool fullResolution = false);
+  void decoded(int imageId, const QImage& image);
+
+  // Decodes at full resolution if scaledSize is invalid
+  static QImage decode(const QString& absPath, const QSize& scaledSize);
+
+private:
+  QCache<int, QImage> cache_;
+  QSize decodeSize_;
+  QThreadPool threadPool_;
+
+  // Shared with the decoding tasks
+  QMutex mutex_;
+  QWaitCondition decodedCondition_;
+  QSet<int> queued_;
+  QSet<int> requested_;
+  QSet<int> running_;
+  QHash<int, QImage> decoded_;
+};
+
+#endif // IMAGECACHE_H
@@ -2,6 +2,8 @@
 #include <QFile>
 #include <QDir>
 #include <QSettings>
+#include <QReadLocker>
+#include <QWriteLocker>
 
 PreferencesManager& PreferencesManager::instance()
 {
@@ -11,7 +13,11 @@ PreferencesManager& PreferencesManager::instance()
 
 PreferencesManager::PreferencesManager()
 {
-
+  // Every key is read at once, the settings are small
+  QSettings settings;
+  foreach (const QString& key, settings.allKeys()) {
+    values_.insert(key, settings.value(key));
+  }
 }
 
 PreferencesManager::~PreferencesManager()
@@ -21,25 +27,94 @@ PreferencesManager::~PreferencesManager()
 
 QString PreferencesManager::getImagesRootDirectory() const
 {
-  QSettings settings;
-  return settings.value("imagesRootDirectory", "images").toString();
+  return getValue("imagesRootDirectory", "images").toString();
 }
 
 void PreferencesManager::setImagesRootDirectory(
     const QString& imagesRootDirectory)
 {
-  QSettings settings;
-  settings.setValue("imagesRootDirectory", imagesRootDirectory);
+  setValue("imagesRootDirectory", imagesRootDirectory);
 }
 
 QString PreferencesManager::getDatabaseFilePath() const
 {
-  QSettings settings;
-  return settings.value("databaseFilePath", "annotation.sqlite").toString();
+  return getValue("databaseFilePath", "annotation.sqlite").toString();
 }
 
 void PreferencesManager::setDatabaseFilePath(const QString &databaseFilePath)
 {
-  QSettings settings;
-  settings.setValue("databaseFilePath", databaseFilePath);
+  setValue("databaseFilePath", databaseFilePath);
+}
+
+bool PreferencesManager::getConcurrentMode() const
+{
+  return getValue("concurrentMode", false).toBool();
+}
+
+void PreferencesManager::setConcurrentMode(bool concurrentMode)
+{
+  setValue("concurrentMode", concurrentMode);
+}
+
+int PreferencesManager::getImageCacheSize() const
+{
+  return getValue("imageCacheSize", 512).toInt();
+}
+
+void PreferencesManager::setImageCacheSize(int imageCacheSize)
+{
+  setValue("imageCacheSize", imageCacheSize);
+}
+
+int PreferencesManager::getPrefetchDepth() const
+{
+  return getValue("prefetchDepth", 3).toInt();
+}
+
+void PreferencesManager::setPrefetchDepth(int prefetchDepth)
+{
+  setValue("prefetchDepth", prefetchDepth);
+}
+
+int PreferencesManager::getDecodingThreadCount() const
+{
+  return getValue("decodingThreadCount", 2).toInt();
+}
+
+void PreferencesManager::setDecodingThreadCount(int decodingThreadCount)
+{
+  setValue("decodingThreadCount", decodingThreadCount);
+}
+
+int PreferencesManager::getDatabaseCacheSize() const
+{
+  return getValue("databaseCacheSize", 64).toInt();
+}
+
+void PreferencesManager::setDatabaseCacheSize(int databaseCacheSize)
+{
+  setValue("databaseCacheSize", databaseCacheSize);
+}
+
+QVariant PreferencesManager::getValue(const QString& key,
+                                      const QVariant& defaultValue) const
+{
+  QReadLocker locker(&lock_);
+  return values_.value(key, defaultValue);
+}
+
+void PreferencesManager::setValue(const QString& key, const QVariant& value)
+{
+  {
+    QWriteLocker locker(&lock_);
+    QHash<QString, QVariant>::const_iterator it = values_.constFind(key);
+    // Values read back from INI files are strings
+    if (it != values_.constEnd() && it.value().toString() == value.toString()) {
+      return;
+    }
+    values_.insert(key, value);
+    QSettings settings;
+    settings.setValue(key, value);
+  }
+  emit preferenceChanged(key);
 }
@@ -1,10 +1,18 @@
 #ifndef PREFERENCESMANAGER_H
 #define PREFERENCESMANAGER_H
 
+#include <QObject>
 #include <QString>
+#include <QVariant>
+#include <QHash>
+#include <QReadWriteLock>
 
-class PreferencesManager
+// Settings read once and kept in memory. Getters may be called from any
+// thread, setters write through to QSettings.
+class PreferencesManager : public QObject
 {
+  Q_OBJECT
+
 public:
   static PreferencesManager& instance();
 
@@ -14,11 +22,41 @@ public:
   QString getDatabaseFilePath() const;
   void setDatabaseFilePath(const QString& databaseFilePath);
 
+  // Shares the database with other annotators, see DatabaseHelper::init
+  bool getConcurrentMode() const;
+  void setConcurrentMode(bool concurrentMode);
+
+  // Budget of the decoded images in megabytes
+  int getImageCacheSize() const;
+  void setImageCacheSize(int imageCacheSize);
+
+  // Images decoded ahead on each side of the shown ones
+  int getPrefetchDepth() const;
+  void setPrefetchDepth(int prefetchDepth);
+
+  int getDecodingThreadCount() const;
+  void setDecodingThreadCount(int decodingThreadCount);
+
+  // SQLite page cache in megabytes
+  int getDatabaseCacheSize() const;
+  void setDatabaseCacheSize(int databaseCacheSize);
+
+signals:
+  // Emitted with the settings key, only if the value has changed
+  void preferenceChanged(const QString& key);
+
 private:
   PreferencesManager();
   PreferencesManager(const PreferencesManager&);
   const PreferencesManager& operator = (const PreferencesManager&);
   ~PreferencesManager();
+
+  QVariant getValue(const QString& key, const QVariant& defaultValue) const;
+  void setValue(const QString& key, const QVariant& value);
+
+private:
+  mutable QReadWriteLock lock_;
+  QHash<QString, QVariant> values_;
 };
 
 #endif // PREFERENCESMANAGER_H
@@ -0,0 +1,170 @@
+#include "utils/ThumbnailCache.h"
+#include "utils/PreferencesManager.h"
+#include "utils/Trace.h"
+#include "utils/util_functions.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QRunnable>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+const QSize ThumbnailCache::ThumbnailSize(128, 96);
+
+// Enough for the thumbnails on screen and a few pages around them
+static const int MaxThumbnails = 1024;
+static const int MaxWanted = 64;
+static const int MaxThumbnailingThreads = 2;
+// Disk budget of the thumbnails, a few kilobytes each. The least recently
+// used ones are removed past it, like the crops of CropCache.
+static const qint64 MaxCacheSize = 512 * 1024 * 1024;
+static const qint64 TrimmedCacheSize = 384 * 1024 * 1024;
+static const int TrimInterval = 16 * 1024 * 1024;
+
+class ThumbnailTask : public QRunnable
+{
+public:
+  ThumbnailTask(ThumbnailCache* cache, int imageId, const QString& absPath)
+    : cache_(cache), imageId_(imageId), absPath_(absPath) {}
+
+  void run()
+  {
+    // Scrolled away before its turn
+    if (!cache_->isWanted(imageId_)) return;
+    PSA_TRACE_SCOPE("ThumbnailTask::run");
+    QString cachePath = cache_->getCachePath(absPath_);
+    QImage thumbnail = loadThumbnail(cachePath);
+    if (thumbnail.isNull()) {
+      thumbnail = ThumbnailCache::makeThumbnail(absPath_);
+      if (!thumbnail.isNull()) {
+        QDir().mkpath(QFileInfo(cachePath).path());
+        if (thumbnail.save(cachePath, "JPG")) {
+          cache_->thumbnailSaved(cachePath);
+        }
+      }
+    }
+    QMetaObject::invokeMethod(cache_, "deliver", Qt::QueuedConnection,
+                              Q_ARG(int, imageId_), Q_ARG(QImage, thumbnail));
+  }
+
+private:
+  static QImage loadThumbnail(const QString& cachePath)
+  {
+    QImage thumbnail;
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly)) return thumbnail;
+    // Marks the thumbnail as used for the eviction
+    file.setFileTime(QDateTime::currentDateTime(),
+                     QFileDevice::FileModificationTime);
+    thumbnail.load(&file, "JPG");
+    return thumbnail;
+  }
+
+private:
+  ThumbnailCache* cache_;
+  int imageId_;
+  QString absPath_;
+};
+
+ThumbnailCache::ThumbnailCache(QObject* parent)
+  : QObject(parent),
+    savedSize_(TrimInterval)
+{
+  cacheDir_ = QDir(QStandardPaths::writableLocation(
+      QStandardPaths::CacheLocation)).filePath("thumbnails");
+  cache_.setMaxCost(MaxThumbnails);
+  threadPool_.setMaxThreadCount(MaxThumbnailingThreads);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+  clear();
+  threadPool_.waitForDone();
+}
+
+void ThumbnailCache::clear()
+{
+  {
+    QMutexLocker locker(&mutex_);
+    wanted_.clear();
+  }
+  threadPool_.clear();
+  cache_.clear();
+}
+
+QImage ThumbnailCache::getThumbnail(const ImageFile& imageFile)
+{
+  int imageId = imageFile.getImageId();
+  if (QImage* thumbnail = cache_.object(imageId)) return *thumbnail;
+
+  QMutexLocker locker(&mutex_);
+  if (wanted_.contains(imageId)) return QImage();
+  wanted_.push_back(imageId);
+  if (wanted_.size() > MaxWanted) wanted_.pop_front();
+  QDir root(PreferencesManager::instance().getImagesRootDirectory());
+  threadPool_.start(new ThumbnailTask(this, imageId,
+                                      root.filePath(imageFile.getPath())));
+  return QImage();
+}
+
+void ThumbnailCache::deliver(int imageId, const QImage& thumbnail)
+{
+  {
+    QMutexLocker locker(&mutex_);
+    wanted_.removeOne(imageId);
+  }
+  // Broken images are not tried again
+  cache_.insert(imageId, new QImage(thumbnail));
+  emit thumbnailLoaded(imageId, thumbnail);
+}
+
+bool ThumbnailCache::isWanted(int imageId)
+{
+  QMutexLocker locker(&mutex_);
+  return wanted_.contains(imageId);
+}
+
+void ThumbnailCache::thumbnailSaved(const QString& cachePath)
+{
+  int size = static_cast<int>(QFileInfo(cachePath).size());
+  int savedSize = savedSize_.fetchAndAddRelaxed(size) + size;
+  // Another task may be trimming already
+  if (savedSize < TrimInterval ||
+      !savedSize_.testAndSetRelaxed(savedSize, 0)) {
+    return;
+  }
+  PSA_TRACE_SCOPE("ThumbnailCache::trim");
+  psa::trimDirectory(cacheDir_, MaxCacheSize, TrimmedCacheSize);
+}
+
+QString ThumbnailCache::getCachePath(const QString& absPath) const
+{
+  QByteArray key = psa::getFileKey(absPath);
+  key += '|' + QByteArray::number(ThumbnailSize.width());
+  key += '|' + QByteArray::number(ThumbnailSize.height());
+  QString hash = QCryptographicHash::hash(
+      key, QCryptographicHash::Sha1).toHex();
+  return QDir(cacheDir_).filePath(hash.left(2) + "/" + hash + ".jpg");
+}
+
+QImage ThumbnailCache::makeThumbnail(const QString& absPath)
+{
+  // Decoders such as JPEG's skip most of the work at reduced sizes
+  QImageReader imageReader(absPath);
+  imageReader.setAutoTransform(true);
+  QSize size = imageReader.size();
+  if (size.isValid()) {
+    imageReader.setScaledSize(size.scaled(ThumbnailSize, Qt::KeepAspectRatio));
+  }
+  QImage thumbnail = imageReader.read();
+  // Rotated by the orientation after scaling
+  if (thumbnail.width() > ThumbnailSize.width() ||
+      thumbnail.height() > ThumbnailSize.height()) {
+    thumbnail = thumbnail.scaled(ThumbnailSize, Qt::KeepAspectRatio,
+                                 Qt::SmoothTransformation);
+  }
+  return thumbnail;
+}
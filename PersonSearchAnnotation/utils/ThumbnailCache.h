@@ -0,0 +1,62 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include "common/ImageFile.hpp"
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSize>
+#include <QThreadPool>
+
+// Small previews of whole images, decoded at a reduced size in background.
+// Kept in memory within a fixed budget and on disk under keys derived from
+// the image files, like the crops of CropCache, within a disk budget too.
+class ThumbnailCache : public QObject
+{
+  Q_OBJECT
+
+public:
+  static const QSize ThumbnailSize;
+
+public:
+  explicit ThumbnailCache(QObject* parent = 0);
+  ~ThumbnailCache();
+
+  void clear();
+
+  // Returns a null image and emits thumbnailLoaded later if not in memory.
+  // Only the latest requests are served, older ones are dropped.
+  QImage getThumbnail(const ImageFile& imageFile);
+
+signals:
+  void thumbnailLoaded(int imageId, const QImage& thumbnail);
+
+private slots:
+  void deliver(int imageId, const QImage& thumbnail);
+
+private:
+  friend class ThumbnailTask;
+
+  bool isWanted(int imageId);
+  QString getCachePath(const QString& absPath) const;
+  // Called by the tasks, trims the cache from time to time
+  void thumbnailSaved(const QString& cachePath);
+
+  static QImage makeThumbnail(const QString& absPath);
+
+private:
+  QString cacheDir_;
+  QCache<int, QImage> cache_;
+  QThreadPool threadPool_;
+
+  // Shared with the tasks, most recent last
+  QMutex mutex_;
+  QList<int> wanted_;
+  // Bytes saved since the last trim
+  QAtomicInt savedSize_;
+};
+
+#endif // THUMBNAILCACHE_H
@@ -0,0 +1,224 @@
+#include "utils/Trace.h"
+#include "utils/BufferedWriter.h"
+#include <cstring>
+#include <algorithm>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+
+static const int BufferCapacity = 1 << 16;
+
+namespace
+{
+
+struct ThreadBuffer
+{
+  QMutex mutex;
+  int threadId;
+  QString threadName;
+  QVector<Trace::Event> events;
+  // Recorded since the last clear, the latest BufferCapacity are kept
+  qint64 count;
+  // Its thread has finished, the next new thread takes it over
+  bool released;
+};
+
+// Releases the buffer of the thread as the thread finishes
+struct BufferHolder
+{
+  BufferHolder() : buffer(NULL) {}
+  ~BufferHolder();
+
+  ThreadBuffer* buffer;
+};
+
+// Buffers outlive their threads, so that the events of finished threads
+// can still be written until a new thread reuses the buffer. Thread pools
+// come and go without the buffers piling up.
+struct Registry
+{
+  ~Registry() { qDeleteAll(buffers); }
+
+  QMutex mutex;
+  QList<ThreadBuffer*> buffers;
+};
+
+struct Clock
+{
+  Clock() { timer.start(); }
+
+  QElapsedTimer timer;
+};
+
+}
+
+Q_GLOBAL_STATIC(Registry, registry)
+Q_GLOBAL_STATIC(Clock, traceClock)
+
+// Kept apart from the holder, which is looked up only once per thread
+static thread_local ThreadBuffer* currentBuffer = NULL;
+static thread_local BufferHolder currentBufferHolder;
+
+BufferHolder::~BufferHolder()
+{
+  currentBuffer = NULL;
+  if (!buffer || registry.isDestroyed()) return;
+  QMutexLocker locker(&registry()->mutex);
+  buffer->released = true;
+}
+
+static ThreadBuffer* getCurrentBuffer()
+{
+  if (currentBuffer) return currentBuffer;
+  QThread* thread = QThread::currentThread();
+  QCoreApplication* application = QCoreApplication::instance();
+  QMutexLocker locker(&registry()->mutex);
+  // The events of the finished thread are overwritten as new ones come
+  ThreadBuffer* buffer = NULL;
+  foreach (ThreadBuffer* releasedBuffer, registry()->buffers) {
+    if (releasedBuffer->released) {
+      buffer = releasedBuffer;
+      break;
+    }
+  }
+  if (!buffer) {
+    buffer = new ThreadBuffer;
+    buffer->events.resize(BufferCapacity);
+    buffer->count = 0;
+    buffer->threadId = registry()->buffers.size() + 1;
+    registry()->buffers.push_back(buffer);
+  }
+  buffer->released = false;
+  buffer->threadName = thread->objectName();
+  if (buffer->threadName.isEmpty()) {
+    buffer->threadName = application && application->thread() == thread ?
+        QString("Main") : QString("Thread %1").arg(buffer->threadId);
+  }
+  currentBuffer = buffer;
+  currentBufferHolder.buffer = buffer;
+  return buffer;
+}
+
+static bool isEarlier(const Trace::Event& a, const Trace::Event& b)
+{
+  return a.begin < b.begin;
+}
+
+static void writeText(BufferedWriter* writer, const char* text)
+{
+  writer->write(text, static_cast<int>(strlen(text)));
+}
+
+// Chrome expects microseconds, the nanoseconds go after the point
+static void writeMicroseconds(BufferedWriter* writer, qint64 nanoseconds)
+{
+  char text[4] = {'.', '0', '0', '0'};
+  int fraction = static_cast<int>(nanoseconds % 1000);
+  for (int i = 3; i > 0; --i, fraction /= 10) {
+    text[i] = static_cast<char>('0' + fraction % 10);
+  }
+  writer->write(QByteArray::number(nanoseconds / 1000));
+  writer->write(text, 4);
+}
+
+QAtomicInt Trace::enabled_(0);
+
+void Trace::setEnabled(bool enabled)
+{
+  // Starts the clock before the first scope needs it
+  now();
+  enabled_.store(enabled ? 1 : 0);
+}
+
+void Trace::clear()
+{
+  QMutexLocker locker(&registry()->mutex);
+  foreach (ThreadBuffer* buffer, registry()->buffers) {
+    QMutexLocker bufferLocker(&buffer->mutex);
+    buffer->count = 0;
+  }
+}
+
+qint64 Trace::now()
+{
+  return traceClock()->timer.nsecsElapsed();
+}
+
+void Trace::record(const char* name, qint64 begin, qint64 end)
+{
+  ThreadBuffer* buffer = getCurrentBuffer();
+  // Only ever contended by a reader
+  QMutexLocker locker(&buffer->mutex);
+  Event& event = buffer->events[buffer->count % BufferCapacity];
+  event.name = name;
+  event.begin = begin;
+  event.end = end;
+  event.threadId = buffer->threadId;
+  ++buffer->count;
+}
+
+QVector<Trace::Event> Trace::getEvents(qint64 since)
+{
+  QVector<Event> events;
+  {
+    QMutexLocker locker(&registry()->mutex);
+    foreach (ThreadBuffer* buffer, registry()->buffers) {
+      QMutexLocker bufferLocker(&buffer->mutex);
+      for (qint64 i = std::max(buffer->count - BufferCapacity, qint64(0));
+           i < buffer->count; ++i) {
+        const Event& event = buffer->events[i % BufferCapacity];
+        if (event.begin >= since) events.push_back(event);
+      }
+    }
+  }
+  std::stable_sort(events.begin(), events.end(), isEarlier);
+  return events;
+}
+
+bool Trace::writeChromeTrace(const QString& filePath)
+{
+  QVector<Event> events = getEvents();
+  QList<QPair<int, QString> > threadNames;
+  {
+    QMutexLocker locker(&registry()->mutex);
+    foreach (ThreadBuffer* buffer, registry()->buffers) {
+      threadNames.push_back(qMakePair(buffer->threadId, buffer->threadName));
+    }
+  }
+
+  BufferedWriter writer;
+  if (!writer.open(filePath)) return false;
+  writeText(&writer, "{\"traceEvents\":[");
+  const char* separator = "\n";
+  for (int i = 0; i < threadNames.size(); ++i) {
+    // Quotes and backslashes would break the JSON
+    QString threadName = threadNames[i].second;
+    threadName.replace('"', '\'').replace('\\', '/');
+    writeText(&writer, separator);
+    writeText(&writer, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":");
+    writer.writeNumber(threadNames[i].first);
+    writeText(&writer, ",\"args\":{\"name\":\"");
+    writer.write(threadName.toUtf8());
+    writeText(&writer, "\"}}");
+    separator = ",\n";
+  }
+  foreach (const Event& event, events) {
+    writeText(&writer, separator);
+    writeText(&writer, "{\"ph\":\"X\",\"cat\":\"psa\",\"pid\":1,\"tid\":");
+    writer.writeNumber(event.threadId);
+    writeText(&writer, ",\"name\":\"");
+    writeText(&writer, event.name);
+    writeText(&writer, "\",\"ts\":");
+    writeMicroseconds(&writer, event.begin);
+    writeText(&writer, ",\"dur\":");
+    writeMicroseconds(&writer, event.end - event.begin);
+    writer.write('}');
+    separator = ",\n";
+  }
+  writeText(&writer, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  return writer.close();
+}
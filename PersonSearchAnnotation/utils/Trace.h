@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QVector>
+#include <QAtomicInt>
+
+// Timings of scopes on the hot paths, kept in a ring buffer per thread and
+// written in the trace event format of chrome://tracing. Off by default, a
+// scope then costs a single atomic load. Building with PSA_NO_TRACE removes
+// the scopes altogether.
+class Trace
+{
+public:
+  struct Event
+  {
+    // A string literal
+    const char* name;
+    // Nanoseconds since the first call of now()
+    qint64 begin;
+    qint64 end;
+    int threadId;
+  };
+
+public:
+  static inline bool isEnabled() { return enabled_.load() != 0; }
+  static void setEnabled(bool enabled);
+  // Drops the recorded events of all threads
+  static void clear();
+
+  static qint64 now();
+  static void record(const char* name, qint64 begin, qint64 end);
+
+  // Events of all threads which began at or after since, oldest first
+  static QVector<Event> getEvents(qint64 since = 0);
+  static bool writeChromeTrace(const QString& filePath);
+
+private:
+  static QAtomicInt enabled_;
+};
+
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* name)
+    : name_(Trace::isEnabled() ? name : NULL),
+      begin_(name_ ? Trace::now() : 0) {}
+  ~TraceScope()
+  {
+    if (name_) Trace::record(name_, begin_, Trace::now());
+  }
+
+private:
+  TraceScope(const TraceScope&);
+  const TraceScope& operator = (const TraceScope&);
+
+private:
+  const char* name_;
+  qint64 begin_;
+};
+
+#ifdef PSA_NO_TRACE
+#define PSA_TRACE_SCOPE(name)
+#else
+#define PSA_TRACE_CONCAT_(a, b) a##b
+#define PSA_TRACE_CONCAT(a, b) PSA_TRACE_CONCAT_(a, b)
+// Times the rest of the enclosing block
+#define PSA_TRACE_SCOPE(name) \
+  TraceScope PSA_TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif // TRACE_H
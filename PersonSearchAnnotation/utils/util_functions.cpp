@@ -1,10 +1,172 @@
 #include "utils/util_functions.h"
 #include <cmath>
+#include <climits>
+#include <algorithm>
 #include <QFileInfoList>
+#include <QDateTime>
 #include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QVector>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 namespace psa {
 
+namespace {
+
+// Directories still to be listed, shared by the walking threads
+struct DirectoryWalk
+{
+  DirectoryWalk() : numBusy(0) {}
+
+  QMutex mutex;
+  QWaitCondition changed;
+  QStringList pendingDirs;
+  // Directories listed already, see getDirectoryKey
+  QSet<QString> visitedDirs;
+  int numBusy;
+  QStringList imageFilePaths;
+};
+
+struct TrimmedFile
+{
+  QString path;
+  qint64 lastModified;
+  qint64 size;
+};
+
+// Same for all the paths of a directory, symlinks included, so that links
+// to an ancestor do not walk the tree again and again
+QString getDirectoryKey(const QString& dirPath)
+{
+#ifdef Q_OS_UNIX
+  struct stat st;
+  if (stat(QFile::encodeName(dirPath).constData(), &st) != 0) return dirPath;
+  return QString("%1:%2").arg(static_cast<quint64>(st.st_dev))
+                         .arg(static_cast<quint64>(st.st_ino));
+#else
+  QString canonicalPath = QFileInfo(dirPath).canonicalFilePath();
+  return canonicalPath.isEmpty() ? dirPath : canonicalPath;
+#endif
+}
+
+// Lists a single directory level without building QFileInfo for the entries
+void listDirectory(const QString& dirPath, QStringList* imageFilePaths,
+                   QStringList* subDirPaths)
+{
+#ifdef Q_OS_UNIX
+  QByteArray encodedDirPath = QFile::encodeName(dirPath);
+  DIR* dir = opendir(encodedDirPath.constData());
+  if (dir == NULL) return;
+  while (struct dirent* entry = readdir(dir)) {
+    const char* name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' ||
+                           (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    bool isDir = false;
+    bool isFile = false;
+    if (entry->d_type == DT_DIR) {
+      isDir = true;
+    } else if (entry->d_type == DT_REG) {
+      isFile = true;
+    } else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+      // Some file systems do not report the type, and links need a stat
+      struct stat st;
+      QByteArray path = encodedDirPath + '/' + name;
+      if (stat(path.constData(), &st) != 0) continue;
+      isDir = S_ISDIR(st.st_mode);
+      isFile = S_ISREG(st.st_mode);
+    }
+    if (isDir) {
+      subDirPaths->push_back(dirPath + '/' + QFile::decodeName(name));
+    } else if (isFile) {
+      QString fileName = QFile::decodeName(name);
+      if (isImageFileName(fileName)) {
+        imageFilePaths->push_back(dirPath + '/' + fileName);
+      }
+    }
+  }
+  closedir(dir);
+#else
+  QDirIterator it(dirPath, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+  while (it.hasNext()) {
+    QString path = it.next();
+    if (it.fileInfo().isDir()) {
+      subDirPaths->push_back(path);
+    } else if (isImageFileName(it.fileName())) {
+      imageFilePaths->push_back(path);
+    }
+  }
+#endif
+}
+
+void walkDirectories(DirectoryWalk* walk)
+{
+  QMutexLocker locker(&walk->mutex);
+  while (true) {
+    while (walk->pendingDirs.isEmpty() && walk->numBusy > 0) {
+      walk->changed.wait(&walk->mutex);
+    }
+    if (walk->pendingDirs.isEmpty()) break;
+    QString dirPath = walk->pendingDirs.takeLast();
+    ++walk->numBusy;
+    locker.unlock();
+
+    QString dirKey = getDirectoryKey(dirPath);
+    locker.relock();
+    bool visited = walk->visitedDirs.contains(dirKey);
+    walk->visitedDirs.insert(dirKey);
+    if (visited) {
+      --walk->numBusy;
+      walk->changed.wakeAll();
+      continue;
+    }
+    locker.unlock();
+
+    QStringList imageFilePaths;
+    QStringList subDirPaths;
+    listDirectory(dirPath, &imageFilePaths, &subDirPaths);
+
+    locker.relock();
+    walk->imageFilePaths.append(imageFilePaths);
+    walk->pendingDirs.append(subDirPaths);
+    --walk->numBusy;
+    walk->changed.wakeAll();
+  }
+}
+
+int compareDigitRuns(const QString& a, int* i, const QString& b, int* j)
+{
+  // Skip leading zeros, then the longer run is the larger number
+  while (*i < a.size() && a[*i] == '0') ++*i;
+  while (*j < b.size() && b[*j] == '0') ++*j;
+  int startA = *i;
+  int startB = *j;
+  while (*i < a.size() && a[*i].isDigit()) ++*i;
+  while (*j < b.size() && b[*j].isDigit()) ++*j;
+  int lengthA = *i - startA;
+  int lengthB = *j - startB;
+  if (lengthA != lengthB) return lengthA < lengthB ? -1 : 1;
+  for (int k = 0; k < lengthA; ++k) {
+    if (a[startA + k] != b[startB + k]) {
+      return a[startA + k] < b[startB + k] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+}
+
 void listImageFiles(const QString& dirPath, QStringList* imageFilePaths)
 {
   QStringList filter;
@@ -17,10 +179,135 @@ void listImageFiles(const QString& dirPath, QStringList* imageFilePaths)
   }
 }
 
+void listImageFilesRecursively(const QString& dirPath,
+                               QStringList* imageFilePaths,
+                               int numThreads)
+{
+  if (numThreads <= 0) {
+    // Listing is mostly waiting for the (network) file system
+    numThreads = std::max(4, QThread::idealThreadCount() * 2);
+  }
+  DirectoryWalk walk;
+  walk.pendingDirs.push_back(QDir(dirPath).absolutePath());
+  QThreadPool threadPool;
+  threadPool.setMaxThreadCount(numThreads);
+  for (int i = 0; i < numThreads; ++i) {
+    QtConcurrent::run(&threadPool, walkDirectories, &walk);
+  }
+  threadPool.waitForDone();
+  imageFilePaths->swap(walk.imageFilePaths);
+}
+
+bool isImageFileName(const QString& fileName)
+{
+  return fileName.endsWith(".png", Qt::CaseInsensitive) ||
+         fileName.endsWith(".bmp", Qt::CaseInsensitive) ||
+         fileName.endsWith(".jpg", Qt::CaseInsensitive) ||
+         fileName.endsWith(".jpeg", Qt::CaseInsensitive);
+}
+
+QByteArray getFileKey(const QString& filePath)
+{
+  QFileInfo fileInfo(filePath);
+  return filePath.toUtf8() + '|' +
+         QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()) +
+         '|' + QByteArray::number(fileInfo.size());
+}
+
+void trimDirectory(const QString& dirPath, qint64 maxSize,
+                   qint64 trimmedSize)
+{
+  QVector<TrimmedFile> files;
+  qint64 totalSize = 0;
+  QDirIterator it(dirPath, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    TrimmedFile file;
+    file.path = it.next();
+    file.lastModified = it.fileInfo().lastModified().toMSecsSinceEpoch();
+    file.size = it.fileInfo().size();
+    files.push_back(file);
+    totalSize += file.size;
+  }
+  if (totalSize <= maxSize) return;
+  std::sort(files.begin(), files.end(),
+            [](const TrimmedFile& a, const TrimmedFile& b) {
+    return a.lastModified < b.lastModified;
+  });
+  for (int i = 0; i < files.size() && totalSize > trimmedSize; ++i) {
+    if (QFile::remove(files[i].path)) totalSize -= files[i].size;
+  }
+}
+
+bool naturalLessThan(const QString& a, const QString& b)
+{
+  int i = 0;
+  int j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i].isDigit() && b[j].isDigit()) {
+      int result = compareDigitRuns(a, &i, b, &j);
+      if (result != 0) return result < 0;
+    } else {
+      if (a[i] != b[j]) return a[i] < b[j];
+      ++i;
+      ++j;
+    }
+  }
+  if (a.size() - i != b.size() - j) return a.size() - i < b.size() - j;
+  // Equal up to leading zeros
+  return a < b;
+}
+
+void naturalSort(QStringList* strings)
+{
+  std::sort(strings->begin(), strings->end(), naturalLessThan);
+}
+
 qreal euclideanDist(const QPointF& a, const QPointF& b)
 {
   return std::sqrt((a.x() - b.x()) * (a.x() - b.x()) +
                    (a.y() - b.y()) * (a.y() - b.y()));
 }
 
+int formatNumber(int value, char* text)
+{
+  // Work on the negative magnitude so that INT_MIN does not overflow
+  char digits[10];
+  int numDigits = 0;
+  int n = value < 0 ? value : -value;
+  do {
+    digits[numDigits++] = static_cast<char>('0' - n % 10);
+    n /= 10;
+  } while (n != 0);
+  int length = 0;
+  if (value < 0) text[length++] = '-';
+  while (numDigits > 0) {
+    text[length++] = digits[--numDigits];
+  }
+  return length;
+}
+
+void appendNumber(std::string* text, int value)
+{
+  char buffer[16];
+  text->append(buffer, formatNumber(value, buffer));
+}
+
+const char* parseNumber(const char* text, const char* end, int* value)
+{
+  bool negative = text < end && *text == '-';
+  const char* p = negative ? text + 1 : text;
+  // Ten digits at most, which cannot overflow in 64 bits
+  qint64 n = 0;
+  const char* digits = p;
+  while (p < end && *p >= '0' && *p <= '9' && p - digits < 10) {
+    n = n * 10 + (*p - '0');
+    ++p;
+  }
+  if (p == digits || (p < end && *p >= '0' && *p <= '9')) return NULL;
+  if (negative) n = -n;
+  if (n < INT_MIN || n > INT_MAX) return NULL;
+  *value = static_cast<int>(n);
+  return p;
+}
+
 }
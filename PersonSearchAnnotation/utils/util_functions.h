@@ -1,17 +1,44 @@
 #ifndef UTIL_FUNCTIONS_H
 #define UTIL_FUNCTIONS_H
 
+#include <string>
 #include <QString>
 #include <QStringList>
+#include <QByteArray>
 #include <QPointF>
 
 namespace psa
 {
 
 void listImageFiles(const QString& dirPath, QStringList* imageFilePaths);
+// Lists the images of the whole directory tree on multiple threads, in no
+// particular order. Uses an automatic number of threads if numThreads <= 0.
+// Directories reached again through symlinks are listed once.
+void listImageFilesRecursively(const QString& dirPath,
+                               QStringList* imageFilePaths,
+                               int numThreads = 0);
+
+bool isImageFileName(const QString& fileName);
+// Changes whenever the file is replaced or modified, for keying caches
+QByteArray getFileKey(const QString& filePath);
+// Removes the least recently modified files of the directory tree, if they
+// take more than maxSize bytes, until they take at most trimmedSize
+void trimDirectory(const QString& dirPath, qint64 maxSize,
+                   qint64 trimmedSize);
+// Compares digit runs by their numeric values, so "9.jpg" < "10.jpg"
+bool naturalLessThan(const QString& a, const QString& b);
+void naturalSort(QStringList* strings);
 
 qreal euclideanDist(const QPointF& a, const QPointF& b);
 
+// Writes the decimal digits of value into text without a terminating null,
+// returns the number of chars written. text must hold at least 11 chars.
+int formatNumber(int value, char* text);
+void appendNumber(std::string* text, int value);
+// Parses a decimal integer at the start of [text, end). Returns the end of
+// the number, or NULL if there is no number or it does not fit in an int.
+const char* parseNumber(const char* text, const char* end, int* value);
+
 }
 
 #endif // UTIL_FUNCTIONS_H